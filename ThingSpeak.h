@@ -31,12 +31,83 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <strings.h>
 #include <string>
 #include "mbed.h"
+#ifndef THINGSPEAK_HTTPS
+#define THINGSPEAK_HTTPS 0  // Connect to ThingSpeak with HTTPS, the root CA has to be set with setRootCA()
+#endif
 #include "http_request.h"
+#if THINGSPEAK_HTTPS
+#include "https_request.h"
+#endif
+#include "BlockDevice.h"
 
 #define THINGSPEAK_URL "api.thingspeak.com"
+#if THINGSPEAK_HTTPS
+#define THINGSPEAK_PORT_NUMBER 443
+#else
 #define THINGSPEAK_PORT_NUMBER 80
+#endif
+
+#define THINGSPEAK_MQTT_URL "mqtt3.thingspeak.com"
+#define THINGSPEAK_MQTT_PORT 1883
+#ifndef THINGSPEAK_MQTT_KEEPALIVE
+#define THINGSPEAK_MQTT_KEEPALIVE 60  // Seconds a MQTT connection may be idle
+#endif
+
+#ifndef THINGSPEAK_ASYNC_QUEUE_EVENTS
+#define THINGSPEAK_ASYNC_QUEUE_EVENTS 8     // Max number of pending asynchronous requests
+#endif
+#ifndef THINGSPEAK_ASYNC_STACK_SIZE
+#define THINGSPEAK_ASYNC_STACK_SIZE 4096    // Stack size of the thread executing asynchronous requests
+#endif
+
+#ifndef THINGSPEAK_DNS_TTL
+#define THINGSPEAK_DNS_TTL 3600  // Seconds the resolved address of the ThingSpeak server is reused
+#endif
+
+#ifndef THINGSPEAK_KEEPALIVE
+#define THINGSPEAK_KEEPALIVE 1  // Keep the connection to ThingSpeak open between requests
+#endif
+
+#ifndef THINGSPEAK_RETRY_ATTEMPTS
+#define THINGSPEAK_RETRY_ATTEMPTS 1       // Attempts of a write until it is given up, 1 disables the retries, see setRetryPolicy()
+#endif
+#ifndef THINGSPEAK_RETRY_BASE_DELAY
+#define THINGSPEAK_RETRY_BASE_DELAY 1000  // Max delay before the first retry in ms, doubles with each further one
+#endif
+#ifndef THINGSPEAK_RETRY_MAX_DELAY
+#define THINGSPEAK_RETRY_MAX_DELAY 30000  // Max delay between two attempts in ms
+#endif
+
+#ifndef THINGSPEAK_READ_CACHE
+#define THINGSPEAK_READ_CACHE 4  // Number of responses kept for conditional reads, 0 disables them
+#endif
+#ifndef THINGSPEAK_READ_CACHE_BYTES
+#define THINGSPEAK_READ_CACHE_BYTES 1024  // Max bytes of the responses and validators kept, the least recently used ones are dropped beyond
+#endif
+#ifndef THINGSPEAK_READ_CACHE_TTL
+#define THINGSPEAK_READ_CACHE_TTL 0  // ms a cached response is returned without any request, 0 revalidates each read, see setReadCacheTTL()
+#endif
+
+#ifndef THINGSPEAK_PIPELINE_DEPTH
+#define THINGSPEAK_PIPELINE_DEPTH 8  // Max reads of readPipelined() sent before their responses are read
+#endif
+
+#ifndef THINGSPEAK_POOL_SIZE
+#define THINGSPEAK_POOL_SIZE 1  // Number of connections to ThingSpeak requests of different threads are spread across
+#endif
+
+#ifndef THINGSPEAK_STATS
+#define THINGSPEAK_STATS 1  // Collect request statistics, see getStats()
+#endif
+#define THINGSPEAK_STATS_CODES 8      // Number of distinct status codes counted
+#define THINGSPEAK_STATS_BUCKETS 8    // Buckets of the request time histogram, the first one ends at 50 ms, each next one doubles
+#ifndef THINGSPEAK_HEAP_STATS
+#define THINGSPEAK_HEAP_STATS 0  // Profile the heap and stack use of each public call, needs THINGSPEAK_STATS and the mbed heap stats, see getStats()
+#endif
+#define THINGSPEAK_HEAP_STATS_APIS 32  // Distinct public calls profiled
 
 #define TS_USER_AGENT "tslib-mbed/" TS_VER " (mbed)"
 
@@ -44,7 +115,50 @@
 #define FIELDNUM_MAX 8
 #define FIELDLENGTH_MAX 255  // Max length for a field in ThingSpeak is 255 bytes (UTF-8)
 
-#define TIMEOUT_MS_SERVERRESPONSE 5000  // Wait up to five seconds for server to respond
+#ifndef TIMEOUT_MS_SERVERRESPONSE
+#define TIMEOUT_MS_SERVERRESPONSE 5000  // Default max time in ms of a request, from connect to the end of the response, see setTimeout()
+#endif
+
+#ifndef THINGSPEAK_PAYLOAD_SIZE
+#define THINGSPEAK_PAYLOAD_SIZE 1024      // Bytes reserved for the payload of a write request
+#endif
+#define THINGSPEAK_NUMBER_LENGTH 32       // Buffer size for a formatted number
+#ifndef THINGSPEAK_FLOAT_DECIMALS
+#define THINGSPEAK_FLOAT_DECIMALS 6       // Max decimals of a float written or set as a field, trailing zeros are dropped
+#endif
+
+#ifndef THINGSPEAK_ARENA_SIZE
+#define THINGSPEAK_ARENA_SIZE 512         // Bytes shared by all values of a multi-field update
+#endif
+
+#ifndef THINGSPEAK_BULK_MAX_ENTRIES
+#define THINGSPEAK_BULK_MAX_ENTRIES 16    // Max number of entries collected for one bulk update
+#endif
+#ifndef THINGSPEAK_BULK_BUFFER_SIZE
+#define THINGSPEAK_BULK_BUFFER_SIZE 2048  // Bytes reserved for the entries of one bulk update
+#endif
+
+#ifndef THINGSPEAK_UPDATE_INTERVAL
+#define THINGSPEAK_UPDATE_INTERVAL 15000  // Default minimum interval between updates of a channel in ms (free account)
+#endif
+#ifndef THINGSPEAK_SCHEDULE_CHANNELS
+#define THINGSPEAK_SCHEDULE_CHANNELS 2     // Max number of channels written with scheduleFields()
+#endif
+
+#define BULK_FORMAT_JSON 0  // Bulk updates are sent as JSON (bulk_update.json)
+#define BULK_FORMAT_CSV  1  // Bulk updates are sent as compact CSV (bulk_update.csv)
+
+#define AGGREGATE_LAST 0  // The latest value of a field is written
+#define AGGREGATE_MIN  1  // The smallest value of a field since the last update is written
+#define AGGREGATE_MAX  2  // The largest value of a field since the last update is written
+#define AGGREGATE_MEAN 3  // The mean of the values of a field since the last update is written
+#define AGGREGATE_COUNT  4  // The number of values of a field since the last update is written, accumulate() only
+#define AGGREGATE_STDDEV 5  // The sample standard deviation of the values since the last update is written, accumulate() only
+
+#ifndef THINGSPEAK_STORE_BUFFER_SIZE
+#define THINGSPEAK_STORE_BUFFER_SIZE (THINGSPEAK_ARENA_SIZE + 64)  // Bytes reserved for one record of the offline store
+#endif
+#define THINGSPEAK_RTC_VALID 1577836800  // RTC times before 2020-01-01 are treated as not set
 
 #define OK_SUCCESS              200     // OK / Success
 #define ERR_BADAPIKEY           400     // Incorrect API key (or invalid ThingSpeak server address)
@@ -56,1355 +170,6964 @@
 #define ERR_UNEXPECTED_FAIL     -302    // Unexpected failure during write to ThingSpeak
 #define ERR_BAD_RESPONSE        -303    // Unable to parse response
 #define ERR_TIMEOUT             -304    // Timeout waiting for server to respond
+#define ERR_QUEUE_FULL          -305    // Queue of asynchronous requests is full
 #define ERR_NOT_INSERTED        -401    // Point was not inserted (most probable cause is the rate limit of once every 15 seconds)
+#define ERR_STORE_FAILED        -501    // Offline store is not mounted or the block device failed
+#define ERR_NO_TIMESTAMP        -502    // Update can't be stored without a timestamp, set the RTC or call setCreatedAt()
 
-// Enables an Arduino, ESP8266, ESP32 or other compatible hardware to write or read data to or from ThingSpeak, an open data platform for the Internet of Things with MATLAB analytics and visualization.
-class ThingSpeak
+// Formats a payload into a fixed buffer without heap allocations. Appending beyond the capacity marks the
+// payload as overflowed instead of growing it.
+class ThingSpeakPayload
 {
   public:
-  ThingSpeak() {
-    resetWriteFields();
-    this->lastReadStatus = OK_SUCCESS;
-    this->net = NULL;
+  ThingSpeakPayload(char * buffer, size_t capacity) {
+    this->buffer = buffer;
+    this->capacity = capacity;
+    this->len = 0;
+    this->fOverflow = (capacity == 0);
+    if(!this->fOverflow) {
+      this->buffer[0] = '\0';
+    }
   };
 
+  void append(const char * value, size_t valueLen) {
+    if(this->fOverflow || this->len + valueLen >= this->capacity) {
+      this->fOverflow = true;
+      return;
+    }
+    memcpy(this->buffer + this->len, value, valueLen);
+    this->len += valueLen;
+    this->buffer[this->len] = '\0';
+  };
 
-  /*
-  Function: begin
+  void append(const char * value) {
+    append(value, strlen(value));
+  };
 
-  Summary:
-  Initializes the ThingSpeak library and network settings using the ThingSpeak.com service.
+  void append(char c) {
+    append(&c, 1);
+  };
 
-  Parameters:
-  client - EthernetClient, YunClient, TCPClient, or WiFiClient created earlier in the sketch
+  void appendLong(long value) {
+    char valueString[THINGSPEAK_NUMBER_LENGTH];
+    append(valueString, formatLong(valueString, value));
+  };
 
-  Returns:
-  Always returns true
+  void appendFloat(float value, int decimals) {
+    char valueString[THINGSPEAK_NUMBER_LENGTH];
+    append(valueString, formatFloat(valueString, value, decimals));
+  };
 
-  Notes:
-  This does not validate the information passed in, or generate any calls to ThingSpeak.
+  const char * c_str() {
+    return this->buffer;
+  };
 
-  */
-  bool begin(NetworkInterface * net) {
-    resetWriteFields();
-    this->lastReadStatus = OK_SUCCESS;
-    this->net = net;
+  size_t length() {
+    return this->len;
+  };
 
-    return true;
+  bool overflow() {
+    return this->fOverflow;
   };
 
-  /*
-  Function: writeField
+  // Writes value zero terminated to out (at least THINGSPEAK_NUMBER_LENGTH bytes), returns the number of characters
+  static size_t formatLong(char * out, long value) {
+    size_t pos = 0;
+    unsigned long magnitude = (value < 0) ? 0UL - (unsigned long)value : (unsigned long)value;
 
-  Summary:
-  Write an integer value to a single field in a ThingSpeak channel
+    if(value < 0) {
+      out[pos++] = '-';
+    }
+    return pos + formatUnsigned(out + pos, magnitude);
+  };
 
-  Parameters:
-  channelNumber - Channel number
-  field - Field number (1-8) within the channel to write to.
-  value - Integer value (from -32,768 to 32,767) to write.
-  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+  // Writes the digits of value zero terminated to out (at least THINGSPEAK_NUMBER_LENGTH bytes), returns the number of characters
+  static size_t formatUnsigned(char * out, uint64_t value) {
+    char digits[THINGSPEAK_NUMBER_LENGTH];
+    size_t nDigits = 0;
+    size_t pos = 0;
 
-  Returns:
-  HTTP status code of 200 if successful.
+    do {
+      digits[nDigits++] = (char)('0' + value % 10);
+      value /= 10;
+    } while(value > 0);
 
-  Notes:
-  See getLastReadStatus() for other possible return values.
-  */
-  int writeField(unsigned long channelNumber, unsigned int field, int value, const char * writeAPIKey) {
-    return writeField(channelNumber, field, std::to_string(value), writeAPIKey);
+    while(nDigits > 0) {
+      out[pos++] = digits[--nDigits];
+    }
+    out[pos] = '\0';
+    return pos;
   };
 
-
   /*
-  Function: writeField
-
-  Summary:
-  Write a long value to a single field in a ThingSpeak channel
-
-  Parameters:
-  channelNumber - Channel number
-  field - Field number (1-8) within the channel to write to.
-  value - Long value (from -2,147,483,648 to 2,147,483,647) to write.
-  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
-
-  Returns:
-  HTTP status code of 200 if successful.
-
-  Notes:
-  See getLastReadStatus() for other possible return values.
+  Writes value with a fixed number of decimals zero terminated to out (at least THINGSPEAK_NUMBER_LENGTH bytes),
+  returns the number of characters. Values of 1e12 and more, and those with more than 18 digits including the decimals,
+  are written in exponent notation, NaN and infinity as "nan", "inf" and "-inf" like printf(). With fTrim, trailing zeros
+  of the decimals and a bare decimal point are dropped.
   */
-  int writeField(unsigned long channelNumber, unsigned int field, long value, const char * writeAPIKey) {
-    return writeField(channelNumber, field, std::to_string(value), writeAPIKey);
-  };
+  static size_t formatFloat(char * out, float value, int decimals, bool fTrim = false) {
+    size_t pos = 0;
+    double magnitude = value;
 
-  /*
-  Function: writeField
+    if(isnan(value)) {
+      strcpy(out, "nan");
+      return 3;
+    }
+    if(magnitude < 0 || (magnitude == 0 && signbit(value))) {
+      out[pos++] = '-';
+      magnitude = -magnitude;
+    }
+    if(isinf(value)) {
+      strcpy(out + pos, "inf");
+      return pos + 3;
+    }
 
-  Summary:
-  Write a floating point value to a single field in a ThingSpeak channel
+    if(decimals < 0) {
+      decimals = 0;
+    }
+    if(decimals > 9) {
+      decimals = 9;
+    }
 
-  Parameters:
-  channelNumber - Channel number
-  field - Field number (1-8) within the channel to write to.
-  value - Floating point value (from -999999000000 to 999999000000) to write.  If you need more accuracy, or a wider range, you should format the number using <tt>dtostrf</tt> and writeField().
-  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+    uint64_t scale = 1;
+    for(int iDecimal = 0; iDecimal < decimals; iDecimal++) {
+      scale *= 10;
+    }
 
-  Returns:
-  HTTP status code of 200 if successful.
+    // the scaled value has to fit into 18 digits, so an integral of 10^(18 - decimals) or more takes the exponent notation
+    int exponent = 0;
+    if(magnitude >= 1e12 || magnitude >= 1e18 / (double)scale) {
+      while(magnitude >= 10.0) {
+        magnitude /= 10.0;
+        exponent++;
+      }
+    }
 
-  Notes:
-  See getLastReadStatus() for other possible return values.
-  */
-  int writeField(unsigned long channelNumber, unsigned int field, float value, const char * writeAPIKey) {
-    return writeField(channelNumber, field, std::to_string(value), writeAPIKey);
-  };
+    uint64_t scaled = (uint64_t)(magnitude * (double)scale + 0.5);
+    // rounding may carry into another digit of the mantissa, e.g. 9.9999999e+12
+    if(exponent > 0 && scaled >= 10 * scale) {
+      scaled = (scaled + 5) / 10;
+      exponent++;
+    }
+    uint64_t integral = scaled / scale;
+    uint64_t fraction = scaled % scale;
 
+    while(fTrim && decimals > 0 && fraction % 10 == 0) {
+      fraction /= 10;
+      decimals--;
+    }
 
-  /*
-  Function: writeField
+    pos += formatUnsigned(out + pos, integral);
+    if(decimals > 0) {
+      out[pos++] = '.';
+      for(int iDecimal = decimals - 1; iDecimal >= 0; iDecimal--) {
+        out[pos + iDecimal] = (char)('0' + fraction % 10);
+        fraction /= 10;
+      }
+      pos += decimals;
+    }
+    if(exponent > 0) {
+      out[pos++] = 'e';
+      out[pos++] = '+';
+      pos += formatLong(out + pos, exponent);
+    }
+    out[pos] = '\0';
+    return pos;
+  };
 
-  Summary:
-  Write a string to a single field in a ThingSpeak channel
+  private:
+  char *buffer;
+  size_t capacity;
+  size_t len;
+  bool fOverflow;
+};
 
-  Parameters:
-  channelNumber - Channel number
-  field - Field number (1-8) within the channel to write to.
-  value - String to write (UTF8 string).  ThingSpeak limits this field to 255 bytes.
-  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+// A multi-field update. All values share one arena of THINGSPEAK_ARENA_SIZE bytes and are referenced by offset and
+// length, a bitmask tells which items are set.
+class ThingSpeakEntry
+{
+  public:
+  // Items of a multi-field update in the order they are serialised
+  enum {
+    ITEM_STATUS = FIELDNUM_MAX,
+    ITEM_TWITTER,
+    ITEM_TWEET,
+    ITEM_CREATED_AT,
+    ITEM_LATITUDE,
+    ITEM_LONGITUDE,
+    ITEM_ELEVATION,
+    ITEM_COUNT
+  };
 
-  Returns:
-  HTTP status code of 200 if successful.
+  ThingSpeakEntry() {
+    reset();
+  };
 
-  Notes:
-  See getLastReadStatus() for other possible return values.
-  */
-  int writeField(unsigned long channelNumber, unsigned int field, const char * value, const char * writeAPIKey) {
-    return writeField(channelNumber, field, string(value), writeAPIKey);
+  void reset() {
+    this->mask = 0;
+    this->arenaUsed = 0;
+    this->contentLen = 0;
   };
 
   /*
-  Function: writeField
+  Sets an item, an empty value clears it. Returns false if the value does not fit into the arena.
+  A value that is not longer than the previous one reuses its place, otherwise the arena is compacted if needed.
+  */
+  bool set(size_t item, const char * value, size_t valueLen) {
+    uint16_t bit = (uint16_t)(1 << item);
+
+    if(this->mask & bit) {
+      this->contentLen -= getKeyLength(item) + this->length[item];
+      if(valueLen <= this->length[item]) {
+        memmove(this->arena + this->offset[item], value, valueLen);
+        storeItem(item, this->offset[item], valueLen);
+        return true;
+      }
+      this->mask &= (uint16_t)~bit;
+    }
 
-  Summary:
-  Write a string to a single field in a ThingSpeak channel
+    if(valueLen == 0) {
+      return true;
+    }
 
-  Parameters:
-  channelNumber - Channel number
-  field - Field number (1-8) within the channel to write to.
-  value - String to write (UTF8 string).  ThingSpeak limits this field to 255 bytes.
-  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+    if(this->arenaUsed + valueLen > THINGSPEAK_ARENA_SIZE) {
+      compact();
+      if(this->arenaUsed + valueLen > THINGSPEAK_ARENA_SIZE) {
+        return false;
+      }
+    }
 
-  Returns:
-  HTTP status code of 200 if successful.
+    memcpy(this->arena + this->arenaUsed, value, valueLen);
+    storeItem(item, (uint16_t)this->arenaUsed, valueLen);
+    this->arenaUsed += valueLen;
+    return true;
+  };
 
-  Notes:
-  See getLastReadStatus() for other possible return values.
-  */
-  int writeField(unsigned long channelNumber, unsigned int field, string value, const char * writeAPIKey) {
-    // Invalid field number specified
-    if(field < FIELDNUM_MIN || field > FIELDNUM_MAX)
-      return ERR_INVALID_FIELD_NUM;
-    // Max # bytes for ThingSpeak field is 255
-    if(value.length() > FIELDLENGTH_MAX)
-      return ERR_OUT_OF_RANGE;
+  bool isSet(size_t item) const {
+    return (this->mask & (1 << item)) != 0;
+  };
 
-    #ifdef PRINT_DEBUG_MESSAGES
-      printf("ts::writeField (channelNumber: %lu writeAPIKey: %s field: %d value: \"%s\")\n", channelNumber, writeAPIKey, field, value.c_str());
-    #endif
-    string postMessage = string("field");
-    postMessage +=  std::to_string(field);
-    postMessage += "=";
-    postMessage += value;
-    return writeRaw(channelNumber, postMessage, writeAPIKey);
-   };
+  // Value of an item, not zero terminated
+  const char * get(size_t item) const {
+    return this->arena + this->offset[item];
+  };
 
+  size_t getLength(size_t item) const {
+    return isSet(item) ? this->length[item] : 0;
+  };
 
-  /*
-  Function: setField
+  uint16_t getMask() const {
+    return this->mask;
+  };
 
-  Summary:
-  Set the value of a single field that will be part of a multi-field update.
+  // Length of all items form encoded as '&key=value'
+  size_t getContentLength() const {
+    return this->contentLen;
+  };
 
-  Parameters:
-  field - Field number (1-8) within the channel to set.
-  value - Integer value (from -32,768 to 32,767) to set.
+  static const char * getItemName(size_t item) {
+    static const char * const itemNames[ITEM_COUNT] = { "field1", "field2", "field3", "field4", "field5", "field6", "field7", "field8", "status", "twitter", "tweet", "created_at", "lat", "long", "elevation" };
+    return itemNames[item];
+  };
 
-  Returns:
-  Code of 200 if successful.
-  Code of -101 if value is out of range or string is too long (> 255 bytes)
+  // Name of an item in a JSON bulk update, which spells out latitude and longitude
+  static const char * getBulkItemName(size_t item) {
+    if(item == ITEM_LATITUDE) {
+      return "latitude";
+    }
+    if(item == ITEM_LONGITUDE) {
+      return "longitude";
+    }
+    return getItemName(item);
+  };
 
-  */
-  int setField(unsigned int field, int value) {
-    return setField(field, std::to_string(value));
+  private:
+  // Length of '&key=' in the form encoded payload
+  static size_t getKeyLength(size_t item) {
+    return strlen(getItemName(item)) + 2;
   };
 
-  /*
-  Function: setField
+  void storeItem(size_t item, uint16_t itemOffset, size_t valueLen) {
+    this->offset[item] = itemOffset;
+    this->length[item] = (uint8_t)valueLen;
+    if(valueLen > 0) {
+      this->mask |= (uint16_t)(1 << item);
+      this->contentLen += getKeyLength(item) + valueLen;
+    }
+    else {
+      this->mask &= (uint16_t)~(1 << item);
+    }
+  };
 
-  Summary:
-  Set the value of a single field that will be part of a multi-field update.
+  // Moves all set items to the start of the arena, keeping their order
+  void compact() {
+    size_t used = 0;
+    for(;;) {
+      // the set item with the lowest offset not yet moved
+      size_t next = ITEM_COUNT;
+      for(size_t iItem = 0; iItem < ITEM_COUNT; iItem++) {
+        if(isSet(iItem) && this->offset[iItem] >= used && (next == ITEM_COUNT || this->offset[iItem] < this->offset[next])) {
+          next = iItem;
+        }
+      }
+      if(next == ITEM_COUNT) {
+        break;
+      }
+      memmove(this->arena + used, this->arena + this->offset[next], this->length[next]);
+      this->offset[next] = (uint16_t)used;
+      used += this->length[next];
+    }
+    this->arenaUsed = used;
+  };
 
-  Parameters:
-  field - Field number (1-8) within the channel to set.
-  value - Long value (from -2,147,483,648 to 2,147,483,647) to write.
+  char arena[THINGSPEAK_ARENA_SIZE];
+  uint16_t offset[ITEM_COUNT];
+  uint8_t length[ITEM_COUNT];
+  uint16_t mask;
+  size_t arenaUsed;
+  size_t contentLen;
+};
 
-  Returns:
-  Code of 200 if successful.
-  Code of -101 if value is out of range or string is too long (> 255 bytes)
+// Staging of one multi-field update. Each thread writing to ThingSpeak owns its own context and passes it to
+// ThingSpeak::writeFields(), so concurrent updates don't share the staged values.
+class WriteContext : public ThingSpeakEntry
+{
+  public:
+  int setField(unsigned int field, const char * value) {
+    size_t valueLen = strlen(value);
 
-  */
-  int setField(unsigned int field, long value) {
-    return setField(field, std::to_string(value));
+    if(field < FIELDNUM_MIN || field > FIELDNUM_MAX) return ERR_INVALID_FIELD_NUM;
+    // Max # bytes for ThingSpeak field is 255 (UTF-8)
+    if(valueLen > FIELDLENGTH_MAX) return ERR_OUT_OF_RANGE;
+    if(!set(field - 1, value, valueLen)) return ERR_OUT_OF_RANGE;
+    return OK_SUCCESS;
   };
 
-  /*
-  Function: setField
-
-  Summary:
-  Set the value of a single field that will be part of a multi-field update.
+  int setField(unsigned int field, string value) {
+    return setField(field, value.c_str());
+  };
 
-  Parameters:
-  field - Field number (1-8) within the channel to set.
-  value - Floating point value (from -999999000000 to 999999000000) to write.  If you need more accuracy, or a wider range, you should format the number yourself (using <tt>dtostrf</tt>) and setField() using the resulting string.
+  int setField(unsigned int field, long value) {
+    char valueString[THINGSPEAK_NUMBER_LENGTH];
+    ThingSpeakPayload::formatLong(valueString, value);
+    return setField(field, (const char *)valueString);
+  };
 
-  Returns:
-  Code of 200 if successful.
-  Code of -101 if value is out of range or string is too long (> 255 bytes)
+  int setField(unsigned int field, int value) {
+    return setField(field, (long)value);
+  };
 
-  */
   int setField(unsigned int field, float value) {
-    return setField(field, std::to_string(value));
+    return setField(field, value, THINGSPEAK_FLOAT_DECIMALS);
+  };
+
+  // Sets value with at most decimals decimals, trailing zeros are dropped
+  int setField(unsigned int field, float value, int decimals) {
+    char valueString[THINGSPEAK_NUMBER_LENGTH];
+    ThingSpeakPayload::formatFloat(valueString, value, decimals, true);
+    return setField(field, (const char *)valueString);
+  };
+
+  // NAN clears the location items
+  int setLatitude(float latitude) {
+    return setLocationItem(ITEM_LATITUDE, latitude);
+  };
+
+  int setLongitude(float longitude) {
+    return setLocationItem(ITEM_LONGITUDE, longitude);
+  };
+
+  int setElevation(float elevation) {
+    return setLocationItem(ITEM_ELEVATION, elevation);
+  };
+
+  int setStatus(const char * status) {
+    return setItem(ITEM_STATUS, status);
+  };
+
+  int setTwitterTweet(const char * twitter, const char * tweet) {
+    // Max # bytes for ThingSpeak field is 255 (UTF-8)
+    if(strlen(twitter) > FIELDLENGTH_MAX || strlen(tweet) > FIELDLENGTH_MAX)
+      return ERR_OUT_OF_RANGE;
+    int status = setItem(ITEM_TWITTER, twitter);
+    return status == OK_SUCCESS ? setItem(ITEM_TWEET, tweet) : status;
+  };
+
+  int setCreatedAt(const char * createdAt) {
+    // the ISO 8601 format is too complicated to check for valid timestamps here
+    // we'll need to reply on the api to tell us if there is a problem
+    return setItem(ITEM_CREATED_AT, createdAt);
+  };
+
+  private:
+  // Formats the value once, an unset item is a cleared bit of the mask like any other item
+  int setLocationItem(size_t item, float value) {
+    char valueString[THINGSPEAK_NUMBER_LENGTH];
+    size_t valueLen = isnan(value) ? 0 : ThingSpeakPayload::formatFloat(valueString, value, THINGSPEAK_FLOAT_DECIMALS, true);
+    if(!set(item, valueString, valueLen)) return ERR_OUT_OF_RANGE;
+    return OK_SUCCESS;
+  };
+
+  int setItem(size_t item, const char * value) {
+    size_t valueLen = strlen(value);
+
+    // Max # bytes for ThingSpeak field is 255 (UTF-8)
+    if(valueLen > FIELDLENGTH_MAX)
+      return ERR_OUT_OF_RANGE;
+    if(!set(item, value, valueLen))
+      return ERR_OUT_OF_RANGE;
+    return OK_SUCCESS;
+  };
+};
+
+// Result of a read owned by the caller, so concurrent readers don't share getLastReadStatus()
+class ReadResult
+{
+  public:
+  ReadResult() {
+    this->status = OK_SUCCESS;
+  };
+
+  // Value as a number, 0 if it is not one
+  float toFloat() const {
+    return strtof(this->value.c_str(), NULL);
+  };
+
+  long toLong() const {
+    return strtol(this->value.c_str(), NULL, 10);
+  };
+
+  int toInt() const {
+    return (int)toLong();
+  };
+
+  int status;     // HTTP status code of 200 if successful, see ThingSpeak::getLastReadStatus() for other values
+  string value;   // Value read, empty in case of an error
+};
+
+// One update of ThingSpeak::writeChannels(), the entry is reset once it is sent
+class ChannelWrite
+{
+  public:
+  ChannelWrite() : channelNumber(0), writeAPIKey(NULL), entry(NULL), status(OK_SUCCESS) {}
+  ChannelWrite(unsigned long channelNumber, const char * writeAPIKey, WriteContext & entry) :
+    channelNumber(channelNumber), writeAPIKey(writeAPIKey), entry(&entry), status(OK_SUCCESS) {}
+
+  unsigned long channelNumber;
+  const char * writeAPIKey;
+  WriteContext * entry;
+  int status;     // Status of the update once writeChannels() returns, see ThingSpeak::writeFields()
+};
+
+// One read of ThingSpeak::readPipelined(), either the latest value of a field or any URL suffix as for ThingSpeak::readRaw()
+class ChannelRead
+{
+  public:
+  ChannelRead() : channelNumber(0), readAPIKey(NULL) {}
+  ChannelRead(unsigned long channelNumber, unsigned int field, const char * readAPIKey = NULL) :
+    channelNumber(channelNumber), readAPIKey(readAPIKey) {
+    // an invalid field leaves the suffix empty
+    if(field >= FIELDNUM_MIN && field <= FIELDNUM_MAX) {
+      this->URLSuffix = string("/fields/") + std::to_string(field) + string("/last");
+    }
+  }
+  ChannelRead(unsigned long channelNumber, const char * URLSuffix, const char * readAPIKey = NULL) :
+    channelNumber(channelNumber), URLSuffix(URLSuffix), readAPIKey(readAPIKey) {}
+
+  unsigned long channelNumber;
+  string URLSuffix;
+  const char * readAPIKey;
+};
+
+// Times in microseconds and sizes of one request to ThingSpeak, passed to the hook set with ThingSpeak::setStatsHook()
+struct ThingSpeakRequestStats
+{
+  http_method method;
+  int status;               // HTTP status code or error code
+  bool fReused;             // sent over a connection opened before
+  unsigned int attempts;    // 2 if a reused connection had been closed by the server
+  uint32_t dnsTime;         // 0 if the cached address was used
+  uint32_t connectTime;     // 0 if the connection was reused
+  uint32_t sendTime;        // until the request was sent
+  uint32_t firstByteTime;   // until the first byte of the response was received
+  uint32_t totalTime;       // until the response was complete
+  uint32_t bytesSent;
+  uint32_t bytesReceived;
+};
+
+#if THINGSPEAK_HEAP_STATS
+#if !THINGSPEAK_STATS
+#error "THINGSPEAK_HEAP_STATS needs THINGSPEAK_STATS"
+#endif
+#ifndef MBED_HEAP_STATS_ENABLED
+#error "THINGSPEAK_HEAP_STATS needs the mbed heap stats, set platform.heap-stats-enabled"
+#endif
+
+// Heap and stack use of one public call of ThingSpeak, see ThingSpeakStats::heap. Heap sizes are in bytes as counted by
+// mbed_stats_heap_get(), which sees the allocations of all threads.
+struct ThingSpeakHeapStats
+{
+  const char * api;             // name of the call, overloads share an entry
+  unsigned long calls;
+  uint64_t allocatedBytes;      // bytes allocated by all calls, freed or not
+  uint32_t maxAllocatedBytes;   // most bytes allocated by one call, 0 for a call without heap allocations
+  uint32_t peakHeap;            // most heap in use above the start of a call, exact for a call that raised the heap high-water mark
+  unsigned long allocFailures;  // allocations that failed during the calls
+  uint32_t maxStack;            // stack high-water mark of the calling threads, 0 unless MBED_STACK_STATS_ENABLED
+};
+#endif
+
+// Request statistics of a ThingSpeak instance, see ThingSpeak::getStats()
+struct ThingSpeakStats
+{
+  unsigned long requests;
+  unsigned long failures;       // requests without a response
+  unsigned long retries;        // requests repeated on a new connection
+  unsigned long connects;       // connections opened
+  unsigned long resolves;       // server names resolved
+  uint64_t bytesSent;
+  uint64_t bytesReceived;
+  uint64_t dnsTime;             // sums in microseconds, divide by the counts above for the mean
+  uint64_t connectTime;
+  uint64_t sendTime;
+  uint64_t firstByteTime;
+  uint64_t totalTime;
+  uint32_t maxTotalTime;
+  int statusCode[THINGSPEAK_STATS_CODES];               // status codes seen, 0 marks an unused slot
+  unsigned long statusCount[THINGSPEAK_STATS_CODES];    // requests answered with statusCode[i]
+  unsigned long otherStatusCount;                       // requests with a status code not fitting into the table
+  unsigned long histogram[THINGSPEAK_STATS_BUCKETS];    // total request times, bucket i ends at 50 ms * 2^i, the last one is open
+  unsigned long bulkStored;     // queued entries moved to the offline store to make room, see queueFields()
+  unsigned long bulkDropped;    // queued entries dropped to make room, there was no store or it failed
+#if THINGSPEAK_HEAP_STATS
+  ThingSpeakHeapStats heap[THINGSPEAK_HEAP_STATS_APIS]; // per public call, heap[i].api is NULL for an unused slot
+  unsigned long otherHeapCalls;                         // calls not fitting into the table
+#endif
+};
+
+#if THINGSPEAK_HEAP_STATS
+// Measures the heap and stack use of a public call of ThingSpeak from its construction to its destruction
+// and adds it to the entry of the call in ThingSpeakStats::heap. The table is updated in a critical section,
+// so profiling does not contend for the locks of the calls it measures.
+class ThingSpeakHeapProbe
+{
+  public:
+  ThingSpeakHeapProbe(ThingSpeakStats & stats, const char * api) : stats(stats) {
+    this->api = api;
+    mbed_stats_heap_get(&this->start);
+  };
+
+  ~ThingSpeakHeapProbe() {
+    mbed_stats_heap_t end;
+    mbed_stats_heap_get(&end);
+
+    // The high-water mark of the heap only tells the peak of a call that raised it, otherwise the heap still in use is taken
+    uint32_t peak = end.current_size > this->start.current_size ? end.current_size - this->start.current_size : 0;
+    if(end.max_size > this->start.max_size && end.max_size - this->start.current_size > peak) {
+      peak = end.max_size - this->start.current_size;
+    }
+    uint32_t allocated = end.total_size - this->start.total_size;
+
+    uint32_t stack = 0;
+    #ifdef MBED_STACK_STATS_ENABLED
+      osThreadId_t thread = osThreadGetId();
+      stack = osThreadGetStackSize(thread) - osThreadGetStackSpace(thread);
+    #endif
+
+    core_util_critical_section_enter();
+    ThingSpeakHeapStats * entry = find();
+    if(NULL == entry) {
+      this->stats.otherHeapCalls++;
+    }
+    else {
+      entry->calls++;
+      entry->allocatedBytes += allocated;
+      if(allocated > entry->maxAllocatedBytes) {
+        entry->maxAllocatedBytes = allocated;
+      }
+      if(peak > entry->peakHeap) {
+        entry->peakHeap = peak;
+      }
+      entry->allocFailures += end.alloc_fail_cnt - this->start.alloc_fail_cnt;
+      if(stack > entry->maxStack) {
+        entry->maxStack = stack;
+      }
+    }
+    core_util_critical_section_exit();
+  };
+
+  private:
+  // The entry of the call, a free one the first time, NULL if the table is full
+  ThingSpeakHeapStats * find() {
+    for(size_t i = 0; i < THINGSPEAK_HEAP_STATS_APIS; i++) {
+      ThingSpeakHeapStats * entry = &this->stats.heap[i];
+      if(NULL == entry->api) {
+        entry->api = this->api;
+        return entry;
+      }
+      if(entry->api == this->api || strcmp(entry->api, this->api) == 0) {
+        return entry;
+      }
+    }
+    return NULL;
+  };
+
+  ThingSpeakStats & stats;
+  const char * api;
+  mbed_stats_heap_t start;
+};
+
+// Profiles the public call of ThingSpeak it is placed in, as api, until the call returns
+#define THINGSPEAK_HEAP_PROBE(api) ThingSpeakHeapProbe heapProbe(this->stats, api)
+#else
+#define THINGSPEAK_HEAP_PROBE(api)
+#endif
+
+// Running aggregate of the samples of one field in fixed memory. add() is O(1) and may be called from interrupt
+// context, a critical section keeps the thread taking the aggregate from seeing a half updated one.
+class ThingSpeakAccumulator
+{
+  public:
+  ThingSpeakAccumulator() {
+    this->aggregation = AGGREGATE_MEAN;
+    this->count = 0;
+    this->last = this->min = this->max = this->mean = this->m2 = 0.0f;
+  };
+
+  void add(float value) {
+    if(isnan(value)) {
+      return;
+    }
+
+    core_util_critical_section_enter();
+    this->count++;
+    this->last = value;
+    if(this->count == 1 || value < this->min) {
+      this->min = value;
+    }
+    if(this->count == 1 || value > this->max) {
+      this->max = value;
+    }
+    // Welford's update keeps the mean and the variance accurate without a growing sum
+    float delta = value - this->mean;
+    this->mean += delta / (float)this->count;
+    this->m2 += delta * (value - this->mean);
+    core_util_critical_section_exit();
+  };
+
+  // Takes the aggregate of the samples added since the last call and starts a new window, returns false if there were none
+  bool take(float * value) {
+    core_util_critical_section_enter();
+    uint32_t samples = this->count;
+    switch(this->aggregation) {
+      case AGGREGATE_LAST:   *value = this->last; break;
+      case AGGREGATE_MIN:    *value = this->min; break;
+      case AGGREGATE_MAX:    *value = this->max; break;
+      case AGGREGATE_COUNT:  *value = (float)samples; break;
+      case AGGREGATE_STDDEV: *value = samples > 1 ? sqrtf(this->m2 / (float)(samples - 1)) : 0.0f; break;
+      default:               *value = this->mean; break;
+    }
+    this->count = 0;
+    this->mean = this->m2 = 0.0f;
+    core_util_critical_section_exit();
+    return samples > 0;
+  };
+
+  int aggregation;
+
+  private:
+  uint32_t count;
+  float last;
+  float min;
+  float max;
+  float mean;
+  float m2;
+};
+
+#if THINGSPEAK_STATS
+// Socket counting the bytes sent and received and the time of the first byte of a response
+template<class Base>
+class ThingSpeakMeteredSocket : public Base
+{
+  public:
+  ThingSpeakMeteredSocket() {
+    start();
+  };
+
+  // Starts measuring a new request
+  void start() {
+    this->bytesSent = 0;
+    this->bytesReceived = 0;
+    this->startedAt = us_ticker_read();
+    this->sentAt = this->startedAt;
+    this->firstByteAt = this->startedAt;
+    this->fReceived = false;
+  };
+
+  virtual nsapi_size_or_error_t send(const void * data, nsapi_size_t size) {
+    nsapi_size_or_error_t sent = Base::send(data, size);
+    if(sent > 0) {
+      this->bytesSent += sent;
+      if(!this->fReceived) {
+        this->sentAt = us_ticker_read();
+      }
+    }
+    return sent;
+  };
+
+  virtual nsapi_size_or_error_t recv(void * data, nsapi_size_t size) {
+    nsapi_size_or_error_t received = Base::recv(data, size);
+    if(received > 0) {
+      if(!this->fReceived) {
+        this->firstByteAt = us_ticker_read();
+        this->fReceived = true;
+      }
+      this->bytesReceived += received;
+    }
+    return received;
+  };
+
+  uint32_t bytesSent;
+  uint32_t bytesReceived;
+  uint32_t startedAt;
+  uint32_t sentAt;
+  uint32_t firstByteAt;
+  bool fReceived;
+};
+#endif
+
+// Socket bounding connect, send and recv by a deadline, the socket timeout is set to the time left before each of them
+template<class Base>
+class ThingSpeakTimedSocket : public Base
+{
+  public:
+  ThingSpeakTimedSocket() {
+    this->deadline = 0;
+  };
+
+  using Base::connect;
+
+  // Sets the Kernel::get_ms_count() by which the following operations have to be done, 0 for no deadline
+  void setDeadline(uint64_t deadline) {
+    this->deadline = deadline;
+  };
+
+  virtual nsapi_error_t connect(const SocketAddress & address) {
+    if(!arm()) {
+      return NSAPI_ERROR_TIMEOUT;
+    }
+    return Base::connect(address);
+  };
+
+  virtual nsapi_size_or_error_t send(const void * data, nsapi_size_t size) {
+    if(!arm()) {
+      return NSAPI_ERROR_TIMEOUT;
+    }
+    return Base::send(data, size);
+  };
+
+  virtual nsapi_size_or_error_t recv(void * data, nsapi_size_t size) {
+    if(!arm()) {
+      return NSAPI_ERROR_TIMEOUT;
+    }
+    return Base::recv(data, size);
+  };
+
+  private:
+  // Sets the socket timeout to the time left, false if the deadline has passed
+  bool arm() {
+    if(this->deadline == 0) {
+      Base::set_timeout(-1);
+      return true;
+    }
+    uint64_t now = Kernel::get_ms_count();
+    if(now >= this->deadline) {
+      return false;
+    }
+    Base::set_timeout((int)(this->deadline - now));
+    return true;
+  };
+
+  uint64_t deadline;
+};
+
+#if THINGSPEAK_HTTPS
+#if THINGSPEAK_STATS
+typedef ThingSpeakMeteredSocket<ThingSpeakTimedSocket<TLSSocket> > ThingSpeakSocket;
+#else
+typedef ThingSpeakTimedSocket<TLSSocket> ThingSpeakSocket;
+#endif
+typedef HttpsRequest ThingSpeakRequest;
+#else
+#if THINGSPEAK_STATS
+typedef ThingSpeakMeteredSocket<ThingSpeakTimedSocket<TCPSocket> > ThingSpeakSocket;
+#else
+typedef ThingSpeakTimedSocket<TCPSocket> ThingSpeakSocket;
+#endif
+typedef HttpRequest ThingSpeakRequest;
+#endif
+
+// Keeps one TCP connection to ThingSpeak open across requests and reopens it once it was closed.
+// The resolved server address is cached for THINGSPEAK_DNS_TTL seconds. With THINGSPEAK_HTTPS the connection is
+// a TLS session, kept open the same way so the handshake is only paid when the connection has to be reopened.
+class ThingSpeakConnection
+{
+  public:
+  ThingSpeakConnection() {
+    this->net = NULL;
+    this->socket = NULL;
+    this->host = THINGSPEAK_URL;
+    this->port = THINGSPEAK_PORT_NUMBER;
+    this->fResolved = false;
+    this->resolvedAt = 0;
+    this->rootCA = NULL;
+    this->dnsTime = 0;
+    this->connectTime = 0;
+  };
+
+  ~ThingSpeakConnection() {
+    close();
+  };
+
+  void begin(NetworkInterface * net, const char * host, uint16_t port) {
+    close();
+    this->net = net;
+    this->host = host;
+    this->port = port;
+    this->fResolved = false;
+  };
+
+  /*
+  Resolves the server name, the address is reused until THINGSPEAK_DNS_TTL expires or a connect fails.
+  Returns NSAPI_ERROR_OK or the error of gethostbyname().
+  */
+  nsapi_error_t resolve() {
+    if(NULL == this->net) {
+      return NSAPI_ERROR_NO_CONNECTION;
+    }
+
+    uint32_t startedAt = us_ticker_read();
+    nsapi_error_t error = this->net->gethostbyname(this->host.c_str(), &this->address);
+    this->dnsTime = us_ticker_read() - startedAt;
+    if(error != NSAPI_ERROR_OK) {
+      #ifdef PRINT_DEBUG_MESSAGES
+        printf("ts::connection gethostbyname(%s) failed (%d)\n", this->host.c_str(), error);
+      #endif
+      this->fResolved = false;
+      return error;
+    }
+    this->address.set_port(this->port);
+    this->fResolved = true;
+    this->resolvedAt = Kernel::get_ms_count();
+
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::connection %s resolved to %s\n", this->host.c_str(), this->address.get_ip_address());
+    #endif
+    return NSAPI_ERROR_OK;
+  };
+
+  /*
+  Returns the connected socket, opening and connecting a new one if there is no open connection.
+  Connect, send and recv of the socket are bounded by deadline (Kernel::get_ms_count(), 0 for none).
+  Returns NULL if the connection to ThingSpeak failed.
+  */
+  ThingSpeakSocket * acquire(uint64_t deadline = 0) {
+    this->dnsTime = 0;
+    this->connectTime = 0;
+    if(NULL != this->socket) {
+      this->socket->setDeadline(deadline);
+      return this->socket;
+    }
+    if(NULL == this->net) {
+      return NULL;
+    }
+
+    if(!this->fResolved || Kernel::get_ms_count() - this->resolvedAt > (uint64_t)THINGSPEAK_DNS_TTL * 1000) {
+      // gethostbyname() can't be bounded, it is only checked against the deadline afterwards
+      if(resolve() != NSAPI_ERROR_OK) {
+        return NULL;
+      }
+    }
+
+    uint32_t startedAt = us_ticker_read();
+    this->socket = new ThingSpeakSocket();
+    this->socket->setDeadline(deadline);
+    nsapi_error_t error = this->socket->open(this->net);
+    #if THINGSPEAK_HTTPS
+      // The certificate is verified against the server name, not the address connected to
+      if(error == NSAPI_ERROR_OK) {
+        this->socket->set_hostname(this->host.c_str());
+        error = (NULL == this->rootCA) ? NSAPI_ERROR_PARAMETER : this->socket->set_root_ca_cert(this->rootCA);
+      }
+    #endif
+    if(error == NSAPI_ERROR_OK) {
+      error = this->socket->connect(this->address);
+    }
+    if(error != NSAPI_ERROR_OK && error != NSAPI_ERROR_IS_CONNECTED) {
+      #ifdef PRINT_DEBUG_MESSAGES
+        printf("ts::connection connect failed (%d)\n", error);
+      #endif
+      close();
+      // the address may have changed, resolve it again next time
+      this->fResolved = false;
+      return NULL;
+    }
+
+    this->connectTime = us_ticker_read() - startedAt;
+
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::connection connected to %s\n", this->address.get_ip_address());
+    #endif
+    return this->socket;
+  };
+
+  void close() {
+    if(NULL == this->socket) {
+      return;
+    }
+    this->socket->close();
+    delete this->socket;
+    this->socket = NULL;
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::connection disconnected.\n");
+    #endif
+  };
+
+  bool isConnected() {
+    return NULL != this->socket;
+  };
+
+  // Microseconds the last acquire() spent resolving the server name and connecting, 0 if not needed
+  uint32_t getDNSTime() {
+    return this->dnsTime;
+  };
+
+  uint32_t getConnectTime() {
+    return this->connectTime;
+  };
+
+  // Root CA certificate(s) in PEM format the server certificate is verified with, used with THINGSPEAK_HTTPS only
+  void setRootCA(const char * rootCA) {
+    close();
+    this->rootCA = rootCA;
+  };
+
+  /*
+  Returns the URL of path on the resolved server address. Requests using it need no further name resolution,
+  the Host header has to be set to getHostHeader().
+  */
+  string getURL(const string & path) {
+    string URL = THINGSPEAK_HTTPS ? "https://" : "http://";
+    if(this->address.get_ip_version() == NSAPI_IPv6) {
+      URL += "[";
+      URL += this->address.get_ip_address();
+      URL += "]";
+    }
+    else {
+      URL += this->address.get_ip_address();
+    }
+    URL += ":";
+    URL += std::to_string(this->port);
+    URL += path;
+    return URL;
+  };
+
+  string getHostHeader() {
+    if(this->port == THINGSPEAK_PORT_NUMBER) {
+      return this->host;
+    }
+    return this->host + ":" + std::to_string(this->port);
+  };
+
+  private:
+  NetworkInterface *net;
+  ThingSpeakSocket *socket;
+  string host;
+  uint16_t port;
+  SocketAddress address;
+  bool fResolved;
+  uint64_t resolvedAt;
+  const char *rootCA;
+  uint32_t dnsTime;
+  uint32_t connectTime;
+};
+
+// Reads HTTP/1.1 responses one after the other from a connection, for requests sent back-to-back by ThingSpeak::readPipelined().
+// Bodies with Content-Length, chunked ones and ones ended by closing the connection are understood.
+class ThingSpeakResponseReader
+{
+  public:
+  ThingSpeakResponseReader(ThingSpeakSocket * socket) {
+    this->socket = socket;
+    this->pos = 0;
+    this->len = 0;
+    this->fClosed = false;
+  };
+
+  /*
+  Reads the next response. fClose is set if the server closes the connection after it.
+  Returns false if the connection failed or the response is malformed, the connection is unusable then.
+  */
+  bool read(int & status, string & body, string & etag, string & lastModified, bool & fClose) {
+    string line;
+    long contentLength;
+    bool fChunked;
+    do {
+      // status line, 1xx responses are followed by the actual one
+      if(!readLine(line) || line.compare(0, 7, "HTTP/1.") != 0 || line.length() < 12) {
+        return false;
+      }
+      status = (int)strtol(line.c_str() + 9, NULL, 10);
+
+      contentLength = -1;
+      fChunked = false;
+      fClose = line.compare(0, 8, "HTTP/1.0") == 0;
+      etag.clear();
+      lastModified.clear();
+      while(true) {
+        if(!readLine(line)) {
+          return false;
+        }
+        if(line.empty()) {
+          break;
+        }
+        size_t colon = line.find(':');
+        if(colon == string::npos) {
+          return false;
+        }
+        size_t valuePos = line.find_first_not_of(" \t", colon + 1);
+        const char * value = (valuePos == string::npos) ? "" : line.c_str() + valuePos;
+        line[colon] = '\0';
+        const char * name = line.c_str();
+        if(strcasecmp(name, "Content-Length") == 0) {
+          contentLength = strtol(value, NULL, 10);
+        }
+        else if(strcasecmp(name, "Transfer-Encoding") == 0) {
+          fChunked = strcasecmp(value, "identity") != 0;
+        }
+        else if(strcasecmp(name, "Connection") == 0) {
+          fClose = strcasecmp(value, "close") == 0;
+        }
+        else if(strcasecmp(name, "ETag") == 0) {
+          etag = value;
+        }
+        else if(strcasecmp(name, "Last-Modified") == 0) {
+          lastModified = value;
+        }
+      }
+    } while(status >= 100 && status < 200);
+
+    body.clear();
+    if(status == 204 || status == 304) {
+      return true;
+    }
+    if(fChunked) {
+      while(true) {
+        if(!readLine(line)) {
+          return false;
+        }
+        size_t chunkLength = strtoul(line.c_str(), NULL, 16);
+        if(chunkLength == 0) {
+          break;
+        }
+        if(!readBytes(chunkLength, body) || !readLine(line)) {
+          return false;
+        }
+      }
+      // trailer up to the empty line
+      do {
+        if(!readLine(line)) {
+          return false;
+        }
+      } while(!line.empty());
+      return true;
+    }
+    if(contentLength >= 0) {
+      return readBytes((size_t)contentLength, body);
+    }
+
+    // the body ends with the connection
+    fClose = true;
+    while(fill()) {
+      body.append(this->buffer + this->pos, this->len - this->pos);
+      this->pos = this->len;
+    }
+    return this->fClosed;
+  };
+
+  private:
+  // Receives more bytes once the buffer is consumed, false if there are none
+  bool fill() {
+    if(this->pos < this->len) {
+      return true;
+    }
+    nsapi_size_or_error_t received = this->socket->recv(this->buffer, sizeof(this->buffer));
+    if(received <= 0) {
+      this->fClosed = (received == 0);
+      return false;
+    }
+    this->pos = 0;
+    this->len = received;
+    return true;
+  };
+
+  // A line without its CRLF, lines longer than a header may be are malformed
+  bool readLine(string & line) {
+    line.clear();
+    while(fill()) {
+      char c = this->buffer[this->pos++];
+      if(c == '\n') {
+        if(!line.empty() && line[line.length() - 1] == '\r') {
+          line.erase(line.length() - 1);
+        }
+        return true;
+      }
+      if(line.length() >= 1024) {
+        return false;
+      }
+      line += c;
+    }
+    return false;
+  };
+
+  bool readBytes(size_t count, string & out) {
+    while(count > 0 && fill()) {
+      size_t n = this->len - this->pos;
+      if(n > count) {
+        n = count;
+      }
+      out.append(this->buffer + this->pos, n);
+      this->pos += n;
+      count -= n;
+    }
+    return count == 0;
+  };
+
+  ThingSpeakSocket * socket;
+  char buffer[256];
+  size_t pos;
+  size_t len;
+  bool fClosed;
+};
+
+#if THINGSPEAK_READ_CACHE > 0
+// Responses of reads together with the validators (ETag, Last-Modified) the server sent along. A response younger than the
+// TTL is returned without a request, an older one is revalidated with a conditional request, so an unchanged channel costs a
+// header-only exchange. Entries are keyed by channel and a hash of the URL suffix and API key. The least recently used ones
+// are dropped when there are more than THINGSPEAK_READ_CACHE of them or they hold more than THINGSPEAK_READ_CACHE_BYTES.
+class ThingSpeakReadCache
+{
+  public:
+  struct Entry {
+    Entry() : fValid(false), channelNumber(0), key(0), lastUsed(0), fetchedAt(0) {}
+    size_t size() const {
+      return this->etag.length() + this->lastModified.length() + this->content.length();
+    };
+    bool fValid;
+    unsigned long channelNumber;
+    uint32_t key;
+    uint32_t lastUsed;
+    uint64_t fetchedAt;
+    string etag;
+    string lastModified;
+    string content;
+  };
+
+  ThingSpeakReadCache() {
+    this->useCount = 0;
+    this->usedBytes = 0;
+  };
+
+  // FNV-1a of the URL suffix and the API key
+  static uint32_t hash(const string & URLSuffix, const char * apiKey) {
+    uint32_t value = 2166136261u;
+    for(size_t i = 0; i < URLSuffix.length(); i++) {
+      value = (value ^ (uint8_t)URLSuffix[i]) * 16777619u;
+    }
+    value = (value ^ 0xFF) * 16777619u;
+    for(const char * c = apiKey; NULL != c && *c != '\0'; c++) {
+      value = (value ^ (uint8_t)*c) * 16777619u;
+    }
+    return value;
+  };
+
+  Entry * find(unsigned long channelNumber, uint32_t key) {
+    for(size_t i = 0; i < THINGSPEAK_READ_CACHE; i++) {
+      Entry * entry = &this->entries[i];
+      if(entry->fValid && entry->channelNumber == channelNumber && entry->key == key) {
+        entry->lastUsed = ++this->useCount;
+        return entry;
+      }
+    }
+    return NULL;
+  };
+
+  // Keeps a response fetched at now, replaces the least recently used entries as long as the budget is exceeded
+  void store(unsigned long channelNumber, uint32_t key, const string & etag, const string & lastModified, const char * body, size_t bodyLen, uint64_t now) {
+    remove(channelNumber, key);
+    if(etag.length() + lastModified.length() + bodyLen > THINGSPEAK_READ_CACHE_BYTES) {
+      return;
+    }
+
+    Entry * entry = leastRecentlyUsed();
+    while(entry->fValid || this->usedBytes + etag.length() + lastModified.length() + bodyLen > THINGSPEAK_READ_CACHE_BYTES) {
+      drop(leastRecentlyUsedValid());
+      entry = leastRecentlyUsed();
+    }
+
+    entry->fValid = true;
+    entry->channelNumber = channelNumber;
+    entry->key = key;
+    entry->lastUsed = ++this->useCount;
+    entry->fetchedAt = now;
+    entry->etag = etag;
+    entry->lastModified = lastModified;
+    entry->content.assign(body, bodyLen);
+    this->usedBytes += entry->size();
+  };
+
+  void remove(unsigned long channelNumber, uint32_t key) {
+    Entry * entry = find(channelNumber, key);
+    if(NULL != entry) {
+      drop(entry);
+    }
+  };
+
+  void clear() {
+    for(size_t i = 0; i < THINGSPEAK_READ_CACHE; i++) {
+      if(this->entries[i].fValid) {
+        drop(&this->entries[i]);
+      }
+    }
+  };
+
+  private:
+  // A free entry if there is one, the least recently used one otherwise
+  Entry * leastRecentlyUsed() {
+    Entry * entry = &this->entries[0];
+    for(size_t i = 1; i < THINGSPEAK_READ_CACHE && entry->fValid; i++) {
+      if(!this->entries[i].fValid || this->entries[i].lastUsed < entry->lastUsed) {
+        entry = &this->entries[i];
+      }
+    }
+    return entry;
+  };
+
+  // The least recently used of the valid entries, only called while usedBytes > 0 or all entries are valid
+  Entry * leastRecentlyUsedValid() {
+    Entry * entry = NULL;
+    for(size_t i = 0; i < THINGSPEAK_READ_CACHE; i++) {
+      if(this->entries[i].fValid && (NULL == entry || this->entries[i].lastUsed < entry->lastUsed)) {
+        entry = &this->entries[i];
+      }
+    }
+    return entry;
+  };
+
+  void drop(Entry * entry) {
+    this->usedBytes -= entry->size();
+    entry->fValid = false;
+    string().swap(entry->etag);
+    string().swap(entry->lastModified);
+    string().swap(entry->content);
+  };
+
+  Entry entries[THINGSPEAK_READ_CACHE];
+  uint32_t useCount;
+  size_t usedBytes;
+};
+#endif
+
+// Carries the updates of writeField(), writeFields() and writeRaw() to ThingSpeak, see ThingSpeak::setTransport().
+class ThingSpeakTransport
+{
+  public:
+  virtual ~ThingSpeakTransport() {};
+
+  /*
+  Sends one update of a channel, body holds the form encoded fields as for POST /update.
+  Returns 200 if successful or one of the error codes, entryID receives the entry ID or 0 if the transport does not learn it.
+  */
+  virtual int update(unsigned long channelNumber, const char * writeAPIKey, const char * body, size_t bodyLen, long * entryID) = 0;
+};
+
+// Publishes updates to the ThingSpeak MQTT broker (MQTT 3.1.1, QoS 0) over one long-lived connection.
+// The broker authenticates the MQTT device credentials created on ThingSpeak, the write API key is not used.
+class ThingSpeakMQTT : public ThingSpeakTransport
+{
+  public:
+  ThingSpeakMQTT() {
+    this->net = NULL;
+    this->socket = NULL;
+    this->host = THINGSPEAK_MQTT_URL;
+    this->port = THINGSPEAK_MQTT_PORT;
+    this->lastSent = 0;
+  };
+
+  ~ThingSpeakMQTT() {
+    close();
+  };
+
+  /*
+  Sets the network interface and the MQTT device credentials, the connection is opened with the first update.
+  */
+  void begin(NetworkInterface * net, const char * clientID, const char * username, const char * password, const char * host = THINGSPEAK_MQTT_URL, uint16_t port = THINGSPEAK_MQTT_PORT) {
+    this->mutex.lock();
+    closeSocket();
+    this->net = net;
+    this->clientID = clientID;
+    this->username = username;
+    this->password = password;
+    this->host = host;
+    this->port = port;
+    this->mutex.unlock();
+  };
+
+  /*
+  Publishes body to channels/<channelNumber>/publish. QoS 0 has no acknowledgement, so 200 means the update was
+  handed to the network and entryID is always 0. The broker authenticates the device, the write API key is not used.
+  */
+  virtual int update(unsigned long channelNumber, const char *, const char * body, size_t bodyLen, long * entryID) {
+    int status = ERR_CONNECT_FAILED;
+
+    *entryID = 0;
+
+    string topic = string("channels/") + std::to_string(channelNumber) + string("/publish");
+    size_t remainingLen = 2 + topic.length() + bodyLen;
+    if(remainingLen + 5 > sizeof(this->packet)) {
+      return ERR_OUT_OF_RANGE;
+    }
+
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::mqtt PUBLISH %s \"%.*s\"\n", topic.c_str(), (int)bodyLen, body);
+    #endif
+
+    // The packet buffer is shared with connect() and the other threads, it is only used with the lock held
+    this->mutex.lock();
+    for(int attempt = 0; attempt < 2; attempt++) {
+      // The broker drops a connection idle for 1.5 keep-alive periods, reconnect before that can happen
+      if(NULL != this->socket && Kernel::get_ms_count() - this->lastSent > (uint64_t)THINGSPEAK_MQTT_KEEPALIVE * 1000) {
+        closeSocket();
+      }
+      bool fReused = (NULL != this->socket);
+      if(!fReused) {
+        status = connect();
+        if(status != OK_SUCCESS) {
+          break;
+        }
+      }
+
+      // PUBLISH, QoS 0, no message identifier
+      size_t packetLen = 0;
+      this->packet[packetLen++] = (char)0x30;
+      packetLen += encodeLength(this->packet + packetLen, remainingLen);
+      packetLen += encodeString(this->packet + packetLen, topic.c_str(), topic.length());
+      memcpy(this->packet + packetLen, body, bodyLen);
+      packetLen += bodyLen;
+
+      if(sendAll(this->packet, packetLen)) {
+        status = OK_SUCCESS;
+        break;
+      }
+      status = ERR_CONNECT_FAILED;
+      closeSocket();
+      if(!fReused) {
+        break;
+      }
+    }
+    this->mutex.unlock();
+
+    return status;
+  };
+
+  // Disconnects from the broker
+  void close() {
+    this->mutex.lock();
+    closeSocket();
+    this->mutex.unlock();
+  };
+
+  private:
+  int connect() {
+    if(NULL == this->net) {
+      return ERR_CONNECT_FAILED;
+    }
+
+    SocketAddress address;
+    if(this->net->gethostbyname(this->host.c_str(), &address) != NSAPI_ERROR_OK) {
+      return ERR_CONNECT_FAILED;
+    }
+    address.set_port(this->port);
+
+    this->socket = new TCPSocket();
+    if(this->socket->open(this->net) != NSAPI_ERROR_OK || this->socket->connect(address) != NSAPI_ERROR_OK) {
+      closeSocket();
+      return ERR_CONNECT_FAILED;
+    }
+    this->socket->set_timeout(TIMEOUT_MS_SERVERRESPONSE);
+
+    // CONNECT with clean session, user name and password
+    size_t remainingLen = 10 + 2 + this->clientID.length() + 2 + this->username.length() + 2 + this->password.length();
+    if(remainingLen + 5 > sizeof(this->packet)) {
+      closeSocket();
+      return ERR_OUT_OF_RANGE;
+    }
+    size_t packetLen = 0;
+    this->packet[packetLen++] = (char)0x10;
+    packetLen += encodeLength(this->packet + packetLen, remainingLen);
+    packetLen += encodeString(this->packet + packetLen, "MQTT", 4);
+    this->packet[packetLen++] = 4;                   // protocol level 3.1.1
+    this->packet[packetLen++] = (char)0xC2;          // user name, password, clean session
+    this->packet[packetLen++] = (char)(THINGSPEAK_MQTT_KEEPALIVE >> 8);
+    this->packet[packetLen++] = (char)(THINGSPEAK_MQTT_KEEPALIVE & 0xFF);
+    packetLen += encodeString(this->packet + packetLen, this->clientID.c_str(), this->clientID.length());
+    packetLen += encodeString(this->packet + packetLen, this->username.c_str(), this->username.length());
+    packetLen += encodeString(this->packet + packetLen, this->password.c_str(), this->password.length());
+
+    char connack[4];
+    if(!sendAll(this->packet, packetLen) || !recvAll(connack, sizeof(connack)) || (uint8_t)connack[0] != 0x20 || connack[1] != 2) {
+      #ifdef PRINT_DEBUG_MESSAGES
+        printf("ts::mqtt no CONNACK from %s\n", this->host.c_str());
+      #endif
+      closeSocket();
+      return ERR_BAD_RESPONSE;
+    }
+    if(connack[3] != 0) {
+      #ifdef PRINT_DEBUG_MESSAGES
+        printf("ts::mqtt connection refused (%d)\n", connack[3]);
+      #endif
+      closeSocket();
+      // 4: bad user name or password, 5: not authorized
+      return (connack[3] == 4 || connack[3] == 5) ? ERR_BADAPIKEY : ERR_CONNECT_FAILED;
+    }
+
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::mqtt connected to %s\n", this->host.c_str());
+    #endif
+    return OK_SUCCESS;
+  };
+
+  void closeSocket() {
+    if(NULL == this->socket) {
+      return;
+    }
+    const char disconnect[2] = { (char)0xE0, 0 };
+    this->socket->send(disconnect, sizeof(disconnect));
+    this->socket->close();
+    delete this->socket;
+    this->socket = NULL;
+  };
+
+  bool sendAll(const char * data, size_t len) {
+    while(len > 0) {
+      nsapi_size_or_error_t sent = this->socket->send(data, len);
+      if(sent <= 0) {
+        return false;
+      }
+      data += sent;
+      len -= sent;
+    }
+    this->lastSent = Kernel::get_ms_count();
+    return true;
+  };
+
+  bool recvAll(char * data, size_t len) {
+    while(len > 0) {
+      nsapi_size_or_error_t received = this->socket->recv(data, len);
+      if(received <= 0) {
+        return false;
+      }
+      data += received;
+      len -= received;
+    }
+    return true;
+  };
+
+  // Remaining length of the fixed header, 1-4 bytes
+  static size_t encodeLength(char * out, size_t len) {
+    size_t outLen = 0;
+    do {
+      char digit = (char)(len & 0x7F);
+      len >>= 7;
+      out[outLen++] = (char)(len > 0 ? (digit | 0x80) : digit);
+    } while(len > 0);
+    return outLen;
+  };
+
+  static size_t encodeString(char * out, const char * value, size_t len) {
+    out[0] = (char)(len >> 8);
+    out[1] = (char)(len & 0xFF);
+    memcpy(out + 2, value, len);
+    return 2 + len;
+  };
+
+  NetworkInterface *net;
+  TCPSocket *socket;
+  Mutex mutex;
+  string host;
+  uint16_t port;
+  string clientID;
+  string username;
+  string password;
+  uint64_t lastSent;
+  char packet[THINGSPEAK_PAYLOAD_SIZE + 64];
+};
+
+// Append-only log of packed entries on a BlockDevice, holds updates while ThingSpeak can't be reached.
+// The device is split into segments of one erase unit which are written round robin, so every segment gets
+// the same number of erase cycles. Forwarded entries are marked by appending a checkpoint record instead of
+// rewriting the log, a segment is erased only when it is reused. If all segments are full the oldest is dropped.
+class ThingSpeakStore
+{
+  public:
+  ThingSpeakStore() {
+    this->bd = NULL;
+    this->segmentSize = 0;
+    this->segmentCount = 0;
+    this->alignSize = 1;
+    this->headerSize = 0;
+    this->fEmpty = true;
+    this->tailSequence = 0;
+    this->headSequence = 0;
+    this->writeOffset = 0;
+    this->readSequence = 0;
+    this->readOffset = 0;
+    this->pendingCount = 0;
+  };
+
+  /*
+  Initializes the block device and scans the log for the write position and the first entry not forwarded yet.
+  Returns true if the log can be used.
+  */
+  bool mount(BlockDevice * bd) {
+    this->bd = bd;
+    if(bd->init() != 0) {
+      return false;
+    }
+
+    this->alignSize = bd->get_program_size();
+    if(bd->get_read_size() > this->alignSize) {
+      this->alignSize = bd->get_read_size();
+    }
+    this->segmentSize = bd->get_erase_size();
+    this->segmentCount = (uint32_t)(bd->size() / this->segmentSize);
+    this->headerSize = align(SEGMENT_HEADER_SIZE);
+    if(this->segmentCount < 2 || align(RECORD_HEADER_SIZE) > THINGSPEAK_STORE_BUFFER_SIZE) {
+      #ifdef PRINT_DEBUG_MESSAGES
+        printf("ts::store unsupported geometry (%lu segments of %lu bytes)\n", (unsigned long)this->segmentCount, (unsigned long)this->segmentSize);
+      #endif
+      return false;
+    }
+
+    // The newest segment has the highest sequence number, the log reaches back as long as the predecessors are intact
+    this->fEmpty = true;
+    for(uint32_t iSegment = 0; iSegment < this->segmentCount; iSegment++) {
+      uint32_t sequence;
+      if(readSegmentHeader(iSegment, &sequence) && sequence % this->segmentCount == iSegment) {
+        if(this->fEmpty || sequence > this->headSequence) {
+          this->headSequence = sequence;
+        }
+        this->fEmpty = false;
+      }
+    }
+    if(this->fEmpty) {
+      this->pendingCount = 0;
+      return true;
+    }
+    this->tailSequence = this->headSequence;
+    while(this->tailSequence > 0 && this->headSequence - this->tailSequence + 1 < this->segmentCount) {
+      uint32_t sequence;
+      if(!readSegmentHeader((this->tailSequence - 1) % this->segmentCount, &sequence) || sequence != this->tailSequence - 1) {
+        break;
+      }
+      this->tailSequence--;
+    }
+
+    // Replay the log to find the last checkpoint and the end of the newest segment
+    this->readSequence = this->tailSequence;
+    this->readOffset = this->headerSize;
+    for(uint32_t sequence = this->tailSequence; sequence <= this->headSequence; sequence++) {
+      uint32_t offset = this->headerSize;
+      uint8_t type;
+      size_t len;
+      while(readRecord(sequence, offset, &type, &len)) {
+        if(type == RECORD_CHECKPOINT && len == 8) {
+          uint32_t checkpointSequence = getUInt32(this->buffer + RECORD_HEADER_SIZE);
+          if(checkpointSequence >= this->tailSequence) {
+            this->readSequence = checkpointSequence;
+            this->readOffset = getUInt32(this->buffer + RECORD_HEADER_SIZE + 4);
+          }
+        }
+        offset += align(RECORD_HEADER_SIZE + len);
+      }
+      if(sequence == this->headSequence) {
+        // Don't program over a torn record, continue in a fresh segment
+        this->writeOffset = isErased(sequence, offset) ? offset : this->segmentSize;
+      }
+    }
+
+    countPending();
+
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::store mounted (segments %lu..%lu, %u entries pending)\n", (unsigned long)this->tailSequence, (unsigned long)this->headSequence, this->pendingCount);
+    #endif
+    return true;
+  };
+
+  /*
+  Appends one packed entry to the log.
+  Returns true if the entry was programmed.
+  */
+  bool append(const char * entry, size_t len) {
+    return appendRecord(RECORD_ENTRY, entry, len);
+  };
+
+  /*
+  Reads the next entry at or behind the position sequence/offset into entry and moves the position behind it.
+  Returns the length of the entry, or 0 at the end of the log or if the entry does not fit into capacity.
+  */
+  size_t readNext(uint32_t * sequence, uint32_t * offset, char * entry, size_t capacity) {
+    if(this->fEmpty) {
+      return 0;
+    }
+    while(*sequence <= this->headSequence) {
+      uint8_t type;
+      size_t len;
+      if(!readRecord(*sequence, *offset, &type, &len)) {
+        if(*sequence == this->headSequence) {
+          return 0;
+        }
+        (*sequence)++;
+        *offset = this->headerSize;
+        continue;
+      }
+      if(type == RECORD_ENTRY && len > capacity) {
+        return 0;
+      }
+      *offset += align(RECORD_HEADER_SIZE + len);
+      if(type == RECORD_ENTRY) {
+        memcpy(entry, this->buffer + RECORD_HEADER_SIZE, len);
+        return len;
+      }
+    }
+    return 0;
+  };
+
+  /*
+  Marks all entries before the position sequence/offset as forwarded, count is the number of entries this covers.
+  Returns true if the checkpoint was programmed.
+  */
+  bool commit(uint32_t sequence, uint32_t offset, unsigned int count) {
+    this->readSequence = sequence;
+    this->readOffset = offset;
+    this->pendingCount = count < this->pendingCount ? this->pendingCount - count : 0;
+    return appendCheckpoint();
+  };
+
+  // Position of the first entry not forwarded yet
+  void getReadPosition(uint32_t * sequence, uint32_t * offset) {
+    *sequence = this->readSequence;
+    *offset = this->readOffset;
+  };
+
+  unsigned int getPendingCount() {
+    return this->pendingCount;
+  };
+
+  // Scratch space for encoding an entry before it is appended
+  char * getEntryBuffer() {
+    return this->entry;
+  };
+
+  private:
+  bool appendRecord(uint8_t type, const char * data, size_t len) {
+    size_t recordSize = align(RECORD_HEADER_SIZE + len);
+    if(NULL == this->bd || len > 0xFFFF || recordSize > THINGSPEAK_STORE_BUFFER_SIZE || this->headerSize + 2 * recordSize > this->segmentSize) {
+      return false;
+    }
+
+    if(this->fEmpty || this->writeOffset + recordSize > this->segmentSize) {
+      if(!rotate()) {
+        return false;
+      }
+      // The checkpoint has to stay in a segment that outlives the ones it refers to
+      if(type != RECORD_CHECKPOINT && !appendCheckpoint()) {
+        return false;
+      }
+    }
+
+    memset(this->buffer, 0xFF, recordSize);
+    this->buffer[0] = RECORD_MAGIC;
+    this->buffer[1] = type;
+    setUInt16(this->buffer + 2, (uint16_t)len);
+    setUInt16(this->buffer + 4, crc16(data, len));
+    memcpy(this->buffer + RECORD_HEADER_SIZE, data, len);
+    if(this->bd->program(this->buffer, address(this->headSequence, this->writeOffset), recordSize) != 0) {
+      // Part of the record may be programmed, continue in a fresh segment
+      this->writeOffset = this->segmentSize;
+      return false;
+    }
+    this->writeOffset += recordSize;
+    if(type == RECORD_ENTRY) {
+      this->pendingCount++;
+    }
+    return true;
+  };
+
+  bool appendCheckpoint() {
+    char checkpoint[8];
+    setUInt32(checkpoint, this->readSequence);
+    setUInt32(checkpoint + 4, this->readOffset);
+    return appendRecord(RECORD_CHECKPOINT, checkpoint, sizeof(checkpoint));
+  };
+
+  // Starts the next segment in ring order, dropping the oldest one if the log is full
+  bool rotate() {
+    uint32_t sequence = this->fEmpty ? 0 : this->headSequence + 1;
+
+    if(!this->fEmpty && sequence - this->tailSequence >= this->segmentCount) {
+      this->tailSequence++;
+      if(this->readSequence < this->tailSequence) {
+        #ifdef PRINT_DEBUG_MESSAGES
+          printf("ts::store full, dropping segment %lu\n", (unsigned long)(this->tailSequence - 1));
+        #endif
+        this->readSequence = this->tailSequence;
+        this->readOffset = this->headerSize;
+        countPending();
+      }
+    }
+
+    bd_addr_t segment = (bd_addr_t)(sequence % this->segmentCount) * this->segmentSize;
+    if(this->bd->erase(segment, this->segmentSize) != 0) {
+      return false;
+    }
+    memset(this->buffer, 0xFF, this->headerSize);
+    memcpy(this->buffer, "TSLG", 4);
+    setUInt32(this->buffer + 4, sequence);
+    if(this->bd->program(this->buffer, segment, this->headerSize) != 0) {
+      return false;
+    }
+
+    if(this->fEmpty) {
+      this->tailSequence = sequence;
+      this->readSequence = sequence;
+      this->readOffset = this->headerSize;
+      this->fEmpty = false;
+    }
+    this->headSequence = sequence;
+    this->writeOffset = this->headerSize;
+    return true;
+  };
+
+  void countPending() {
+    uint32_t sequence = this->readSequence;
+    uint32_t offset = this->readOffset;
+    uint8_t type;
+    size_t len;
+
+    this->pendingCount = 0;
+    for(; sequence <= this->headSequence; sequence++, offset = this->headerSize) {
+      while(readRecord(sequence, offset, &type, &len)) {
+        if(type == RECORD_ENTRY) {
+          this->pendingCount++;
+        }
+        offset += align(RECORD_HEADER_SIZE + len);
+      }
+    }
+  };
+
+  bool readSegmentHeader(uint32_t index, uint32_t * sequence) {
+    if(this->bd->read(this->buffer, (bd_addr_t)index * this->segmentSize, this->headerSize) != 0) {
+      return false;
+    }
+    if(memcmp(this->buffer, "TSLG", 4) != 0) {
+      return false;
+    }
+    *sequence = getUInt32(this->buffer + 4);
+    return true;
+  };
+
+  // Reads the record at offset into buffer, returns false at the end of the segment or for a damaged record
+  bool readRecord(uint32_t sequence, uint32_t offset, uint8_t * type, size_t * len) {
+    size_t headerLen = align(RECORD_HEADER_SIZE);
+    if(offset + headerLen > this->segmentSize) {
+      return false;
+    }
+    if(this->bd->read(this->buffer, address(sequence, offset), headerLen) != 0 || (uint8_t)this->buffer[0] != RECORD_MAGIC) {
+      return false;
+    }
+
+    *type = (uint8_t)this->buffer[1];
+    *len = getUInt16(this->buffer + 2);
+    size_t recordSize = align(RECORD_HEADER_SIZE + *len);
+    if(recordSize > THINGSPEAK_STORE_BUFFER_SIZE || offset + recordSize > this->segmentSize) {
+      return false;
+    }
+    if(recordSize > headerLen && this->bd->read(this->buffer + headerLen, address(sequence, offset + headerLen), recordSize - headerLen) != 0) {
+      return false;
+    }
+    return crc16(this->buffer + RECORD_HEADER_SIZE, *len) == getUInt16(this->buffer + 4);
+  };
+
+  bool isErased(uint32_t sequence, uint32_t offset) {
+    size_t headerLen = align(RECORD_HEADER_SIZE);
+    if(offset + headerLen > this->segmentSize) {
+      return true;
+    }
+    if(this->bd->read(this->buffer, address(sequence, offset), headerLen) != 0) {
+      return false;
+    }
+    int erased = this->bd->get_erase_value();
+    for(size_t i = 0; i < headerLen; i++) {
+      if(erased < 0 || (uint8_t)this->buffer[i] != (uint8_t)erased) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  bd_addr_t address(uint32_t sequence, uint32_t offset) {
+    return (bd_addr_t)(sequence % this->segmentCount) * this->segmentSize + offset;
+  };
+
+  size_t align(size_t len) {
+    return (len + this->alignSize - 1) / this->alignSize * this->alignSize;
+  };
+
+  static uint16_t crc16(const char * data, size_t len) {
+    // CRC-16/CCITT-FALSE
+    uint16_t crc = 0xFFFF;
+    for(size_t i = 0; i < len; i++) {
+      crc ^= (uint16_t)((uint8_t)data[i] << 8);
+      for(int iBit = 0; iBit < 8; iBit++) {
+        crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+      }
+    }
+    return crc;
+  };
+
+  static uint16_t getUInt16(const char * p) {
+    return (uint16_t)((uint8_t)p[0] | ((uint8_t)p[1] << 8));
+  };
+
+  static uint32_t getUInt32(const char * p) {
+    return (uint32_t)getUInt16(p) | ((uint32_t)getUInt16(p + 2) << 16);
+  };
+
+  static void setUInt16(char * p, uint16_t value) {
+    p[0] = (char)(value & 0xFF);
+    p[1] = (char)(value >> 8);
+  };
+
+  static void setUInt32(char * p, uint32_t value) {
+    setUInt16(p, (uint16_t)(value & 0xFFFF));
+    setUInt16(p + 2, (uint16_t)(value >> 16));
+  };
+
+  // Segment header: magic and sequence number. Record header: magic, type, data length and CRC of the data.
+  static const size_t SEGMENT_HEADER_SIZE = 8;
+  static const size_t RECORD_HEADER_SIZE = 8;
+  static const uint8_t RECORD_MAGIC = 0x5A;
+  static const uint8_t RECORD_ENTRY = 1;
+  static const uint8_t RECORD_CHECKPOINT = 2;
+
+  BlockDevice *bd;
+  uint32_t segmentSize;
+  uint32_t segmentCount;
+  size_t alignSize;
+  size_t headerSize;
+  bool fEmpty;
+  uint32_t tailSequence;
+  uint32_t headSequence;
+  uint32_t writeOffset;
+  uint32_t readSequence;
+  uint32_t readOffset;
+  unsigned int pendingCount;
+  char buffer[THINGSPEAK_STORE_BUFFER_SIZE];
+  char entry[THINGSPEAK_STORE_BUFFER_SIZE];
+};
+
+// Value of a JSON member found by ThingSpeakJSON::scan(). It points into the scanned text, escape sequences are not resolved.
+struct ThingSpeakJSONValue
+{
+  const char * value;
+  size_t length;
+  bool fFound;
+  bool fString;
+  bool fNull;
+};
+
+// Scans the members of a flat JSON object in place, without copying the text or allocating memory.
+class ThingSpeakJSON
+{
+  public:
+  /*
+  Looks up keyCount keys in one pass over the object in json. values[i] receives the value of keys[i], nested objects and
+  arrays are returned as they are. Returns false if json is not a complete object, the values found up to the error are valid.
+  */
+  static bool scan(const char * json, size_t len, const char * const keys[], ThingSpeakJSONValue values[], size_t keyCount) {
+    const char * end = json + len;
+    const char * p = skipSpace(json, end);
+
+    for(size_t i = 0; i < keyCount; i++) {
+      values[i].value = NULL;
+      values[i].length = 0;
+      values[i].fFound = false;
+      values[i].fString = false;
+      values[i].fNull = false;
+    }
+
+    if(p == end || *p != '{') {
+      return false;
+    }
+    p = skipSpace(p + 1, end);
+    if(p != end && *p == '}') {
+      return true;
+    }
+
+    while(p != end) {
+      if(*p != '"') {
+        return false;
+      }
+      const char * key = p + 1;
+      p = skipString(p, end);
+      if(NULL == p) {
+        return false;
+      }
+      size_t keyLen = p - key - 1;
+
+      p = skipSpace(p, end);
+      if(p == end || *p != ':') {
+        return false;
+      }
+      p = skipSpace(p + 1, end);
+
+      const char * value = p;
+      p = skipValue(p, end);
+      if(NULL == p) {
+        return false;
+      }
+
+      for(size_t i = 0; i < keyCount; i++) {
+        if(!values[i].fFound && strncmp(keys[i], key, keyLen) == 0 && keys[i][keyLen] == '\0') {
+          values[i].fFound = true;
+          values[i].fString = (*value == '"');
+          values[i].value = values[i].fString ? value + 1 : value;
+          values[i].length = values[i].fString ? p - value - 2 : p - value;
+          values[i].fNull = (p - value == 4 && strncmp(value, "null", 4) == 0);
+          break;
+        }
+      }
+
+      p = skipSpace(p, end);
+      if(p != end && *p == '}') {
+        return true;
+      }
+      if(p == end || *p != ',') {
+        return false;
+      }
+      p = skipSpace(p + 1, end);
+    }
+    return false;
+  };
+
+  /*
+  Resolves the escape sequences of a string value into out, which is always zero-terminated.
+  Returns the length of the unescaped value, the value is truncated if it does not fit into capacity.
+  */
+  static size_t unescape(const ThingSpeakJSONValue & value, char * out, size_t capacity) {
+    size_t len = 0;
+    const char * p = value.value;
+    const char * end = value.value + value.length;
+
+    if(capacity == 0) {
+      return 0;
+    }
+    while(p != end && len + 1 < capacity) {
+      char c = *p++;
+      if(!value.fString || c != '\\' || p == end) {
+        out[len++] = c;
+        continue;
+      }
+      c = *p++;
+      switch(c) {
+        case 'b': out[len++] = '\b'; break;
+        case 'f': out[len++] = '\f'; break;
+        case 'n': out[len++] = '\n'; break;
+        case 'r': out[len++] = '\r'; break;
+        case 't': out[len++] = '\t'; break;
+        case 'u': {
+          char utf8[3];
+          uint32_t code = 0;
+          for(int i = 0; i < 4 && p != end; i++) {
+            int digit = hexDigit(*p++);
+            code = (code << 4) | (digit < 0 ? 0 : digit);
+          }
+          size_t utf8Len = encodeUTF8(code, utf8);
+          if(len + utf8Len >= capacity) {
+            out[len] = '\0';
+            return len;
+          }
+          memcpy(out + len, utf8, utf8Len);
+          len += utf8Len;
+          break;
+        }
+        default: out[len++] = c; break;
+      }
+    }
+    out[len] = '\0';
+    return len;
+  };
+
+  // Encodes a code point of the basic multilingual plane as UTF-8 into out (3 bytes), returns the number of bytes
+  static size_t encodeUTF8(uint32_t code, char * out) {
+    if(code < 0x80) {
+      out[0] = (char)code;
+      return 1;
+    }
+    if(code < 0x800) {
+      out[0] = (char)(0xC0 | (code >> 6));
+      out[1] = (char)(0x80 | (code & 0x3F));
+      return 2;
+    }
+    out[0] = (char)(0xE0 | ((code >> 12) & 0x0F));
+    out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+    out[2] = (char)(0x80 | (code & 0x3F));
+    return 3;
+  };
+
+  static int hexDigit(char c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  };
+
+  private:
+  static const char * skipSpace(const char * p, const char * end) {
+    while(p != end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+      p++;
+    }
+    return p;
+  };
+
+  // Skips the string starting at the opening quote p, returns the position behind the closing quote or NULL
+  static const char * skipString(const char * p, const char * end) {
+    for(p++; p != end; p++) {
+      if(*p == '\\') {
+        if(++p == end) {
+          return NULL;
+        }
+      }
+      else if(*p == '"') {
+        return p + 1;
+      }
+    }
+    return NULL;
+  };
+
+  // Skips a string, literal, object or array, returns the position behind it or NULL
+  static const char * skipValue(const char * p, const char * end) {
+    if(p == end) {
+      return NULL;
+    }
+    if(*p == '"') {
+      return skipString(p, end);
+    }
+    if(*p == '{' || *p == '[') {
+      unsigned int depth = 0;
+      while(p != end) {
+        if(*p == '"') {
+          p = skipString(p, end);
+          if(NULL == p) {
+            return NULL;
+          }
+          continue;
+        }
+        if(*p == '{' || *p == '[') {
+          depth++;
+        }
+        else if(*p == '}' || *p == ']') {
+          if(--depth == 0) {
+            return p + 1;
+          }
+        }
+        p++;
+      }
+      return NULL;
+    }
+
+    // number, true, false or null
+    const char * from = p;
+    while(p != end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+      p++;
+    }
+    return p == from ? NULL : p;
+  };
+};
+
+// Entry of a channel feed as read by readLastFeed(). Values which are null or not part of the feed are empty.
+class FeedEntry
+{
+  public:
+  FeedEntry() {
+    reset();
+  };
+
+  void reset() {
+    this->entryID = 0;
+    this->createdAt.clear();
+    for(size_t i = 0; i < FIELDNUM_MAX; i++) {
+      this->field[i].clear();
+    }
+    this->status.clear();
+    this->latitude.clear();
+    this->longitude.clear();
+    this->elevation.clear();
+  };
+
+  // Value of field 1-8, an empty string for other field numbers
+  const string & getField(unsigned int fieldNumber) const {
+    static const string empty;
+    if(fieldNumber < FIELDNUM_MIN || fieldNumber > FIELDNUM_MAX) {
+      return empty;
+    }
+    return this->field[fieldNumber - 1];
+  };
+
+  // Assigns value to the member named key in a feed, returns false for keys which are not part of an entry
+  bool setValue(const char * key, const char * value, size_t len) {
+    if(strncmp(key, "field", 5) == 0 && key[5] >= '1' && key[5] < '1' + FIELDNUM_MAX && key[6] == '\0') {
+      this->field[key[5] - '1'].assign(value, len);
+    }
+    else if(strcmp(key, "created_at") == 0) {
+      this->createdAt.assign(value, len);
+    }
+    else if(strcmp(key, "entry_id") == 0) {
+      this->entryID = atol(string(value, len).c_str());
+    }
+    else if(strcmp(key, "status") == 0) {
+      this->status.assign(value, len);
+    }
+    else if(strcmp(key, "latitude") == 0) {
+      this->latitude.assign(value, len);
+    }
+    else if(strcmp(key, "longitude") == 0) {
+      this->longitude.assign(value, len);
+    }
+    else if(strcmp(key, "elevation") == 0) {
+      this->elevation.assign(value, len);
+    }
+    else {
+      return false;
+    }
+    return true;
+  };
+
+  long entryID;
+  string createdAt;
+  string field[FIELDNUM_MAX];
+  string status;
+  string latitude;
+  string longitude;
+  string elevation;
+};
+
+// Incremental parser of a channel feed in JSON format. The response body is passed in as it arrives, each entry of the
+// feeds array is handed to the callback once it is complete. The memory needed does not depend on the size of the feed,
+// values longer than FIELDLENGTH_MAX bytes are truncated.
+class ThingSpeakFeedParser
+{
+  public:
+  ThingSpeakFeedParser(Callback<void(const FeedEntry &)> onEntry) {
+    this->onEntry = onEntry;
+    this->mode = MODE_VALUE;
+    this->depth = 0;
+    this->arrayMask = 0;
+    this->feedsDepth = 0;
+    this->fFeeds = false;
+    this->fExpectKey = false;
+    this->fInEntry = false;
+    this->fDone = false;
+    this->fError = false;
+    this->tokenLen = 0;
+    this->key[0] = '\0';
+    this->entryCount = 0;
+  };
+
+  // Body callback of the request, data is not zero-terminated
+  void parse(const char * data, uint32_t len) {
+    for(uint32_t i = 0; i < len && !this->fError; i++) {
+      parseChar(data[i]);
+    }
+  };
+
+  // true if the body was a complete JSON document with a feeds array
+  bool isComplete() {
+    if(this->mode == MODE_LITERAL && this->depth == 0) {
+      endLiteral();
+    }
+    return !this->fError && this->fDone && this->fFeeds;
+  };
+
+  unsigned long getEntryCount() {
+    return this->entryCount;
+  };
+
+  private:
+  void parseChar(char c) {
+    switch(this->mode) {
+      case MODE_STRING:
+        if(c == '"') {
+          this->mode = MODE_VALUE;
+          endString();
+        }
+        else if(c == '\\') {
+          this->mode = MODE_ESCAPE;
+        }
+        else {
+          appendToken(c);
+        }
+        return;
+
+      case MODE_ESCAPE:
+        this->mode = MODE_STRING;
+        switch(c) {
+          case 'b': appendToken('\b'); break;
+          case 'f': appendToken('\f'); break;
+          case 'n': appendToken('\n'); break;
+          case 'r': appendToken('\r'); break;
+          case 't': appendToken('\t'); break;
+          case 'u':
+            this->mode = MODE_UNICODE;
+            this->unicodeDigits = 0;
+            this->unicode = 0;
+            break;
+          default: appendToken(c); break;
+        }
+        return;
+
+      case MODE_UNICODE: {
+        int digit = ThingSpeakJSON::hexDigit(c);
+        if(digit < 0) {
+          this->fError = true;
+          return;
+        }
+        this->unicode = (this->unicode << 4) | digit;
+        if(++this->unicodeDigits == 4) {
+          // surrogate pairs are not combined
+          char utf8[3];
+          size_t utf8Len = ThingSpeakJSON::encodeUTF8(this->unicode, utf8);
+          for(size_t i = 0; i < utf8Len; i++) {
+            appendToken(utf8[i]);
+          }
+          this->mode = MODE_STRING;
+        }
+        return;
+      }
+
+      case MODE_LITERAL:
+        if(c != ',' && c != '}' && c != ']' && c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+          appendToken(c);
+          return;
+        }
+        endLiteral();
+        break;
+
+      case MODE_VALUE:
+        break;
+    }
+
+    if(this->fDone) {
+      // only white space may follow the document
+      if(c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+        this->fError = true;
+      }
+      return;
+    }
+
+    switch(c) {
+      case ' ': case '\t': case '\r': case '\n': case ':':
+        break;
+
+      case '"':
+        this->mode = MODE_STRING;
+        this->tokenLen = 0;
+        break;
+
+      case '{':
+      case '[':
+        if(this->depth >= 32) {
+          this->fError = true;
+          return;
+        }
+        if(c == '{' && this->feedsDepth != 0 && this->depth == this->feedsDepth) {
+          this->fInEntry = true;
+          this->entry.reset();
+        }
+        if(c == '[' && this->depth == 1 && strcmp(this->key, "feeds") == 0) {
+          this->feedsDepth = 2;
+          this->fFeeds = true;
+        }
+        this->arrayMask = (c == '[') ? (this->arrayMask | (1UL << this->depth)) : (this->arrayMask & ~(1UL << this->depth));
+        this->depth++;
+        this->fExpectKey = (c == '{');
+        break;
+
+      case '}':
+      case ']':
+        if(this->depth == 0 || ((c == ']') != isArray())) {
+          this->fError = true;
+          return;
+        }
+        this->depth--;
+        if(c == '}' && this->fInEntry && this->depth == this->feedsDepth) {
+          this->fInEntry = false;
+          this->entryCount++;
+          if(this->onEntry) {
+            this->onEntry(this->entry);
+          }
+        }
+        if(this->depth < this->feedsDepth) {
+          this->feedsDepth = 0;
+        }
+        this->fDone = (this->depth == 0);
+        break;
+
+      case ',':
+        this->fExpectKey = !isArray();
+        break;
+
+      default:
+        this->mode = MODE_LITERAL;
+        this->tokenLen = 0;
+        appendToken(c);
+        break;
+    }
+  };
+
+  void endString() {
+    this->token[this->tokenLen] = '\0';
+    if(this->fExpectKey) {
+      this->fExpectKey = false;
+      strncpy(this->key, this->token, sizeof(this->key) - 1);
+      this->key[sizeof(this->key) - 1] = '\0';
+      return;
+    }
+    endValue(false);
+  };
+
+  void endLiteral() {
+    this->mode = MODE_VALUE;
+    this->token[this->tokenLen] = '\0';
+    endValue(strcmp(this->token, "null") == 0);
+  };
+
+  void endValue(bool fNull) {
+    if(this->depth == 0) {
+      // a document which is a single value
+      this->fDone = true;
+      return;
+    }
+    if(this->fInEntry && this->depth == this->feedsDepth + 1 && !fNull) {
+      this->entry.setValue(this->key, this->token, this->tokenLen);
+    }
+  };
+
+  bool isArray() {
+    return this->depth > 0 && (this->arrayMask & (1UL << (this->depth - 1)));
+  };
+
+  void appendToken(char c) {
+    if(this->tokenLen < FIELDLENGTH_MAX) {
+      this->token[this->tokenLen++] = c;
+    }
+  };
+
+  enum { MODE_VALUE, MODE_STRING, MODE_ESCAPE, MODE_UNICODE, MODE_LITERAL };
+
+  Callback<void(const FeedEntry &)> onEntry;
+  FeedEntry entry;
+  int mode;
+  unsigned int depth;
+  uint32_t arrayMask;
+  unsigned int feedsDepth;
+  bool fFeeds;
+  bool fExpectKey;
+  bool fInEntry;
+  bool fDone;
+  bool fError;
+  int unicodeDigits;
+  uint32_t unicode;
+  char token[FIELDLENGTH_MAX + 1];
+  size_t tokenLen;
+  char key[16];
+  unsigned long entryCount;
+};
+
+// Enables an Arduino, ESP8266, ESP32 or other compatible hardware to write or read data to or from ThingSpeak, an open data platform for the Internet of Things with MATLAB analytics and visualization.
+class ThingSpeak
+{
+  public:
+  ThingSpeak() {
+    this->payload = this->payloadBuffer;
+    this->payloadCapacity = THINGSPEAK_PAYLOAD_SIZE;
+    resetWriteFields();
+    this->lastReadStatus = OK_SUCCESS;
+    this->net = NULL;
+    this->bulkLength = 0;
+    this->bulkCount = 0;
+    this->bulkChannelNumber = 0;
+    this->bulkLastQueued = 0;
+    this->asyncQueue = NULL;
+    this->asyncThread = NULL;
+    #if THINGSPEAK_POOL_SIZE > 1
+      this->fanOutCount = 0;
+      this->fFanOutFailed = false;
+    #endif
+    this->store = NULL;
+    for(size_t i = 0; i < THINGSPEAK_SCHEDULE_CHANNELS; i++) {
+      this->schedules[i] = NULL;
+    }
+    this->httpTransport.ts = this;
+    this->transport = &this->httpTransport;
+    this->nextPoolSlot = 0;
+    this->bulkFormat = BULK_FORMAT_JSON;
+    #if THINGSPEAK_READ_CACHE > 0
+      this->readCacheTTL = THINGSPEAK_READ_CACHE_TTL;
+    #endif
+    this->retryAttempts = THINGSPEAK_RETRY_ATTEMPTS;
+    this->requestTimeout = TIMEOUT_MS_SERVERRESPONSE;
+    this->retryBaseDelay = THINGSPEAK_RETRY_BASE_DELAY;
+    this->retryMaxDelay = THINGSPEAK_RETRY_MAX_DELAY;
+    this->jitterState = 0;
+    this->fPowerManaged = false;
+    this->fNetworkUp = true;
+    this->fDeepSleepLocked = false;
+    this->networkUsers = 0;
+    this->flushInterval = 0;
+    this->flushEventID = 0;
+    #if THINGSPEAK_STATS
+      memset(&this->stats, 0, sizeof(this->stats));
+    #endif
+  };
+
+
+  /*
+  Function: begin
+
+  Summary:
+  Initializes the ThingSpeak library and network settings using the ThingSpeak.com service.
+
+  Parameters:
+  net - Network interface connected earlier in the application
+
+  Returns:
+  Always returns true
+
+  Notes:
+  This does not validate the information passed in, or generate any calls to ThingSpeak.
+
+  */
+  bool begin(NetworkInterface * net) {
+    return begin(net, THINGSPEAK_URL, THINGSPEAK_PORT_NUMBER, false);
+  };
+
+
+  /*
+  Function: begin
+
+  Summary:
+  Initializes the ThingSpeak library and network settings using a custom installation of ThingSpeak.
+
+  Parameters:
+  net - Network interface connected earlier in the application
+  host - Host name or IP address of the ThingSpeak server
+  port - Port number of the ThingSpeak server
+  resolve - Resolve the host name now instead of on the first request
+
+  Returns:
+  True, or false if resolve was requested and the host name could not be resolved
+
+  Notes:
+  The resolved address is reused for THINGSPEAK_DNS_TTL seconds or until a connect to it fails.
+
+  */
+  bool begin(NetworkInterface * net, const char * host, unsigned int port, bool resolve) {
+    resetWriteFields();
+    this->lastReadStatus = OK_SUCCESS;
+    this->net = net;
+    for(size_t i = 0; i < THINGSPEAK_POOL_SIZE; i++) {
+      this->pool[i].mutex.lock();
+      this->pool[i].connection.begin(net, host, (uint16_t)port);
+      this->pool[i].mutex.unlock();
+    }
+
+    if(resolve) {
+      // the other connections resolve the name with their first request
+      this->pool[0].mutex.lock();
+      bool fResolved = this->pool[0].connection.resolve() == NSAPI_ERROR_OK;
+      this->pool[0].mutex.unlock();
+      return fResolved;
+    }
+    return true;
+  };
+
+  /*
+  Function: setPayloadBuffer
+
+  Summary:
+  Use a buffer provided by the application for the payload of write requests.
+
+  Parameters:
+  buffer - Buffer that stays valid as long as the ThingSpeak object is used, NULL selects the built-in buffer again
+  capacity - Size of buffer in bytes
+
+  Returns:
+  Always return 200
+
+  Notes:
+  The payload of writeField(), writeFields() and writeRaw() is formatted into this buffer without any heap allocation.
+  The built-in buffer has THINGSPEAK_PAYLOAD_SIZE bytes. Writes whose payload does not fit return -101.
+  The buffer is swapped with the payload lock held, so the call waits for a write using the previous buffer to finish,
+  which may then be reused by the application.
+
+  */
+  int setPayloadBuffer(char * buffer, size_t capacity) {
+    this->writeMutex.lock();
+    if(NULL == buffer || capacity == 0) {
+      this->payload = this->payloadBuffer;
+      this->payloadCapacity = THINGSPEAK_PAYLOAD_SIZE;
+    }
+    else {
+      this->payload = buffer;
+      this->payloadCapacity = capacity;
+    }
+    this->writeMutex.unlock();
+    return OK_SUCCESS;
+  };
+
+
+  /*
+  Function: setTransport
+
+  Summary:
+  Select how writeField(), writeFields(), writeRaw() and the asynchronous and scheduled writes reach ThingSpeak.
+
+  Parameters:
+  transport - Transport used for updates, e.g. a ThingSpeakMQTT instance set up with begin(). NULL selects HTTP POST /update.
+
+  Notes:
+  Reads and bulk updates always use HTTP. The transport has to outlive its use by the library.
+
+  */
+  void setTransport(ThingSpeakTransport * transport) {
+    this->transport = (NULL == transport) ? &this->httpTransport : transport;
+  };
+
+
+  /*
+  Function: setRetryPolicy
+
+  Summary:
+  Set how often and when a failed write is sent again.
+
+  Parameters:
+  maxAttempts - Attempts of a write until the error is returned, 1 disables the retries.
+  baseDelay - Max delay before the first retry in ms, it doubles with each further retry.
+  maxDelay - Max delay between two attempts in ms.
+
+  Notes:
+  The delay before a retry is drawn at random between 0 and the backoff (full jitter), so devices failing at the same time
+  don't retry at the same time. The serialised body is sent again as it is. Failed connects (-301), timeouts (-304) and
+  server errors (5xx) are retried. writeField(), writeFields(), writeRaw() and writeBulk() wait for the retries, the
+  asynchronous writes are sent again by the worker thread without blocking it in between.
+  The default policy is set by THINGSPEAK_RETRY_ATTEMPTS, THINGSPEAK_RETRY_BASE_DELAY and THINGSPEAK_RETRY_MAX_DELAY.
+
+  */
+  void setRetryPolicy(unsigned int maxAttempts, uint32_t baseDelay, uint32_t maxDelay) {
+    setRetryPolicy(maxAttempts, baseDelay, maxDelay, nullptr);
+  };
+
+
+  /*
+  Function: setRetryPolicy
+
+  Summary:
+  Set how often and when a failed write is sent again, and which status codes are retried.
+
+  Parameters:
+  maxAttempts - Attempts of a write until the error is returned, 1 disables the retries.
+  baseDelay - Max delay before the first retry in ms, it doubles with each further retry.
+  maxDelay - Max delay between two attempts in ms.
+  retryable - Returns true for a status code worth a retry. May be empty for the default of -301, -304 and 5xx.
+
+  */
+  void setRetryPolicy(unsigned int maxAttempts, uint32_t baseDelay, uint32_t maxDelay, Callback<bool(int)> retryable) {
+    this->retryAttempts = maxAttempts > 0 ? maxAttempts : 1;
+    this->retryBaseDelay = baseDelay;
+    this->retryMaxDelay = maxDelay;
+    this->retryable = retryable;
+  };
+
+
+  /*
+  Function: setTimeout
+
+  Summary:
+  Set the max time of a request, from connecting to the end of the response.
+
+  Parameters:
+  timeout - Max time in ms, 0 lets a request wait for as long as the network stack does.
+
+  Notes:
+  A request running out of time is given up, the call returns -304 (a timed out writeRaw() also drops the staged update, it may have been
+  inserted nevertheless). Each of the retries of setRetryPolicy() gets the full timeout, use the writeFields() and readField() forms
+  taking a timeout to bound a whole call. The socket timeout is set to the time left before each connect, send and receive,
+  the name lookup can't be cut short. Reads sent with readPipelined() share one timeout per connection.
+  The default is TIMEOUT_MS_SERVERRESPONSE.
+
+  */
+  void setTimeout(uint32_t timeout) {
+    this->requestTimeout = timeout;
+  };
+
+
+  /*
+  Function: setPowerManagement
+
+  Summary:
+  Let the library bring the network interface up for its requests only and send the collected updates in wake windows.
+
+  Parameters:
+  flushInterval - Time between two wake windows in ms, 0 ends the power management and connects the interface again
+  onWake - Called from the worker thread within each wake window after the bulk update was sent, e.g. to call writeStored(). May be empty.
+
+  Returns:
+  200 - successful.
+  -301 - flushInterval is 0 and the interface could not be connected again, the application has to connect it
+
+  Notes:
+  The interface passed to begin() is disconnected right away. Updates collected with queueFields() are sent with writeBulk()
+  every flushInterval, all within one connect of the interface. Any other request (writeFields(), reads, ...) connects the interface on demand and
+  disconnects it once no request is left. While the interface is connected, deep sleep is locked with the mbed sleep manager,
+  so the MCU can deep sleep between the wake windows. Requests over setTransport() transports other than the HTTP one are
+  not covered, they expect a connected interface. Requests fail with -301 while a power managed interface can't be connected.
+
+  */
+  int setPowerManagement(uint32_t flushInterval, Callback<void()> onWake = nullptr) {
+    int status = OK_SUCCESS;
+    startAsyncQueue();
+
+    this->powerMutex.lock();
+    if(this->flushEventID != 0) {
+      this->asyncQueue->cancel(this->flushEventID);
+      this->flushEventID = 0;
+    }
+    this->fPowerManaged = flushInterval > 0;
+    this->flushInterval = flushInterval;
+    this->onWake = onWake;
+    if(this->fPowerManaged) {
+      if(this->networkUsers == 0 && this->fNetworkUp) {
+        sleepNetwork();
+      }
+      this->flushEventID = this->asyncQueue->call_in(flushInterval, this, &ThingSpeak::runFlush);
+    }
+    else {
+      // the application owns the interface again
+      if(!this->fNetworkUp && NULL != this->net) {
+        nsapi_error_t error = this->net->connect();
+        #ifdef PRINT_DEBUG_MESSAGES
+          printf("ts::setPowerManagement   connect (%d)\n", error);
+        #endif
+        if(error == NSAPI_ERROR_OK || error == NSAPI_ERROR_IS_CONNECTED) {
+          this->fNetworkUp = true;
+        }
+        else {
+          status = ERR_CONNECT_FAILED;
+        }
+      }
+      unlockDeepSleep();
+    }
+    this->powerMutex.unlock();
+    return status;
+  };
+
+
+  /*
+  Function: flush
+
+  Summary:
+  Connect the network interface, send the updates collected with queueFields() and disconnect it again.
+
+  Returns:
+  200 - successful or there was nothing to send.
+  -301 - The network interface or ThingSpeak could not be connected
+  Other values - see writeBulk()
+
+  Notes:
+  Called every flushInterval with setPowerManagement(), may be called any time in addition, e.g. before a reset.
+
+  */
+  int flush() {
+    THINGSPEAK_HEAP_PROBE("flush");
+    int status = OK_SUCCESS;
+    if(acquireNetwork() != NSAPI_ERROR_OK) {
+      status = ERR_CONNECT_FAILED;
+    }
+    else if(this->bulkCount > 0) {
+      status = writeBulk();
+    }
+    releaseNetwork();
+    return status;
+  };
+
+
+  /*
+  Function: setRootCA
+
+  Summary:
+  Set the root CA certificate the ThingSpeak server certificate is verified with when THINGSPEAK_HTTPS is enabled.
+
+  Parameters:
+  rootCA - Root CA certificate(s) in PEM format. The string is not copied and has to stay valid.
+
+  Notes:
+  Define THINGSPEAK_HTTPS as 1 before including ThingSpeak.h to connect with HTTPS on port 443. The TLS connection is kept
+  open between requests like the plain one, so only the first request after a reconnect pays for the handshake.
+  Without a root CA no HTTPS connection is opened.
+
+  */
+  void setRootCA(const char * rootCA) {
+    for(size_t i = 0; i < THINGSPEAK_POOL_SIZE; i++) {
+      this->pool[i].mutex.lock();
+      this->pool[i].connection.setRootCA(rootCA);
+      this->pool[i].mutex.unlock();
+    }
+  };
+
+
+  #if THINGSPEAK_STATS
+  /*
+  Function: getStats
+
+  Summary:
+  Get the statistics of the HTTP requests sent to ThingSpeak.
+
+  Returns:
+  A copy of the counters, byte counts, summed times and the request time histogram since the start or the last resetStats().
+
+  Notes:
+  Available if THINGSPEAK_STATS is 1 (default). The copy is taken with the statistics locked, so it is a consistent
+  snapshot also while requests are running. With THINGSPEAK_HEAP_STATS the copy includes heap[], which takes
+  THINGSPEAK_HEAP_STATS_APIS * sizeof(ThingSpeakHeapStats) bytes on the stack of the calling thread.
+  With THINGSPEAK_HEAP_STATS defined as 1 heap[] also holds the heap and stack use of each public call, e.g. to size the
+  heap and the thread stacks. It is measured with mbed_stats_heap_get() (platform.heap-stats-enabled), the stack
+  high-water mark needs platform.stack-stats-enabled. The heap counters see the allocations of all threads, profile with the
+  other threads idle. A call made by another public call, e.g. writeFields() by writeField(), is counted for both.
+  accumulate() is not profiled, it may be called from interrupt context.
+
+  */
+  ThingSpeakStats getStats() {
+    this->connectionMutex.lock();
+    #if THINGSPEAK_HEAP_STATS
+      // the heap probes record in a critical section
+      core_util_critical_section_enter();
+    #endif
+    ThingSpeakStats snapshot = this->stats;
+    #if THINGSPEAK_HEAP_STATS
+      core_util_critical_section_exit();
+    #endif
+    this->connectionMutex.unlock();
+    return snapshot;
+  };
+
+
+  /*
+  Function: resetStats
+
+  Summary:
+  Clear the statistics returned by getStats().
+
+  */
+  void resetStats() {
+    this->connectionMutex.lock();
+    #if THINGSPEAK_HEAP_STATS
+      // the heap probes record in a critical section
+      core_util_critical_section_enter();
+    #endif
+    memset(&this->stats, 0, sizeof(this->stats));
+    #if THINGSPEAK_HEAP_STATS
+      core_util_critical_section_exit();
+    #endif
+    this->connectionMutex.unlock();
+  };
+
+
+  /*
+  Function: setStatsHook
+
+  Summary:
+  Set the function called after each HTTP request with its times and sizes.
+
+  Parameters:
+  hook - Called with the statistics of the request. May be empty.
+
+  Notes:
+  The hook is called from the thread sending the request after the statistics were updated and unlocked, it may call getStats().
+  It delays the request it is called for, so it should return quickly.
+
+  */
+  void setStatsHook(Callback<void(const ThingSpeakRequestStats &)> hook) {
+    this->connectionMutex.lock();
+    this->statsHook = hook;
+    this->connectionMutex.unlock();
+  };
+  #endif
+
+
+  /*
+  Function: writeField
+
+  Summary:
+  Write an integer value to a single field in a ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel to write to.
+  value - Integer value (from -32,768 to 32,767) to write.
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Returns:
+  HTTP status code of 200 if successful.
+
+  Notes:
+  See getLastReadStatus() for other possible return values.
+  */
+  int writeField(unsigned long channelNumber, unsigned int field, int value, const char * writeAPIKey) {
+    return writeField(channelNumber, field, (long)value, writeAPIKey);
+  };
+
+
+  /*
+  Function: writeField
+
+  Summary:
+  Write a long value to a single field in a ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel to write to.
+  value - Long value (from -2,147,483,648 to 2,147,483,647) to write.
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Returns:
+  HTTP status code of 200 if successful.
+
+  Notes:
+  See getLastReadStatus() for other possible return values.
+  */
+  int writeField(unsigned long channelNumber, unsigned int field, long value, const char * writeAPIKey) {
+    char valueString[THINGSPEAK_NUMBER_LENGTH];
+    ThingSpeakPayload::formatLong(valueString, value);
+    return writeField(channelNumber, field, (const char *)valueString, writeAPIKey);
+  };
+
+  /*
+  Function: writeField
+
+  Summary:
+  Write a floating point value to a single field in a ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel to write to.
+  value - Floating point value to write with up to THINGSPEAK_FLOAT_DECIMALS decimals (default 6), trailing zeros are dropped.  Values from 1e12 on are written in exponent notation.
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Returns:
+  HTTP status code of 200 if successful.
+
+  Notes:
+  See getLastReadStatus() for other possible return values.
+  */
+  int writeField(unsigned long channelNumber, unsigned int field, float value, const char * writeAPIKey) {
+    char valueString[THINGSPEAK_NUMBER_LENGTH];
+    ThingSpeakPayload::formatFloat(valueString, value, THINGSPEAK_FLOAT_DECIMALS, true);
+    return writeField(channelNumber, field, (const char *)valueString, writeAPIKey);
+  };
+
+
+  /*
+  Function: writeField
+
+  Summary:
+  Write a string to a single field in a ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel to write to.
+  value - String to write (UTF8 string).  ThingSpeak limits this field to 255 bytes.
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Returns:
+  HTTP status code of 200 if successful.
+
+  Notes:
+  See getLastReadStatus() for other possible return values.
+  */
+  int writeField(unsigned long channelNumber, unsigned int field, const char * value, const char * writeAPIKey) {
+    THINGSPEAK_HEAP_PROBE("writeField");
+    size_t valueLen = strlen(value);
+
+    // Invalid field number specified
+    if(field < FIELDNUM_MIN || field > FIELDNUM_MAX)
+      return ERR_INVALID_FIELD_NUM;
+    // Max # bytes for ThingSpeak field is 255
+    if(valueLen > FIELDLENGTH_MAX)
+      return ERR_OUT_OF_RANGE;
+
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::writeField (channelNumber: %lu writeAPIKey: %s field: %d value: \"%s\")\n", channelNumber, writeAPIKey, field, value);
+    #endif
+    this->writeMutex.lock();
+    ThingSpeakPayload postMessage(this->payload, this->payloadCapacity);
+    postMessage.append("field");
+    postMessage.appendLong(field);
+    postMessage.append('=');
+    postMessage.append(value, valueLen);
+    int status = writeRawPayload(channelNumber, postMessage, writeAPIKey);
+    this->writeMutex.unlock();
+    return status;
+  };
+
+  /*
+  Function: writeField
+
+  Summary:
+  Write a string to a single field in a ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel to write to.
+  value - String to write (UTF8 string).  ThingSpeak limits this field to 255 bytes.
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Returns:
+  HTTP status code of 200 if successful.
+
+  Notes:
+  See getLastReadStatus() for other possible return values.
+  */
+  int writeField(unsigned long channelNumber, unsigned int field, string value, const char * writeAPIKey) {
+    return writeField(channelNumber, field, value.c_str(), writeAPIKey);
+   };
+
+
+  /*
+  Function: setField
+
+  Summary:
+  Set the value of a single field that will be part of a multi-field update.
+
+  Parameters:
+  field - Field number (1-8) within the channel to set.
+  value - Integer value (from -32,768 to 32,767) to set.
+
+  Returns:
+  Code of 200 if successful.
+  Code of -101 if value is out of range or string is too long (> 255 bytes)
+
+  */
+  int setField(unsigned int field, int value) {
+    return setField(field, (long)value);
+  };
+
+  /*
+  Function: setField
+
+  Summary:
+  Set the value of a single field that will be part of a multi-field update.
+
+  Parameters:
+  field - Field number (1-8) within the channel to set.
+  value - Long value (from -2,147,483,648 to 2,147,483,647) to write.
+
+  Returns:
+  Code of 200 if successful.
+  Code of -101 if value is out of range or string is too long (> 255 bytes)
+
+  */
+  int setField(unsigned int field, long value) {
+    char valueString[THINGSPEAK_NUMBER_LENGTH];
+    ThingSpeakPayload::formatLong(valueString, value);
+    return setField(field, (const char *)valueString);
+  };
+
+  /*
+  Function: setField
+
+  Summary:
+  Set the value of a single field that will be part of a multi-field update.
+
+  Parameters:
+  field - Field number (1-8) within the channel to set.
+  value - Floating point value to write with up to THINGSPEAK_FLOAT_DECIMALS decimals (default 6), trailing zeros are dropped.  Values from 1e12 on are written in exponent notation.
+
+  Returns:
+  Code of 200 if successful.
+  Code of -101 if value is out of range or string is too long (> 255 bytes)
+
+  */
+  int setField(unsigned int field, float value) {
+    return setField(field, value, THINGSPEAK_FLOAT_DECIMALS);
+  };
+
+
+  /*
+  Function: setField
+
+  Summary:
+  Set the value of a single field that will be part of a multi-field update.
+
+  Parameters:
+  field - Field number (1-8) within the channel to set.
+  value - Floating point value to write.
+  decimals - Max number of decimals (0-9), trailing zeros are dropped. Fewer decimals make smaller updates. With more than 6 decimals, values from 10^(18 - decimals) on are written in exponent notation.
+
+  Returns:
+  Code of 200 if successful.
+  Code of -101 if value is out of range or string is too long (> 255 bytes)
+
+  */
+  int setField(unsigned int field, float value, int decimals) {
+    THINGSPEAK_HEAP_PROBE("setField");
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::setField   (field: %d decimals: %d)\n", field, decimals);
+    #endif
+    return this->nextWrite.setField(field, value, decimals);
+  };
+
+
+  /*
+  Function: setField
+
+  Summary:
+  Set the value of a single field that will be part of a multi-field update.
+
+  Parameters:
+  field - Field number (1-8) within the channel to set.
+  value - String to write (UTF8).  ThingSpeak limits this to 255 bytes.
+
+  Returns:
+  Code of 200 if successful.
+  Code 0f -101 if value is out of range or string is too long (> 255 bytes)
+
+  */
+  int setField(unsigned int field, const char * value) {
+    THINGSPEAK_HEAP_PROBE("setField");
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::setField   (field: %d value: \"%s\")\n", field, value);
+    #endif
+    return this->nextWrite.setField(field, value);
+  };
+
+
+  /*
+  Function: setField
+
+  Summary:
+  Set the value of a single field that will be part of a multi-field update.
+
+  Parameters:
+  field - Field number (1-8) within the channel to set.
+  value - string to write (UTF8).  ThingSpeak limits this to 255 bytes.
+
+  Returns:
+  Code of 200 if successful.
+  Code of -101 if value is out of range or string is too long (> 255 bytes)
+
+  */
+  int setField(unsigned int field, string value) {
+    return setField(field, value.c_str());
+  };
+
+
+  /*
+  Function: setLatitude
+
+  Summary:
+  Set the latitude of a multi-field update.
+
+  Parameters:
+  latitude - Latitude of the measurement as a floating point value (degrees N, use negative values for degrees S)
+
+  Returns:
+  Always return 200
+
+  Notes:
+  To record latitude, longitude and elevation of a write, call setField() for each of the fields you want to write. Then setLatitude(), setLongitude(), setElevation() and then call writeFields()
+
+  */
+  int setLatitude(float latitude) {
+    THINGSPEAK_HEAP_PROBE("setLatitude");
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::setLatitude(latitude: %f\")\n", latitude);
+    #endif
+    return this->nextWrite.setLatitude(latitude);
+  };
+
+
+  /*
+  Function: setLongitude
+
+  Summary:
+  Set the longitude of a multi-field update.
+
+  Parameters:
+  longitude - Longitude of the measurement as a floating point value (degrees E, use negative values for degrees W)
+
+  Returns:
+  Always return 200
+
+  Notes:
+  To record latitude, longitude and elevation of a write, call setField() for each of the fields you want to write. Then setLatitude(), setLongitude(), setElevation() and then call writeFields()
+
+  */
+  int setLongitude(float longitude) {
+    THINGSPEAK_HEAP_PROBE("setLongitude");
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::setLongitude(longitude: %f\")\n", longitude);
+    #endif
+    return this->nextWrite.setLongitude(longitude);
+  };
+
+
+  /*
+  Function: setElevation
+
+  Summary:
+  Set the elevation of a multi-field update.
+
+  Parameters:
+  elevation - Elevation of the measurement as a floating point value (meters above sea level)
+
+  Returns:
+  Always return 200
+
+  Notes:
+  To record latitude, longitude and elevation of a write, call setField() for each of the fields you want to write. Then setLatitude(), setLongitude(), setElevation() and then call writeFields()
+
+  */
+  int setElevation(float elevation) {
+    THINGSPEAK_HEAP_PROBE("setElevation");
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::setElevation(elevation: %f\")\n", elevation);
+    #endif
+    return this->nextWrite.setElevation(elevation);
+  };
+
+
+  /*
+  Function: setStatus
+
+  Summary:
+  Set the status field of a multi-field update.
+
+  Parameters:
+  status - String to write (UTF8).  ThingSpeak limits this to 255 bytes.
+
+  Returns:
+  Code of 200 if successful.
+  Code of -101 if string is too long (> 255 bytes)
+
+  Notes:
+  To record a status message on a write, call setStatus() then call writeFields().
+  Use status to provide additonal details when writing a channel update.
+  Additonally, status can be used by the ThingTweet App to send a message to Twitter.
+
+  */
+  int setStatus(const char * status) {
+    THINGSPEAK_HEAP_PROBE("setStatus");
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::setStatus(status: %s\")\n", status);
+    #endif
+    return this->nextWrite.setStatus(status);
+  };
+
+
+  /*
+  Function: setStatus
+
+  Summary:
+  Set the status field of a multi-field update.
+
+  Parameters:
+  status - String to write (UTF8).  ThingSpeak limits this to 255 bytes.
+
+  Returns:
+  Code of 200 if successful.
+  Code of -101 if string is too long (> 255 bytes)
+
+  Notes:
+  To record a status message on a write, call setStatus() then call writeFields().
+  Use status to provide additonal details when writing a channel update.
+  Additonally, status can be used by the ThingTweet App to send a message to Twitter.
+
+  */
+  int setStatus(string status) {
+    return setStatus(status.c_str());
+  };
+
+
+  /*
+  Function: setTwitterTweet
+
+  Summary:
+  Set the Twitter account and message to use for an update to be tweeted.
+
+  Parameters:
+  twitter - Twitter account name as a String.
+  tweet - Twitter message as a String (UTF-8) limited to 140 character.
+
+  Returns:
+  Code of 200 if successful.
+  Code of -101 if string is too long (> 255 bytes)
+
+  Notes:
+  To send a message to twitter call setTwitterTweet() then call writeFields().
+  Prior to using this feature, a twitter account must be linked to your ThingSpeak account. Do this by logging into ThingSpeak and going to Apps, then ThingTweet and clicking Link Twitter Account.
+  */
+  int setTwitterTweet(const char * twitter, const char * tweet) {
+    THINGSPEAK_HEAP_PROBE("setTwitterTweet");
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::setTwitterTweet(twitter: %s, tweet: %s\")\n", twitter, tweet);
+    #endif
+    return this->nextWrite.setTwitterTweet(twitter, tweet);
+  };
+
+  /*
+  Function: setTwitterTweet
+
+  Summary:
+  Set the Twitter account and message to use for an update to be tweeted.
+
+  Parameters:
+  twitter - Twitter account name as a String.
+  tweet - Twitter message as a String (UTF-8) limited to 140 character.
+
+  Returns:
+  Code of 200 if successful.
+  Code of -101 if string is too long (> 255 bytes)
+
+  Notes:
+  To send a message to twitter call setTwitterTweet() then call writeFields().
+  Prior to using this feature, a twitter account must be linked to your ThingSpeak account. Do this by logging into ThingSpeak and going to Apps, then ThingTweet and clicking Link Twitter Account.
+  */
+  int setTwitterTweet(string twitter, const char * tweet) {
+    return setTwitterTweet(twitter.c_str(), tweet);
+  };
+
+  /*
+  Function: setTwitterTweet
+
+  Summary:
+  Set the Twitter account and message to use for an update to be tweeted.
+
+  Parameters:
+  twitter - Twitter account name as a String.
+  tweet - Twitter message as a String (UTF-8) limited to 140 character.
+
+  Returns:
+  Code of 200 if successful.
+  Code of -101 if string is too long (> 255 bytes)
+
+  Notes:
+  To send a message to twitter call setTwitterTweet() then call writeFields().
+  Prior to using this feature, a twitter account must be linked to your ThingSpeak account. Do this by logging into ThingSpeak and going to Apps, then ThingTweet and clicking Link Twitter Account.
+  */
+  int setTwitterTweet(const char * twitter, string tweet) {
+    return setTwitterTweet(twitter, tweet.c_str());
+  };
+
+  /*
+  Function: setTwitterTweet
+
+  Summary:
+  Set the Twitter account and message to use for an update to be tweeted.
+
+  Parameters:
+  twitter - Twitter account name as a String.
+  tweet - Twitter message as a String (UTF-8) limited to 140 character.
+
+  Returns:
+  Code of 200 if successful.
+  Code of -101 if string is too long (> 255 bytes)
+
+  Notes:
+  To send a message to twitter call setTwitterTweet() then call writeFields().
+  Prior to using this feature, a twitter account must be linked to your ThingSpeak account. Do this by logging into ThingSpeak and going to Apps, then ThingTweet and clicking Link Twitter Account.
+  */
+  int setTwitterTweet(string twitter, string tweet) {
+    return setTwitterTweet(twitter.c_str(), tweet.c_str());
+  };
+
+
+  /*
+  Function: setCreatedAt
+
+  Summary:
+  Set the created-at date of a multi-field update.
+
+  Parameters:
+  createdAt - Desired timestamp to be included with the channel update as a String.  The timestamp string must be in the ISO 8601 format. Example "2017-01-12 13:22:54"
+
+  Returns:
+  Code of 200 if successful.
+  Code of -101 if string is too long (> 255 bytes)
+
+  Notes:
+  Timezones can be set using the timezone hour offset parameter. For example, a timestamp for Eastern Standard Time is: "2017-01-12 13:22:54-05".
+  If no timezone hour offset parameter is used, UTC time is assumed.
+
+  */
+  int setCreatedAt(const char * createdAt) {
+    THINGSPEAK_HEAP_PROBE("setCreatedAt");
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::setCreatedAt(createdAt: %s\")\n", createdAt);
+    #endif
+    return this->nextWrite.setCreatedAt(createdAt);
+  }
+
+
+  /*
+  Function: setCreatedAt
+
+  Summary:
+  Set the created-at date of a multi-field update.
+
+  Parameters:
+  createdAt - Desired timestamp to be included with the channel update as a String.  The timestamp string must be in the ISO 8601 format. Example "2017-01-12 13:22:54"
+
+  Returns:
+  Code of 200 if successful.
+  Code of -101 if string is too long (> 255 bytes)
+
+  Notes:
+  Timezones can be set using the timezone hour offset parameter. For example, a timestamp for Eastern Standard Time is: "2017-01-12 13:22:54-05".
+  If no timezone hour offset parameter is used, UTC time is assumed.
+
+  */
+  int setCreatedAt(string createdAt) {
+    return setCreatedAt(createdAt.c_str());
+  }
+
+
+  /*
+  Function: accumulate
+
+  Summary:
+  Add a sample to the running aggregate of a field.
+
+  Parameters:
+  field - Field number (1-8) within the channel.
+  value - Sample, NaN is ignored.
+
+  Returns:
+  200 - successful.
+  -201 - Invalid field number specified
+
+  Notes:
+  Safe to call from interrupt context, the sample is added in constant time without allocations or formatting.
+  writeFields(), writeFieldsAsync(), scheduleFields(), queueFields() and storeFields() close the window: the aggregate
+  selected with setAccumulation() (AGGREGATE_MEAN by default) is set as value of every field which received samples,
+  replacing a value set with setField(), and a new window starts.
+
+  */
+  int accumulate(unsigned int field, float value) {
+    if(field < FIELDNUM_MIN || field > FIELDNUM_MAX) {
+      return ERR_INVALID_FIELD_NUM;
+    }
+    this->accumulators[field - 1].add(value);
+    return OK_SUCCESS;
+  };
+
+
+  /*
+  Function: setAccumulation
+
+  Summary:
+  Set which aggregate of the samples passed to accumulate() is written for a field.
+
+  Parameters:
+  field - Field number (1-8) within the channel.
+  aggregation - AGGREGATE_MEAN (default), AGGREGATE_LAST, AGGREGATE_MIN, AGGREGATE_MAX, AGGREGATE_COUNT or AGGREGATE_STDDEV
+
+  Returns:
+  200 - successful.
+  -101 - Invalid aggregation
+  -201 - Invalid field number specified
+
+  */
+  int setAccumulation(unsigned int field, int aggregation) {
+    if(field < FIELDNUM_MIN || field > FIELDNUM_MAX) {
+      return ERR_INVALID_FIELD_NUM;
+    }
+    if(aggregation < AGGREGATE_LAST || aggregation > AGGREGATE_STDDEV) {
+      return ERR_OUT_OF_RANGE;
+    }
+    this->accumulators[field - 1].aggregation = aggregation;
+    return OK_SUCCESS;
+  };
+
+
+  /*
+  Function: writeFields
+
+  Summary:
+  Write a multi-field update.
+
+  Parameters:
+  channelNumber - Channel number
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Returns:
+  200 - successful.
+  404 - Incorrect API key (or invalid ThingSpeak server address)
+  -101 - Value is out of range or string is too long (> 255 characters)
+  -201 - Invalid field number specified
+  -210 - setField() was not called before writeFields()
+  -301 - Failed to connect to ThingSpeak
+  -302 - Unexpected failure during write to ThingSpeak
+  -303 - Unable to parse response
+    -304 - Timeout waiting for server to respond
+  -401 - Point was not inserted (most probable cause is the rate limit of once every 15 seconds)
+
+
+  Notes:
+  Call setField(), setLatitude(), setLongitude(), setElevation() and/or setStatus() and then call writeFields()
+
+  */
+  int writeFields(unsigned long channelNumber, const char * writeAPIKey) {
+    closeAccumulators();
+    return writeFields(channelNumber, writeAPIKey, this->nextWrite);
+  }
+
+
+  /*
+  Function: writeFields
+
+  Summary:
+  Write a multi-field update staged in a write context.
+
+  Parameters:
+  channelNumber - Channel number
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+  context - Context the fields were set in. It is reset once the update is serialised.
+
+  Returns:
+  See writeFields() above.
+
+  Notes:
+  The setters of ThingSpeak stage a single update shared by all threads. A thread which needs its own update sets
+  the values on a WriteContext it owns and passes it here. The serialisation into the payload buffer and the request
+  are serialised with the other writers, the setters of the context need no lock.
+
+  */
+  int writeFields(unsigned long channelNumber, const char * writeAPIKey, WriteContext & context) {
+    return writeFields(channelNumber, writeAPIKey, context, 0);
+  }
+
+
+  /*
+  Function: writeFields
+
+  Summary:
+  Write a multi-field update staged in a write context, giving up once timeout ms have passed.
+
+  Parameters:
+  channelNumber - Channel number
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+  context - Context the fields were set in. It is reset once the update is serialised.
+  timeout - Max time in ms until the call returns, the retries of setRetryPolicy() included. 0 bounds only each request by setTimeout().
+
+  Returns:
+  -304 if the update could not be sent and answered in time, see writeFields() above for other values.
+
+  Notes:
+  The deadline covers connecting, sending the update and receiving the response. A retry is not started if its delay would
+  end past the deadline. The time waiting for the payload buffer or a free connection of the pool and the name lookup can't be
+  cut short, they count against the deadline. Updates through a setTransport() transport other than HTTP are bounded by the transport only.
+
+  */
+  int writeFields(unsigned long channelNumber, const char * writeAPIKey, WriteContext & context, uint32_t timeout) {
+    THINGSPEAK_HEAP_PROBE("writeFields");
+    int status;
+    uint64_t deadline = getDeadline(timeout);
+
+    // Get the content length of the payload
+    int contentLen = getWriteFieldsContentLength(context);
+
+    if(contentLen == 0) {
+      // setField was not called before writeFields
+      #ifdef PRINT_DEBUG_MESSAGES
+        printf("ERR_SETFIELD_NOT_CALLED\n");
+      #endif
+      return ERR_SETFIELD_NOT_CALLED;
+    }
+
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::writeFields   (channelNumber: %lu writeAPIKey: %s", channelNumber, writeAPIKey);
+    #endif
+
+    char * payload;
+    size_t payloadCapacity;
+    Mutex * payloadMutex = lockPayload((size_t)contentLen, &payload, &payloadCapacity);
+    ThingSpeakPayload body(payload, payloadCapacity);
+    if(!buildWriteFieldsBody(body, context)) {
+      payloadMutex->unlock();
+      return ERR_OUT_OF_RANGE;
+    }
+
+    long entryID;
+    status = updateWithRetry(channelNumber, writeAPIKey, body.c_str(), body.length(), &entryID, deadline);
+    payloadMutex->unlock();
+    #ifdef PRINT_DEBUG_MESSAGES
+      if(status == ERR_NOT_INSERTED) {
+        // ThingSpeak did not accept the write
+        printf("ERR_NOT_INSERTED\n");
+      }
+      else if(status != OK_SUCCESS) {
+        printf("get_status_code %d\n", status);
+      }
+    #endif
+
+    // Keep the update for writeStored() in case ThingSpeak can't be reached
+    if(isStorable(status)) {
+      this->writeMutex.lock();
+      size_t storeLen;
+      if(prepareStoreEntry(context, &storeLen) == OK_SUCCESS) {
+        #ifdef PRINT_DEBUG_MESSAGES
+          printf("ts::writeFields   stored for later (%u pending)\n", this->store->getPendingCount() + 1);
+        #endif
+        this->store->append(this->store->getEntryBuffer(), storeLen);
+      }
+      this->writeMutex.unlock();
+    }
+
+    context.reset();
+    return status;
+  }
+
+
+  /*
+  Function: writeFieldsAsync
+
+  Summary:
+  Write a multi-field update without blocking the calling thread.
+
+  Parameters:
+  channelNumber - Channel number
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+  done - Called with the status (see writeFields()) and the entry ID of the update once the request completed. May be empty.
+
+  Returns:
+  200 - the update was queued.
+  -210 - setField() was not called before writeFieldsAsync()
+  -305 - The queue of asynchronous requests is full
+
+  Notes:
+  The fields set so far are taken over immediately, so new values may be set while the update is in flight.
+  Requests are executed one after the other by a worker thread started on the first asynchronous call, done is called from that thread.
+  Each attempt is bounded by setTimeout(). Like writeFields(), an update that can't reach ThingSpeak is kept by the store
+  (see beginStore()) before done is called, timestamped with the time it was queued.
+
+  */
+  int writeFieldsAsync(unsigned long channelNumber, const char * writeAPIKey, Callback<void(int, long)> done) {
+    closeAccumulators();
+    return writeFieldsAsync(channelNumber, writeAPIKey, this->nextWrite, done);
+  }
+
+
+  /*
+  Function: writeFieldsAsync
+
+  Summary:
+  Write a multi-field update staged in a write context without blocking the calling thread.
+
+  Parameters:
+  channelNumber - Channel number
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+  context - Context the fields were set in. It is reset once the update is queued.
+  done - Called with the status (see writeFields()) and the entry ID of the update once the request completed. May be empty.
+
+  Returns:
+  See writeFieldsAsync() above.
+
+  Notes:
+  The queue of asynchronous requests takes updates from any number of threads, one worker thread sends them.
+
+  */
+  int writeFieldsAsync(unsigned long channelNumber, const char * writeAPIKey, WriteContext & context, Callback<void(int, long)> done) {
+    THINGSPEAK_HEAP_PROBE("writeFieldsAsync");
+    if(getWriteFieldsContentLength(context) == 0) {
+      return ERR_SETFIELD_NOT_CALLED;
+    }
+
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::writeFieldsAsync   (channelNumber: %lu writeAPIKey: %s)\n", channelNumber, writeAPIKey);
+    #endif
+
+    // Serialise straight into the job, the shared payload buffer is not needed
+    AsyncJob * job = new AsyncJob();
+    job->body.resize(this->payloadCapacity);
+    ThingSpeakPayload body(&job->body[0], this->payloadCapacity);
+    if(!buildWriteFieldsBody(body, context)) {
+      delete job;
+      return ERR_OUT_OF_RANGE;
+    }
+    job->body.resize(body.length());
+    job->channelNumber = channelNumber;
+    job->apiKey = writeAPIKey;
+    job->writeDone = done;
+
+    // The store copy is taken now, its created-at time is the time the update was queued
+    if(NULL != this->store) {
+      this->writeMutex.lock();
+      size_t storeLen;
+      if(prepareStoreEntry(context, &storeLen) == OK_SUCCESS) {
+        job->storeEntry.assign(this->store->getEntryBuffer(), storeLen);
+      }
+      this->writeMutex.unlock();
+    }
+
+    context.reset();
+
+    return postAsyncJob(job);
+  }
+
+
+  /*
+  Function: writeChannels
+
+  Summary:
+  Write updates to several channels in one call, each over its own connection of the pool.
+
+  Parameters:
+  writes - Updates, each one a channel number, its write API key and a write context holding the fields. Receives the status of each update.
+  count - Number of updates
+
+  Returns:
+  HTTP status code of 200 if all updates were successful, otherwise the status of the first update that failed. The status
+  of each update is stored in writes[i].status, see writeFields() for the possible values.
+
+  Notes:
+  With THINGSPEAK_POOL_SIZE above 1 the updates are sent concurrently by the calling thread and up to THINGSPEAK_POOL_SIZE - 1
+  helper threads over their own connections, so the call takes about as long as the slowest update. The helper threads are
+  started by the first call and kept for the following ones, each takes THINGSPEAK_ASYNC_STACK_SIZE of heap. With a single
+  connection the updates are sent one after the other, reusing the connection. ThingSpeak has no bulk endpoint shared by several channels.
+
+  */
+  int writeChannels(ChannelWrite * writes, size_t count) {
+    THINGSPEAK_HEAP_PROBE("writeChannels");
+    ChannelFanOut fanOut(this, writes, count);
+
+    #if THINGSPEAK_POOL_SIZE > 1
+      // the helpers busy with the updates of another call join in once they are done with it
+      startFanOut();
+      uint32_t posted = 0;
+      for(size_t i = 0; i < this->fanOutCount && i + 1 < count; i++) {
+        if(this->fanOutQueues[i]->call(&fanOut, &ChannelFanOut::runHelper, (uint32_t)(1 << i)) != 0) {
+          posted |= (uint32_t)(1 << i);
+        }
+      }
+    #endif
+
+    fanOut.run();
+
+    #if THINGSPEAK_POOL_SIZE > 1
+      if(posted != 0) {
+        fanOut.done.wait_all(posted);
+      }
+    #endif
+
+    for(size_t i = 0; i < count; i++) {
+      if(writes[i].status != OK_SUCCESS) {
+        return writes[i].status;
+      }
+    }
+    return OK_SUCCESS;
+  }
+
+  /*
+  Function: scheduleFields
+
+  Summary:
+  Write a multi-field update as soon as the update interval of the channel allows it, without blocking the calling thread.
+
+  Parameters:
+  channelNumber - Channel number
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Returns:
+  200 - the update was merged into the pending update of the channel.
+  -101 - Too many channels scheduled (THINGSPEAK_SCHEDULE_CHANNELS) or the pending update is full
+  -210 - setField() or setStatus() was not called before scheduleFields()
+  -305 - The queue of asynchronous requests is full, the update is sent with the next call
+
+  Notes:
+  The time of the last successful update of every channel is tracked. An update scheduled within the update interval
+  (setUpdateInterval(), THINGSPEAK_UPDATE_INTERVAL by default) is merged into the pending one, the newer value of a field
+  replaces the older or is aggregated as set with setAggregation(). The pending update is sent by the worker thread of
+  the asynchronous requests when the interval has passed. If ThingSpeak does not accept it, it is merged with newer values
+  and tried again one interval later. Use setScheduleCallback() to learn about the result.
+
+  */
+  int scheduleFields(unsigned long channelNumber, const char * writeAPIKey) {
+    closeAccumulators();
+    return scheduleFields(channelNumber, writeAPIKey, this->nextWrite);
+  };
+
+
+  /*
+  Function: scheduleFields
+
+  Summary:
+  Schedule a multi-field update staged in a write context, see scheduleFields() above.
+
+  Parameters:
+  channelNumber - Channel number
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+  context - Context the fields were set in. It is reset once the update is merged.
+
+  Returns:
+  See scheduleFields() above.
+
+  */
+  int scheduleFields(unsigned long channelNumber, const char * writeAPIKey, WriteContext & context) {
+    THINGSPEAK_HEAP_PROBE("scheduleFields");
+    int status = OK_SUCCESS;
+
+    if(getWriteFieldsContentLength(context) == 0) {
+      return ERR_SETFIELD_NOT_CALLED;
+    }
+
+    this->scheduleMutex.lock();
+
+    Schedule * schedule = getSchedule(channelNumber);
+    if(NULL == schedule) {
+      this->scheduleMutex.unlock();
+      return ERR_OUT_OF_RANGE;
+    }
+    schedule->writeAPIKey = writeAPIKey;
+
+    if(!mergeScheduled(schedule, context)) {
+      status = ERR_OUT_OF_RANGE;
+    }
+    context.reset();
+
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::scheduleFields   (channelNumber: %lu writeAPIKey: %s)\n", channelNumber, writeAPIKey);
+    #endif
+
+    if(status == OK_SUCCESS && schedule->eventID == 0) {
+      status = armSchedule(schedule);
+    }
+
+    this->scheduleMutex.unlock();
+    return status;
+  };
+
+
+  /*
+  Function: setUpdateInterval
+
+  Summary:
+  Set the minimum interval between two updates of a channel written with scheduleFields().
+
+  Parameters:
+  channelNumber - Channel number
+  interval - Minimum interval in milliseconds, THINGSPEAK_UPDATE_INTERVAL by default
+
+  Returns:
+  200 - successful.
+  -101 - Too many channels scheduled (THINGSPEAK_SCHEDULE_CHANNELS)
+
+  */
+  int setUpdateInterval(unsigned long channelNumber, unsigned long interval) {
+    this->scheduleMutex.lock();
+    Schedule * schedule = getSchedule(channelNumber);
+    if(NULL != schedule) {
+      schedule->interval = interval;
+    }
+    this->scheduleMutex.unlock();
+    return NULL == schedule ? ERR_OUT_OF_RANGE : OK_SUCCESS;
+  };
+
+
+  /*
+  Function: setAggregation
+
+  Summary:
+  Set how the values of a field received within the update interval are combined by scheduleFields().
+
+  Parameters:
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel
+  aggregation - AGGREGATE_LAST (default), AGGREGATE_MIN, AGGREGATE_MAX or AGGREGATE_MEAN
+
+  Returns:
+  200 - successful.
+  -101 - Too many channels scheduled (THINGSPEAK_SCHEDULE_CHANNELS) or invalid aggregation
+  -201 - Invalid field number specified
+
+  Notes:
+  Only numeric values are aggregated, a value which is not a number replaces the pending one.
+
+  */
+  int setAggregation(unsigned long channelNumber, unsigned int field, int aggregation) {
+    if(field < FIELDNUM_MIN || field > FIELDNUM_MAX) {
+      return ERR_INVALID_FIELD_NUM;
+    }
+    if(aggregation < AGGREGATE_LAST || aggregation > AGGREGATE_MEAN) {
+      return ERR_OUT_OF_RANGE;
+    }
+
+    this->scheduleMutex.lock();
+    Schedule * schedule = getSchedule(channelNumber);
+    if(NULL != schedule) {
+      schedule->aggregation[field - 1] = (uint8_t)aggregation;
+    }
+    this->scheduleMutex.unlock();
+    return NULL == schedule ? ERR_OUT_OF_RANGE : OK_SUCCESS;
+  };
+
+
+  /*
+  Function: setScheduleCallback
+
+  Summary:
+  Set the function called after each update sent by scheduleFields().
+
+  Parameters:
+  done - Called with the channel number, the status (see writeFields()) and the entry ID of the update. May be empty.
+
+  Notes:
+  done is called from the worker thread of the asynchronous requests.
+
+  */
+  void setScheduleCallback(Callback<void(unsigned long, int, long)> done) {
+    this->scheduleMutex.lock();
+    this->scheduleDone = done;
+    this->scheduleMutex.unlock();
+  };
+
+
+
+  /*
+  Function: writeRaw
+
+  Summary:
+  Write a raw POST to a ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  postMessage - Raw URL to write to ThingSpeak as a string.  See the documentation at https://thingspeak.com/docs/channels#update_feed.
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Returns:
+  200 - successful.
+  404 - Incorrect API key (or invalid ThingSpeak server address)
+  -101 - Value is out of range or string is too long (> 255 characters)
+  -201 - Invalid field number specified
+  -210 - setField() was not called before writeFields()
+  -301 - Failed to connect to ThingSpeak
+  -302 - Unexpected failure during write to ThingSpeak
+  -303 - Unable to parse response
+    -304 - Timeout waiting for server to respond
+  -401 - Point was not inserted (most probable cause is the rate limit of once every 15 seconds)
+
+  Notes:
+  This is low level functionality that will not be required by most users.
+  The post message must fit into the payload buffer (THINGSPEAK_PAYLOAD_SIZE or setPayloadBuffer()), -101 is returned otherwise.
+
+  */
+  int writeRaw(unsigned long channelNumber, const char * postMessage, const char * writeAPIKey) {
+    THINGSPEAK_HEAP_PROBE("writeRaw");
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::writeRaw   (channelNumber: %lu writeAPIKey: %s", channelNumber, writeAPIKey);
+    #endif
+
+    this->writeMutex.lock();
+    ThingSpeakPayload body(this->payload, this->payloadCapacity);
+    body.append(postMessage);
+    int status = writeRawPayload(channelNumber, body, writeAPIKey);
+    this->writeMutex.unlock();
+    return status;
+  };
+
+
+  /*
+  Function: writeRaw
+
+  Summary:
+  Write a raw POST to a ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  postMessage - Raw URL to write to ThingSpeak as a string.  See the documentation at https://thingspeak.com/docs/channels#update_feed.
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Returns:
+  200 - successful.
+  404 - Incorrect API key (or invalid ThingSpeak server address)
+  -101 - Value is out of range or string is too long (> 255 characters)
+  -201 - Invalid field number specified
+  -210 - setField() was not called before writeFields()
+  -301 - Failed to connect to ThingSpeak
+  -302 - Unexpected failure during write to ThingSpeak
+  -303 - Unable to parse response
+    -304 - Timeout waiting for server to respond
+  -401 - Point was not inserted (most probable cause is the rate limit of once every 15 seconds)
+
+  Notes:
+  This is low level functionality that will not be required by most users.
+
+  */
+  int writeRaw(unsigned long channelNumber, string postMessage, const char * writeAPIKey) {
+    return writeRaw(channelNumber, postMessage.c_str(), writeAPIKey);
+  };
+
+
+  /*
+  Function: queueFields
+
+  Summary:
+  Add a multi-field update to the entries collected for a bulk update.
+
+  Parameters:
+  channelNumber - Channel number
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Returns:
+  200 - successful.
+  -101 - Entry is too large for the bulk buffer (THINGSPEAK_BULK_BUFFER_SIZE)
+  -210 - setField() or setStatus() was not called before queueFields()
+  Other values - see writeBulk(), if the collected entries had to be sent.
+
+  Notes:
+  Call setField() and/or setStatus() and optionally setCreatedAt(), then call queueFields(). If no created-at timestamp is set,
+  the entry is timestamped with the number of seconds elapsed since the previously queued entry.
+  The collected entries are sent with a single request as soon as THINGSPEAK_BULK_MAX_ENTRIES entries are queued,
+  THINGSPEAK_BULK_BUFFER_SIZE is exhausted or entries for another channel are queued. Call writeBulk() to send them earlier.
+  ThingTweet settings are not part of a bulk update.
+
+  */
+  int queueFields(unsigned long channelNumber, const char * writeAPIKey) {
+    return queueEntry(channelNumber, writeAPIKey, 0, true);
+  };
+
+
+  /*
+  Function: queueFields
+
+  Summary:
+  Add a multi-field update to the entries collected for a bulk update.
+
+  Parameters:
+  channelNumber - Channel number
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+  deltaT - Seconds between the previous entry and this one. Ignored if setCreatedAt() was called.
+
+  Returns:
+  200 - successful.
+  -101 - Entry is too large for the bulk buffer (THINGSPEAK_BULK_BUFFER_SIZE)
+  -210 - setField() or setStatus() was not called before queueFields()
+  Other values - see writeBulk(), if the collected entries had to be sent.
+
+  Notes:
+  If sending the collected entries fails because the buffer is full, the oldest entries make room for the new one. They are
+  moved to the offline store if one is mounted (see beginStore()), an entry with a relative timestamp gets its created-at time
+  from the RTC. Otherwise they are dropped. getStats() counts the entries in bulkStored and bulkDropped.
+
+  */
+  int queueFields(unsigned long channelNumber, const char * writeAPIKey, unsigned long deltaT) {
+    return queueEntry(channelNumber, writeAPIKey, deltaT, false);
+  };
+
+
+  /*
+  Function: writeBulk
+
+  Summary:
+  Send all entries collected with queueFields() as one bulk update.
+
+  Returns:
+  200 - successful.
+  404 - Incorrect API key (or invalid ThingSpeak server address)
+  -210 - queueFields() was not called before writeBulk()
+  -301 - Failed to connect to ThingSpeak
+
+  Notes:
+  The entries are only removed from the queue if ThingSpeak accepted the bulk update, retry writeBulk() otherwise.
+  See https://www.mathworks.com/help/thingspeak/bulkwritejsondata.html and setBulkFormat().
+
+  */
+  int writeBulk() {
+    THINGSPEAK_HEAP_PROBE("writeBulk");
+    int status;
+
+    // Mutex is recursive, queueFields() and writeStored() call writeBulk() with it locked
+    this->writeMutex.lock();
+    if(this->bulkCount == 0) {
+      this->writeMutex.unlock();
+      return ERR_SETFIELD_NOT_CALLED;
+    }
+
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::writeBulk   (channelNumber: %lu writeAPIKey: %s entries: %u)\n", this->bulkChannelNumber, this->bulkWriteAPIKey.c_str(), this->bulkCount);
+    #endif
+
+    string path;
+    string body;
+    const char * contentType = buildBulkBody(path, body);
+
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("               POST \"%s\"\n", body.c_str());
+    #endif
+
+    for(unsigned int attempt = 1; ; attempt++) {
+      ThingSpeakRequest* request;
+      HttpResponse* response = sendRequest(&request, &status, 0, HTTP_POST, path, NULL, contentType, body.c_str(), body.length());
+      if(NULL != response) {
+        status = response->get_status_code();
+        endRequest(request);
+      }
+
+      // ThingSpeak answers a bulk update with 202 Accepted
+      if(status == 202) {
+        status = OK_SUCCESS;
+      }
+      if(attempt >= this->retryAttempts || !isRetryable(status) || !waitForRetry(attempt, 0)) {
+        break;
+      }
+    }
+
+    if(status == OK_SUCCESS) {
+      this->bulkLength = 0;
+      this->bulkCount = 0;
+    }
+
+    this->writeMutex.unlock();
+    return status;
+  };
+
+
+  /*
+  Function: getBulkCount
+
+  Summary:
+  Get the number of entries collected with queueFields() and not yet sent.
+
+  Returns:
+  Number of queued entries.
+
+  */
+  unsigned int getBulkCount() {
+    return this->bulkCount;
+  };
+
+
+  /*
+  Function: setBulkFormat
+
+  Summary:
+  Select the format bulk updates are sent in.
+
+  Parameters:
+  format - BULK_FORMAT_JSON (default) or BULK_FORMAT_CSV
+
+  Notes:
+  The CSV format (https://www.mathworks.com/help/thingspeak/bulkwritecsvdata.html) names no items, so a bulk update takes
+  about half the bytes of the JSON one. It applies one time format to all entries, bulk updates mixing entries with and
+  without setCreatedAt() are sent as JSON.
+
+  */
+  void setBulkFormat(int format) {
+    this->bulkFormat = format;
+  };
+
+  #if THINGSPEAK_READ_CACHE > 0
+
+  /*
+  Function: setReadCacheTTL
+
+  Summary:
+  Set how long responses of reads are returned from the cache without any request.
+
+  Parameters:
+  ttl - Time in ms, 0 (THINGSPEAK_READ_CACHE_TTL by default) sends each read, as conditional request if possible
+
+  Notes:
+  Applies to all reads, e.g. readStatus() followed by readCreatedAt() within ttl costs a single request. With a ttl, reads may
+  miss updates of the channel made within it, also those written by this device. The cache keeps THINGSPEAK_READ_CACHE
+  responses within THINGSPEAK_READ_CACHE_BYTES, responses larger than that are not cached.
+
+  */
+  void setReadCacheTTL(uint32_t ttl) {
+    this->readCacheTTL = ttl;
+  };
+
+
+  /*
+  Function: clearReadCache
+
+  Summary:
+  Drop all cached responses of reads, so the next reads are sent without validators.
+
+  */
+  void clearReadCache() {
+    this->readCacheMutex.lock();
+    this->readCache.clear();
+    this->readCacheMutex.unlock();
+  };
+  #endif
+
+
+  /*
+  Function: beginStore
+
+  Summary:
+  Keep multi-field updates on a block device while ThingSpeak can't be reached.
+
+  Parameters:
+  blockDevice - Block device reserved for the store, e.g. a FlashIAPBlockDevice or a SlicingBlockDevice. It needs at least two erase units.
+
+  Returns:
+  true if the store could be mounted, false otherwise.
+
+  Notes:
+  Once the store is mounted, writeFields() stores the update if the connection failed, the request timed out or the server
+  reported an error. storeFields() stores an update without trying to send it. Stored updates survive a reset and are
+  forwarded by writeStored(). The store holds the updates of one channel. The block device is erased one unit at a time
+  in ring order, when it is full the oldest unit is dropped. An update is stored only with a timestamp, set by
+  setCreatedAt() or taken from the RTC when it is stored, so without an RTC the failed updates of writeFields() are lost.
+
+  */
+  bool beginStore(BlockDevice * blockDevice) {
+    THINGSPEAK_HEAP_PROBE("beginStore");
+    if(NULL == this->store) {
+      this->store = new ThingSpeakStore();
+    }
+    if(!this->store->mount(blockDevice)) {
+      delete this->store;
+      this->store = NULL;
+      return false;
+    }
+    return true;
+  };
+
+
+  /*
+  Function: storeFields
+
+  Summary:
+  Store a multi-field update in the offline store instead of sending it.
+
+  Returns:
+  200 - successful.
+  -101 - Entry is too large for the store (THINGSPEAK_STORE_BUFFER_SIZE)
+  -210 - setField() or setStatus() was not called before storeFields()
+  -501 - The store is not mounted or the block device failed
+  -502 - Neither setCreatedAt() was called nor the RTC is set, the update stays staged
+
+  Notes:
+  The update is timestamped with the created-at value set with setCreatedAt(), or else with the RTC if it was set.
+  Without either it is not stored, as the times of updates kept across a reset can't be told later.
+  ThingTweet settings are not stored.
+
+  */
+  int storeFields() {
+    THINGSPEAK_HEAP_PROBE("storeFields");
+    if(NULL == this->store) {
+      return ERR_STORE_FAILED;
+    }
+    closeAccumulators();
+    if(getBulkEntryLength(this->nextWrite) == 0) {
+      return ERR_SETFIELD_NOT_CALLED;
+    }
+
+    this->writeMutex.lock();
+    size_t entryLen;
+    int status = prepareStoreEntry(this->nextWrite, &entryLen);
+    if(status != OK_SUCCESS) {
+      this->writeMutex.unlock();
+      return status;
+    }
+    resetWriteFields();
+
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::storeFields   (pending: %u)\n", this->store->getPendingCount());
+    #endif
+
+    bool fStored = this->store->append(this->store->getEntryBuffer(), entryLen);
+    this->writeMutex.unlock();
+    return fStored ? OK_SUCCESS : ERR_STORE_FAILED;
+  };
+
+
+  /*
+  Function: writeStored
+
+  Summary:
+  Forward the updates kept in the offline store with bulk updates.
+
+  Parameters:
+  channelNumber - Channel number
+  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Returns:
+  200 - successful, the store is empty.
+  -501 - The store is not mounted or the block device failed
+  Other values - see writeBulk(), the updates which were not accepted stay in the store.
+
+  Notes:
+  Entries collected with queueFields() for the same channel are sent along, those for another channel are sent first.
+  Forwarded updates are marked in the store after every bulk update, so a reset in between sends no update twice.
+
+  */
+  int writeStored(unsigned long channelNumber, const char * writeAPIKey) {
+    THINGSPEAK_HEAP_PROBE("writeStored");
+    if(NULL == this->store) {
+      return ERR_STORE_FAILED;
+    }
+
+    this->writeMutex.lock();
+    int status = forwardStored(channelNumber, writeAPIKey);
+    this->writeMutex.unlock();
+    return status;
+  };
+
+
+  /*
+  Function: getStoredCount
+
+  Summary:
+  Get the number of updates kept in the offline store and not yet forwarded.
+
+  Returns:
+  Number of stored updates, 0 if the store is not mounted.
+
+  */
+  unsigned int getStoredCount() {
+    return NULL == this->store ? 0 : this->store->getPendingCount();
+  };
+
+
+  /*
+  Function: readStringField
+
+  Summary:
+  Read the latest string from a private ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel to read from.
+  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Returns:
+  Value read (UTF8 string), or empty string if there is an error.  Use getLastReadStatus() to get more specific information.
+
+  */
+  string readStringField(unsigned long channelNumber, unsigned int field, const char * readAPIKey) {
+    THINGSPEAK_HEAP_PROBE("readStringField");
+    if(field < FIELDNUM_MIN || field > FIELDNUM_MAX) {
+      this->lastReadStatus = ERR_INVALID_FIELD_NUM;
+      return("");
+    }
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::readStringField(channelNumber: %lu", channelNumber);
+      if(NULL != readAPIKey) {
+        printf(" readAPIKey: %s", readAPIKey);
+      }
+      printf(" field: %d)\n", field);
+    #endif
+    return readRaw(channelNumber, string("/fields/") + std::to_string(field) + string("/last"), readAPIKey);
+  }
+
+
+
+  /*
+  Function: readStringField
+
+  Summary:
+  Read the latest string from a private ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel to read from.
+
+  Returns:
+  Value read (UTF8 string), or empty string if there is an error.  Use getLastReadStatus() to get more specific information.
+
+  */
+  string readStringField(unsigned long channelNumber, unsigned int field) {
+    return readStringField(channelNumber, field, NULL);
+  };
+
+
+  /*
+  Function: readFloatField
+
+  Summary:
+  ead the latest floating point value from a private ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel to read from.
+  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Returns:
+  Value read, or 0 if the field is text or there is an error.  Use getLastReadStatus() to get more specific information.  Note that NAN, INFINITY, and -INFINITY are valid results.
+
+  */
+  float readFloatField(unsigned long channelNumber, unsigned int field, const char * readAPIKey) {
+    THINGSPEAK_HEAP_PROBE("readFloatField");
+    char value[THINGSPEAK_NUMBER_LENGTH];
+    readNumberField(channelNumber, field, readAPIKey, value);
+    return strtof(value, NULL);
+  };
+
+
+  /*
+  Function: readFloatField
+
+  Summary:
+  Read the latest floating point value from a private ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel to read from.
+
+  Returns:
+  Value read, or 0 if the field is text or there is an error.  Use getLastReadStatus() to get more specific information.  Note that NAN, INFINITY, and -INFINITY are valid results.
+
+  */
+  float readFloatField(unsigned long channelNumber, unsigned int field) {
+    return readFloatField(channelNumber, field, NULL);
+  };
+
+
+  /*
+  Function: readLongField
+
+  Summary:
+  Read the latest long value from a private ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel to read from.
+  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Returns:
+  Value read, or 0 if the field is text or there is an error.  Use getLastReadStatus() to get more specific information.  Note that NAN, INFINITY, and -INFINITY are valid results.
+
+  */
+  long readLongField(unsigned long channelNumber, unsigned int field, const char * readAPIKey) {
+    THINGSPEAK_HEAP_PROBE("readLongField");
+    char value[THINGSPEAK_NUMBER_LENGTH];
+    readNumberField(channelNumber, field, readAPIKey, value);
+    return strtol(value, NULL, 10);
+  }
+
+
+  /*
+  Function: readLongField
+
+  Summary:
+  Read the latest long value from a private ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel to read from.
+
+  Returns:
+  Value read, or 0 if the field is text or there is an error.  Use getLastReadStatus() to get more specific information.  Note that NAN, INFINITY, and -INFINITY are valid results.
+
+  */
+  long readLongField(unsigned long channelNumber, unsigned int field) {
+    return readLongField(channelNumber, field, NULL);
+  };
+
+
+  /*
+  Function: readIntField
+
+  Summary:
+  Read the latest int value from a private ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel to read from.
+  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Returns:
+  Value read, or 0 if the field is text or there is an error.  Use getLastReadStatus() to get more specific information.  Note that NAN, INFINITY, and -INFINITY are valid results.
+
+  */
+  int readIntField(unsigned long channelNumber, unsigned int field, const char * readAPIKey) {
+    return readLongField(channelNumber, field, readAPIKey);
+  }
+
+
+  /*
+  Function: readIntField
+
+  Summary:
+  Read the latest int value from a private ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel to read from.
+
+  Returns:
+  Value read, or 0 if the field is text or there is an error.  Use getLastReadStatus() to get more specific information.  Note that NAN, INFINITY, and -INFINITY are valid results.
+
+  */
+  int readIntField(unsigned long channelNumber, unsigned int field) {
+    return readLongField(channelNumber, field, NULL);
+  };
+
+
+  /*
+  Function: readStatus
+
+  Summary:
+  Read the latest status from a private ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Results:
+  Value read (UTF8 string). An empty string is returned if there was no status written to the channel or in case of an error.  Use getLastReadStatus() to get more specific information.
+
+  */
+  string readStatus(unsigned long channelNumber, const char * readAPIKey) {
+    THINGSPEAK_HEAP_PROBE("readStatus");
+    string content = readRaw(channelNumber, "/feeds/last.txt?status=true", readAPIKey);
+
+    if(getLastReadStatus() != OK_SUCCESS) {
+      return string("");
+    }
+
+    return getJSONValueByKey(content, "status");
+  };
+
+
+  /*
+  Function: readStatus
+
+  Summary:
+  Read the latest status from a private ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+
+  Results:
+  Value read (UTF8 string). An empty string is returned if there was no status written to the channel or in case of an error.  Use getLastReadStatus() to get more specific information.
+
+  */
+  string readStatus(unsigned long channelNumber) {
+    return readStatus(channelNumber, NULL);
+  };
+
+
+  /*
+  Function: readCreatedAt
+
+  Summary:
+  Read the created-at timestamp associated with the latest update to a private ThingSpeak channel
+
+  Parameters:
+  channelNumber - Channel number
+  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
+
+  Results:
+  Value read (UTF8 string). An empty string is returned if there was no created-at timestamp written to the channel or in case of an error.  Use getLastReadStatus() to get more specific information.
+
+  */
+  string readCreatedAt(unsigned long channelNumber, const char * readAPIKey) {
+    THINGSPEAK_HEAP_PROBE("readCreatedAt");
+    // the same document as readStatus() reads, so both share a cached response
+    string content = readRaw(channelNumber, "/feeds/last.txt?status=true", readAPIKey);
+
+    if(getLastReadStatus() != OK_SUCCESS) {
+      return string("");
+    }
+
+    return getJSONValueByKey(content, "created_at");
   };
 
 
   /*
-  Function: setField
+  Function: readCreatedAt
 
   Summary:
-  Set the value of a single field that will be part of a multi-field update.
+  Read the created-at timestamp associated with the latest update to a private ThingSpeak channel
 
   Parameters:
-  field - Field number (1-8) within the channel to set.
-  value - String to write (UTF8).  ThingSpeak limits this to 255 bytes.
+  channelNumber - Channel number
 
-  Returns:
-  Code of 200 if successful.
-  Code 0f -101 if value is out of range or string is too long (> 255 bytes)
+  Results:
+  Value read (UTF8 string). An empty string is returned if there was no created-at timestamp written to the channel or in case of an error.  Use getLastReadStatus() to get more specific information.
 
   */
-  int setField(unsigned int field, const char * value) {
-    return setField(field, string(value));
+  string readCreatedAt(unsigned long channelNumber) {
+    return readCreatedAt(channelNumber, NULL);
   };
 
 
   /*
-  Function: setField
+  Function: readLastFeed
 
   Summary:
-  Set the value of a single field that will be part of a multi-field update.
+  Read all fields, status, created-at timestamp, entry ID and location of the latest update to a private ThingSpeak channel with one request
 
   Parameters:
-  field - Field number (1-8) within the channel to set.
-  value - string to write (UTF8).  ThingSpeak limits this to 255 bytes.
+  channelNumber - Channel number
+  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
+  entry - Receives the values read. Values which are null in the feed are empty strings.
 
   Returns:
-  Code of 200 if successful.
-  Code of -101 if value is out of range or string is too long (> 255 bytes)
+  HTTP status code of 200 if successful, see getLastReadStatus() for other possible return values.
+  -303 - The response is not a feed entry
 
   */
-  int setField(unsigned int field, string value) {
-    #ifdef PRINT_DEBUG_MESSAGES
-      printf("ts::setField   (field: %d value: \"%s\")\n", field, value.c_str());
-    #endif
-    if(field < FIELDNUM_MIN || field > FIELDNUM_MAX) return ERR_INVALID_FIELD_NUM;
-    // Max # bytes for ThingSpeak field is 255 (UTF-8)
-    if(value.length() > FIELDLENGTH_MAX) return ERR_OUT_OF_RANGE;
-    this->nextWriteField[field - 1] = value;
-    return OK_SUCCESS;
+  int readLastFeed(unsigned long channelNumber, const char * readAPIKey, FeedEntry & entry) {
+    THINGSPEAK_HEAP_PROBE("readLastFeed");
+    entry.reset();
+
+    string content = readRaw(channelNumber, "/feeds/last.json?status=true&location=true", readAPIKey);
+    if(getLastReadStatus() != OK_SUCCESS) {
+      return getLastReadStatus();
+    }
+
+    if(!parseFeedEntry(content.c_str(), content.length(), entry)) {
+      this->lastReadStatus = ERR_BAD_RESPONSE;
+    }
+    return getLastReadStatus();
   };
 
 
   /*
-  Function: setLatitude
+  Function: readLastFeed
 
   Summary:
-  Set the latitude of a multi-field update.
+  Read all fields, status, created-at timestamp, entry ID and location of the latest update to a public ThingSpeak channel with one request
 
   Parameters:
-  latitude - Latitude of the measurement as a floating point value (degrees N, use negative values for degrees S)
+  channelNumber - Channel number
+  entry - Receives the values read. Values which are null in the feed are empty strings.
 
   Returns:
-  Always return 200
-
-  Notes:
-  To record latitude, longitude and elevation of a write, call setField() for each of the fields you want to write. Then setLatitude(), setLongitude(), setElevation() and then call writeFields()
+  HTTP status code of 200 if successful, see getLastReadStatus() for other possible return values.
+  -303 - The response is not a feed entry
 
   */
-  int setLatitude(float latitude) {
-    #ifdef PRINT_DEBUG_MESSAGES
-      printf("ts::setLatitude(latitude: %f\")\n", latitude);
-    #endif
-    this->nextWriteLatitude = latitude;
-    return OK_SUCCESS;
+  int readLastFeed(unsigned long channelNumber, FeedEntry & entry) {
+    return readLastFeed(channelNumber, NULL, entry);
   };
 
 
   /*
-  Function: setLongitude
+  Function: readFeed
 
   Summary:
-  Set the longitude of a multi-field update.
+  Read the entries of a private ThingSpeak channel feed one at a time while the response arrives
 
   Parameters:
-  longitude - Longitude of the measurement as a floating point value (degrees E, use negative values for degrees W)
+  channelNumber - Channel number
+  query - Query parameters of the feed request, e.g. "results=8000" or "start=2021-01-01%2000:00:00&status=true"
+  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
+  onEntry - Called for each entry of the feed, oldest first. The entry is only valid during the call.
 
   Returns:
-  Always return 200
+  HTTP status code of 200 if successful, see getLastReadStatus() for other possible return values.
+  -303 - The response is not a complete feed, entries passed to onEntry before are valid
 
   Notes:
-  To record latitude, longitude and elevation of a write, call setField() for each of the fields you want to write. Then setLatitude(), setLongitude(), setElevation() and then call writeFields()
+  The response body is parsed as it is received and not kept in memory, so the size of the feed is not limited by the RAM.
+  onEntry is called in the context of the calling thread.
 
   */
-  int setLongitude(float longitude) {
+  int readFeed(unsigned long channelNumber, const char * query, const char * readAPIKey, Callback<void(const FeedEntry &)> onEntry) {
+    THINGSPEAK_HEAP_PROBE("readFeed");
+    string path = string("/channels/") + std::to_string(channelNumber) + string("/feeds.json");
+    if(NULL != query && query[0] != '\0') {
+      path += "?";
+      path += query;
+    }
+
     #ifdef PRINT_DEBUG_MESSAGES
-      printf("ts::setLongitude(longitude: %f\")\n", longitude);
+      printf("ts::readFeed   (channelNumber: %lu", channelNumber);
+      if(NULL != readAPIKey) {
+        printf(" readAPIKey: %s", readAPIKey);
+      }
+      printf(")\n               GET \"%s\"\n", path.c_str());
     #endif
-    this->nextWriteLongitude = longitude;
-    return OK_SUCCESS;
+
+    ThingSpeakFeedParser parser(onEntry);
+
+    ThingSpeakRequest* request;
+    int status;
+    HttpResponse* response = sendRequest(&request, &status, 0, HTTP_GET, path, readAPIKey, NULL, NULL, 0, callback(&parser, &ThingSpeakFeedParser::parse));
+    if(NULL == response) {
+      this->lastReadStatus = status;
+      return this->lastReadStatus;
+    }
+
+    this->lastReadStatus = response->get_status_code();
+    endRequest(request);
+
+    if(this->lastReadStatus == OK_SUCCESS && !parser.isComplete()) {
+      this->lastReadStatus = ERR_BAD_RESPONSE;
+    }
+
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("               %lu entries read (%d)\n", parser.getEntryCount(), this->lastReadStatus);
+    #endif
+
+    return this->lastReadStatus;
   };
 
 
   /*
-  Function: setElevation
+  Function: readFeed
 
   Summary:
-  Set the elevation of a multi-field update.
+  Read the entries of a public ThingSpeak channel feed one at a time while the response arrives
 
   Parameters:
-  elevation - Elevation of the measurement as a floating point value (meters above sea level)
+  channelNumber - Channel number
+  query - Query parameters of the feed request, e.g. "results=8000"
+  onEntry - Called for each entry of the feed, oldest first. The entry is only valid during the call.
 
   Returns:
-  Always return 200
-
-  Notes:
-  To record latitude, longitude and elevation of a write, call setField() for each of the fields you want to write. Then setLatitude(), setLongitude(), setElevation() and then call writeFields()
+  HTTP status code of 200 if successful, see getLastReadStatus() for other possible return values.
+  -303 - The response is not a complete feed, entries passed to onEntry before are valid
 
   */
-  int setElevation(float elevation) {
-    #ifdef PRINT_DEBUG_MESSAGES
-      printf("ts::setElevation(elevation: %f\")\n", elevation);
-    #endif
-    this->nextWriteElevation = elevation;
-    return OK_SUCCESS;
+  int readFeed(unsigned long channelNumber, const char * query, Callback<void(const FeedEntry &)> onEntry) {
+    return readFeed(channelNumber, query, NULL, onEntry);
   };
 
 
   /*
-  Function: setStatus
+  Function: readRaw
 
   Summary:
-  Set the status field of a multi-field update.
+  Read a raw response from a public ThingSpeak channel
 
   Parameters:
-  status - String to write (UTF8).  ThingSpeak limits this to 255 bytes.
+  channelNumber - Channel number
+  URLSuffix - Raw URL to write to ThingSpeak as a String.  See the documentation at https://thingspeak.com/docs/channels#get_feed
 
   Returns:
-  Code of 200 if successful.
-  Code of -101 if string is too long (> 255 bytes)
+  Response if successful, or empty string. Use getLastReadStatus() to get more specific information.
 
   Notes:
-  To record a status message on a write, call setStatus() then call writeFields().
-  Use status to provide additonal details when writing a channel update.
-  Additonally, status can be used by the ThingTweet App to send a message to Twitter.
+  This is low level functionality that will not be required by most users.
 
   */
-  int setStatus(const char * status) {
-    return setStatus(string(status));
-  };
+  string readRaw(unsigned long channelNumber, string URLSuffix) {
+    return readRaw(channelNumber, URLSuffix, NULL);
+  }
 
 
   /*
-  Function: setStatus
+  Function: readRaw
 
   Summary:
-  Set the status field of a multi-field update.
+  Read a raw response from a public ThingSpeak channel
 
   Parameters:
-  status - String to write (UTF8).  ThingSpeak limits this to 255 bytes.
+  channelNumber - Channel number
+  URLSuffix - Raw URL to write to ThingSpeak as a String.  See the documentation at https://thingspeak.com/docs/channels#get_feed
+  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
 
   Returns:
-  Code of 200 if successful.
-  Code of -101 if string is too long (> 255 bytes)
+  Response if successful, or empty string. Use getLastReadStatus() to get more specific information.
 
   Notes:
-  To record a status message on a write, call setStatus() then call writeFields().
-  Use status to provide additonal details when writing a channel update.
-  Additonally, status can be used by the ThingTweet App to send a message to Twitter.
+  This is low level functionality that will not be required by most users.
 
   */
-  int setStatus(string status) {
-    #ifdef PRINT_DEBUG_MESSAGES
-      printf("ts::setStatus(status: %s\")\n", status.c_str());
-    #endif
-    // Max # bytes for ThingSpeak field is 255 (UTF-8)
-    if(status.length() > FIELDLENGTH_MAX)
-      return ERR_OUT_OF_RANGE;
-    this->nextWriteStatus = status;
-    return OK_SUCCESS;
+  string readRaw(unsigned long channelNumber, string URLSuffix, const char * readAPIKey) {
+    THINGSPEAK_HEAP_PROBE("readRaw");
+    string content;
+    int status = getRaw(channelNumber, URLSuffix, readAPIKey, content);
+    if(status == ERR_TIMEOUT) {
+      return abortReadRaw(status);
+    }
+    this->lastReadStatus = status;
+    return content;
   };
 
+  #if THINGSPEAK_READ_CACHE > 0
 
   /*
-  Function: setTwitterTweet
+  Function: readRaw
 
   Summary:
-  Set the Twitter account and message to use for an update to be tweeted.
+  Read a raw response from a ThingSpeak channel, or return a response cached not more than maxAge ms ago without a request.
 
   Parameters:
-  twitter - Twitter account name as a String.
-  tweet - Twitter message as a String (UTF-8) limited to 140 character.
+  channelNumber - Channel number
+  URLSuffix - Raw URL to write to ThingSpeak as a String.  See the documentation at https://thingspeak.com/docs/channels#get_feed
+  readAPIKey - Read API key associated with the channel, NULL for a public channel.  *If you share code with others, do _not_ share this key*
+  maxAge - Max age of a cached response in ms, overrides setReadCacheTTL() for this read. 0 always sends a request.
 
   Returns:
-  Code of 200 if successful.
-  Code of -101 if string is too long (> 255 bytes)
+  Response if successful, or empty string. Use getLastReadStatus() to get more specific information.
 
   Notes:
-  To send a message to twitter call setTwitterTweet() then call writeFields().
-  Prior to using this feature, a twitter account must be linked to your ThingSpeak account. Do this by logging into ThingSpeak and going to Apps, then ThingTweet and clicking Link Twitter Account.
+  A fresh response is kept for later reads even if the server sent no validators, see setReadCacheTTL().
+
   */
-  int setTwitterTweet(const char * twitter, const char * tweet) {
-    return setTwitterTweet(string(twitter), string(tweet));
+  string readRaw(unsigned long channelNumber, string URLSuffix, const char * readAPIKey, uint32_t maxAge) {
+    THINGSPEAK_HEAP_PROBE("readRaw");
+    string content;
+    int status = getRaw(channelNumber, URLSuffix, readAPIKey, &content, NULL, maxAge, 0);
+    if(status == ERR_TIMEOUT) {
+      return abortReadRaw(status);
+    }
+    this->lastReadStatus = status;
+    return content;
   };
+  #endif
+
 
   /*
-  Function: setTwitterTweet
+  Function: readField
 
   Summary:
-  Set the Twitter account and message to use for an update to be tweeted.
+  Read the latest value of a field into a result owned by the caller.
 
   Parameters:
-  twitter - Twitter account name as a String.
-  tweet - Twitter message as a String (UTF-8) limited to 140 character.
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel to read from.
+  readAPIKey - Read API key associated with the channel, NULL for a public channel.  *If you share code with others, do _not_ share this key*
+  result - Receives the status and the value read, use result.toFloat(), toLong() or toInt() for numbers.
 
   Returns:
-  Code of 200 if successful.
-  Code of -101 if string is too long (> 255 bytes)
+  The status, as stored in result.status. HTTP status code of 200 if successful, see getLastReadStatus() for other values.
 
   Notes:
-  To send a message to twitter call setTwitterTweet() then call writeFields().
-  Prior to using this feature, a twitter account must be linked to your ThingSpeak account. Do this by logging into ThingSpeak and going to Apps, then ThingTweet and clicking Link Twitter Account.
+  getLastReadStatus() is shared by all threads, use this form if several threads read concurrently.
+
   */
-  int setTwitterTweet(string twitter, const char * tweet) {
-    return setTwitterTweet(twitter, string(tweet));
+  int readField(unsigned long channelNumber, unsigned int field, const char * readAPIKey, ReadResult & result) {
+    return readField(channelNumber, field, readAPIKey, result, 0);
   };
 
+
   /*
-  Function: setTwitterTweet
+  Function: readField
 
   Summary:
-  Set the Twitter account and message to use for an update to be tweeted.
+  Read the latest value of a field into a result owned by the caller, giving up once timeout ms have passed.
 
   Parameters:
-  twitter - Twitter account name as a String.
-  tweet - Twitter message as a String (UTF-8) limited to 140 character.
+  channelNumber - Channel number
+  field - Field number (1-8) within the channel to read from.
+  readAPIKey - Read API key associated with the channel, NULL for a public channel.  *If you share code with others, do _not_ share this key*
+  result - Receives the status and the value read, use result.toFloat(), toLong() or toInt() for numbers.
+  timeout - Max time in ms until the call returns, 0 for the timeout set with setTimeout().
 
   Returns:
-  Code of 200 if successful.
-  Code of -101 if string is too long (> 255 bytes)
+  The status, as stored in result.status. -304 if the response was not received in time, see readField() above for other values.
 
   Notes:
-  To send a message to twitter call setTwitterTweet() then call writeFields().
-  Prior to using this feature, a twitter account must be linked to your ThingSpeak account. Do this by logging into ThingSpeak and going to Apps, then ThingTweet and clicking Link Twitter Account.
+  A value still fresh in the read cache is returned without a request.
+
   */
-  int setTwitterTweet(const char * twitter, string tweet) {
-    return setTwitterTweet(string(twitter), tweet);
+  int readField(unsigned long channelNumber, unsigned int field, const char * readAPIKey, ReadResult & result, uint32_t timeout) {
+    THINGSPEAK_HEAP_PROBE("readField");
+    result.value.clear();
+    if(field < FIELDNUM_MIN || field > FIELDNUM_MAX) {
+      result.status = ERR_INVALID_FIELD_NUM;
+      return result.status;
+    }
+    result.status = getRaw(channelNumber, string("/fields/") + std::to_string(field) + string("/last"), readAPIKey, &result.value, NULL, getReadCacheTTL(), getDeadline(timeout));
+    if(result.status != OK_SUCCESS) {
+      result.value.clear();
+    }
+    return result.status;
   };
 
+
   /*
-  Function: setTwitterTweet
+  Function: readStatus
 
   Summary:
-  Set the Twitter account and message to use for an update to be tweeted.
+  Read the latest status into a result owned by the caller.
 
   Parameters:
-  twitter - Twitter account name as a String.
-  tweet - Twitter message as a String (UTF-8) limited to 140 character.
+  channelNumber - Channel number
+  readAPIKey - Read API key associated with the channel, NULL for a public channel.  *If you share code with others, do _not_ share this key*
+  result - Receives the status of the request and the status text read.
 
   Returns:
-  Code of 200 if successful.
-  Code of -101 if string is too long (> 255 bytes)
+  The status, as stored in result.status. HTTP status code of 200 if successful, see getLastReadStatus() for other values.
 
-  Notes:
-  To send a message to twitter call setTwitterTweet() then call writeFields().
-  Prior to using this feature, a twitter account must be linked to your ThingSpeak account. Do this by logging into ThingSpeak and going to Apps, then ThingTweet and clicking Link Twitter Account.
   */
-  int setTwitterTweet(string twitter, string tweet) {
-    #ifdef PRINT_DEBUG_MESSAGES
-      printf("ts::setTwitterTweet(twitter: %s, tweet: %s\")\n", twitter.c_str(), tweet.c_str());
-    #endif
-    // Max # bytes for ThingSpeak field is 255 (UTF-8)
-    if((twitter.length() > FIELDLENGTH_MAX) || (tweet.length() > FIELDLENGTH_MAX))
-      return ERR_OUT_OF_RANGE;
-
-    this->nextWriteTwitter = twitter;
-    this->nextWriteTweet = tweet;
-
-    return OK_SUCCESS;
+  int readStatus(unsigned long channelNumber, const char * readAPIKey, ReadResult & result) {
+    THINGSPEAK_HEAP_PROBE("readStatus");
+    string content;
+    result.status = getRaw(channelNumber, "/feeds/last.txt?status=true", readAPIKey, content);
+    result.value = result.status == OK_SUCCESS ? getJSONValueByKey(content, "status") : string("");
+    return result.status;
   };
 
 
   /*
-  Function: setCreatedAt
+  Function: readPipelined
 
   Summary:
-  Set the created-at date of a multi-field update.
+  Read several fields or URL suffixes, of one or different channels, sending the requests back-to-back on one connection.
 
   Parameters:
-  createdAt - Desired timestamp to be included with the channel update as a String.  The timestamp string must be in the ISO 8601 format. Example "2017-01-12 13:22:54"
+  reads - Reads, each one a channel number, a field number or URL suffix and the read API key (NULL for a public channel)
+  count - Number of reads
+  results - Receives the status and the response of each read, count entries owned by the caller
 
   Returns:
-  Code of 200 if successful.
-  Code of -101 if string is too long (> 255 bytes)
+  HTTP status code of 200 if all reads were successful, otherwise the status of the first read that failed. The status of
+  each read is stored in results[i].status, -201 for an invalid field number. See getLastReadStatus() for other values.
 
   Notes:
-  Timezones can be set using the timezone hour offset parameter. For example, a timestamp for Eastern Standard Time is: "2017-01-12 13:22:54-05".
-  If no timezone hour offset parameter is used, UTC time is assumed.
+  Up to THINGSPEAK_PIPELINE_DEPTH requests are written onto the connection before the first response is read, so a
+  batch costs about one round trip instead of one per read. Reads the server did not answer, because it closed the
+  connection in between, are sent again one after the other. Responses are cached as in readRaw(), reads cached within
+  the TTL are not sent. getLastReadStatus() is not changed.
 
   */
-  int setCreatedAt(const char * createdAt) {
-    return setCreatedAt(string(createdAt));
-  }
+  int readPipelined(const ChannelRead * reads, size_t count, ReadResult * results) {
+    THINGSPEAK_HEAP_PROBE("readPipelined");
+    uint32_t maxAge = getReadCacheTTL();
+    size_t batch[THINGSPEAK_PIPELINE_DEPTH];
+
+    for(size_t i = 0; i < count; ) {
+      size_t batchCount = 0;
+      for(; i < count && batchCount < THINGSPEAK_PIPELINE_DEPTH; i++) {
+        results[i].value.clear();
+        if(reads[i].URLSuffix.empty()) {
+          results[i].status = ERR_INVALID_FIELD_NUM;
+          continue;
+        }
+        #if THINGSPEAK_READ_CACHE > 0
+          if(readFromCache(reads[i].channelNumber, ThingSpeakReadCache::hash(reads[i].URLSuffix, reads[i].readAPIKey), maxAge, &results[i].value, NULL)) {
+            results[i].status = OK_SUCCESS;
+            continue;
+          }
+        #endif
+        batch[batchCount++] = i;
+      }
+      if(batchCount == 0) {
+        continue;
+      }
+
+      size_t answered = sendPipelined(reads, batch, batchCount, results, maxAge);
+      for(size_t k = answered; k < batchCount; k++) {
+        const ChannelRead & read = reads[batch[k]];
+        ReadResult & result = results[batch[k]];
+        result.status = getRaw(read.channelNumber, read.URLSuffix, read.readAPIKey, &result.value, NULL, maxAge, 0);
+      }
+    }
+
+    for(size_t i = 0; i < count; i++) {
+      if(results[i].status != OK_SUCCESS) {
+        return results[i].status;
+      }
+    }
+    return OK_SUCCESS;
+  };
 
 
   /*
-  Function: setCreatedAt
+  Function: readRawAsync
 
   Summary:
-  Set the created-at date of a multi-field update.
+  Read a raw response from a ThingSpeak channel without blocking the calling thread.
 
   Parameters:
-  createdAt - Desired timestamp to be included with the channel update as a String.  The timestamp string must be in the ISO 8601 format. Example "2017-01-12 13:22:54"
+  channelNumber - Channel number
+  URLSuffix - Raw URL to write to ThingSpeak as a String.  See the documentation at https://thingspeak.com/docs/channels#get_feed
+  readAPIKey - Read API key associated with the channel, NULL for a public channel.  *If you share code with others, do _not_ share this key*
+  done - Called with the status (see getLastReadStatus()) and the response, or empty string in case of an error.
 
   Returns:
-  Code of 200 if successful.
-  Code of -101 if string is too long (> 255 bytes)
+  200 - the request was queued.
+  -305 - The queue of asynchronous requests is full
 
   Notes:
-  Timezones can be set using the timezone hour offset parameter. For example, a timestamp for Eastern Standard Time is: "2017-01-12 13:22:54-05".
-  If no timezone hour offset parameter is used, UTC time is assumed.
+  done is called from the worker thread, see writeFieldsAsync(). getLastReadStatus() is not changed by asynchronous reads.
 
   */
-  int setCreatedAt(string createdAt) {
-    #ifdef PRINT_DEBUG_MESSAGES
-      printf("ts::setCreatedAt(createdAt: %s\")\n", createdAt.c_str());
-    #endif
-
-    // the ISO 8601 format is too complicated to check for valid timestamps here
-    // we'll need to reply on the api to tell us if there is a problem
-    // Max # bytes for ThingSpeak field is 255 (UTF-8)
-    if(createdAt.length() > FIELDLENGTH_MAX)
-      return ERR_OUT_OF_RANGE;
-    this->nextWriteCreatedAt = createdAt;
+  int readRawAsync(unsigned long channelNumber, string URLSuffix, const char * readAPIKey, Callback<void(int, const string &)> done) {
+    THINGSPEAK_HEAP_PROBE("readRawAsync");
+    AsyncJob * job = new AsyncJob();
+    job->channelNumber = channelNumber;
+    job->path = URLSuffix;
+    if(NULL != readAPIKey) {
+      job->apiKey = readAPIKey;
+      job->fApiKey = true;
+    }
+    job->readDone = done;
 
-    return OK_SUCCESS;
-  }
+    return postAsyncJob(job);
+  };
 
 
   /*
-  Function: writeFields
+  Function: getLastReadStatus
 
   Summary:
-  Write a multi-field update.
-
-  Parameters:
-  channelNumber - Channel number
-  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+  Get the status of the previous read.
 
   Returns:
-  200 - successful.
+  Generally, these are HTTP status codes.  Negative values indicate an error generated by the library.
+  Possible response codes...
+  200 - OK / Success
   404 - Incorrect API key (or invalid ThingSpeak server address)
   -101 - Value is out of range or string is too long (> 255 characters)
   -201 - Invalid field number specified
   -210 - setField() was not called before writeFields()
   -301 - Failed to connect to ThingSpeak
-  -302 - Unexpected failure during write to ThingSpeak
+  -302 -  Unexpected failure during write to ThingSpeak
   -303 - Unable to parse response
     -304 - Timeout waiting for server to respond
-  -401 - Point was not inserted (most probable cause is the rate limit of once every 15 seconds)
-
+  -305 - Queue of asynchronous requests is full
+  -401 - Point was not inserted (most probable cause is exceeding the rate limit)
 
   Notes:
-  Call setField(), setLatitude(), setLongitude(), setElevation() and/or setStatus() and then call writeFields()
-
+  The read functions will return zero or empty if there is an error.  Use this function to retrieve the details.
   */
-  int writeFields(unsigned long channelNumber, const char * writeAPIKey) {
-    int status;
+  int getLastReadStatus() {
+    return this->lastReadStatus;
+  };
 
-    // Get the content length of the payload
-    int contentLen = getWriteFieldsContentLength();
+  
+  private:
+  template<typename... Fields> friend class TypedChannel;
 
-    if(contentLen == 0) {
-      // setField was not called before writeFields
-      printf("ERR_SETFIELD_NOT_CALLED\n");
-      return ERR_SETFIELD_NOT_CALLED;
-    }
+  // Serialises the multi-field update into body, returns false if it does not fit
+  bool buildWriteFieldsBody(ThingSpeakPayload & body) {
+    return buildWriteFieldsBody(body, this->nextWrite);
+  }
 
-    #ifdef PRINT_DEBUG_MESSAGES
-      printf("ts::writeFields   (channelNumber: %lu writeAPIKey: %s", channelNumber, writeAPIKey);
-    #endif
+  bool buildWriteFieldsBody(ThingSpeakPayload & body, const ThingSpeakEntry & entry) {
+    bool fFirstItem = true;
 
+    // fields, status, twitter, tweet, created_at and the location, only the set ones are visited
+    for(uint16_t mask = entry.getMask(); mask != 0; mask &= (uint16_t)(mask - 1)) {
+      size_t iItem = ctz(mask);
+      if(!fFirstItem)
+        body.append('&');
+      body.append(ThingSpeakEntry::getItemName(iItem));
+      body.append('=');
+      body.append(entry.get(iItem), entry.getLength(iItem));
+      fFirstItem = false;
+    }
 
+    return !body.overflow();
+  }
 
-    // create Post message for thingspeak
-    HttpRequest* request = new HttpRequest(this->net, HTTP_POST, "http://api.thingspeak.com/update");
-    request->set_header("User-Agent", TS_USER_AGENT);
-    request->set_header("X-THINGSPEAKAPIKEY", writeAPIKey);
-    request->set_header("Content-Type", "application/x-www-form-urlencoded");
+  // Posts a raw post message, resets the multi-field update like writeRaw() always did
+  int writeRawPayload(unsigned long channelNumber, ThingSpeakPayload & body, const char * writeAPIKey) {
+    int status;
 
-    string body = "";
-    bool fFirstItem = true;
-    for(size_t iField = 0; iField < FIELDNUM_MAX; iField++) {
-      if(this->nextWriteField[iField].length() > 0) {
-        if(!fFirstItem)
-          body += "&";
-        body += "field";
-        body += std::to_string((int)(iField + 1));
-        body += "=";
-        body += this->nextWriteField[iField];
-        fFirstItem = false;
-      }
+    if(body.overflow()) {
+      return ERR_OUT_OF_RANGE;
     }
 
-    /*
-     ToDo oh
-    if(!isnan(this->nextWriteLatitude)) {
-      if(!fFirstItem)
-        body.concat("&");
-      body.concat("lat=");
-      body.concat(this->nextWriteLatitude);
-      fFirstItem = false;
+    long entryID;
+    status = updateWithRetry(channelNumber, writeAPIKey, body.c_str(), body.length(), &entryID, 0);
+    if(status == ERR_TIMEOUT) {
+      return abortWriteRaw(status);
     }
-
-    if(!isnan(this->nextWriteLongitude)) {
-      if(!fFirstItem)
-        body.concat("&");
-      body.concat("long=");
-      body.concat(this->nextWriteLongitude);
-      fFirstItem = false;
+    if(status == OK_SUCCESS || status == ERR_NOT_INSERTED) {
+      resetWriteFields();
     }
+    return status;
+  }
 
+  bool isRetryable(int status) {
+    if(this->retryable) {
+      return this->retryable(status);
+    }
+    return status == ERR_CONNECT_FAILED || status == ERR_TIMEOUT || status >= 500;
+  }
 
-    if(!isnan(this->nextWriteElevation)) {
-      if(!fFirstItem)
-        body.concat("&");
-      body.concat("elevation=");
-      body.concat(this->nextWriteElevation);
-      fFirstItem = false;
+  // Delay in ms before the retry following the given attempt (1 based), uniformly drawn up to the capped exponential backoff
+  uint32_t getRetryDelay(unsigned int attempt) {
+    uint32_t backoff = this->retryBaseDelay;
+    for(unsigned int i = 1; i < attempt && backoff < this->retryMaxDelay; i++) {
+      backoff *= 2;
+    }
+    if(backoff > this->retryMaxDelay) {
+      backoff = this->retryMaxDelay;
     }
-    */
 
-    if(this->nextWriteStatus.length() > 0) {
-      if(!fFirstItem)
-        body += "&";
-      body += "status=";
-      body += this->nextWriteStatus;
-      fFirstItem = false;
+    // xorshift32, seeded from the microsecond ticker so that devices started together draw different delays
+    if(this->jitterState == 0) {
+      this->jitterState = us_ticker_read() | 1;
     }
+    uint32_t x = this->jitterState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    this->jitterState = x;
+    return x % (backoff + 1);
+  }
 
-    if(this->nextWriteTwitter.length() > 0) {
-      if(!fFirstItem)
-        body += "&";
-      body += "twitter=";
-      body += this->nextWriteTwitter;
-      fFirstItem = false;
+  // Waits before the retry following the given attempt, false without a wait if the retry would not start before deadline (0 for none)
+  bool waitForRetry(unsigned int attempt, uint64_t deadline) {
+    uint32_t delay = getRetryDelay(attempt);
+    if(deadline != 0 && Kernel::get_ms_count() + delay >= deadline) {
+      #ifdef PRINT_DEBUG_MESSAGES
+        printf("ts::retry   attempt %u failed, no time left for a retry\n", attempt);
+      #endif
+      return false;
     }
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::retry   attempt %u failed, next in %lu ms\n", attempt, (unsigned long)delay);
+    #endif
+    ThisThread::sleep_for(delay);
+    return true;
+  }
 
-    if(this->nextWriteTweet.length() > 0) {
-      if(!fFirstItem)
-        body += "&";
-      body += "tweet=";
-      body += this->nextWriteTweet;
-      fFirstItem = false;
+  /*
+  Sends an update through the transport, failed attempts are sent again with the same body as the retry policy allows.
+  The attempts and the waits in between end by deadline (Kernel::get_ms_count(), 0 for none), which only a HTTP update can be
+  bounded by, other transports apply their own timeouts.
+  */
+  int updateWithRetry(unsigned long channelNumber, const char * writeAPIKey, const char * body, size_t bodyLen, long * entryID, uint64_t deadline) {
+    int status;
+    for(unsigned int attempt = 1; ; attempt++) {
+      status = sendUpdate(channelNumber, writeAPIKey, body, bodyLen, entryID, deadline);
+      if(attempt >= this->retryAttempts || !isRetryable(status) || !waitForRetry(attempt, deadline)) {
+        return status;
+      }
     }
+  }
 
-    if(this->nextWriteCreatedAt.length() > 0) {
-      if(!fFirstItem)
-        body += "&";
-      body += "created_at=";
-      body += this->nextWriteCreatedAt;
-      fFirstItem = false;
+  // Sends one attempt of an update through the transport, a HTTP one ends by deadline and the request timeout
+  int sendUpdate(unsigned long channelNumber, const char * writeAPIKey, const char * body, size_t bodyLen, long * entryID, uint64_t deadline) {
+    if(this->transport == &this->httpTransport) {
+      return postUpdate(writeAPIKey, body, bodyLen, entryID, deadline);
     }
+    return this->transport->update(channelNumber, writeAPIKey, body, bodyLen, entryID);
+  }
 
-    body += "&headers=false";
+  // Posts an update that ends by deadline (0 for none), *entryID receives the entry ID assigned by ThingSpeak
+  int postUpdate(const char * writeAPIKey, const char * body, size_t bodyLen, long * entryID, uint64_t deadline) {
+    int status;
 
-    resetWriteFields();
+    *entryID = 0;
 
     #ifdef PRINT_DEBUG_MESSAGES
-      printf("               POST \"%s\"\n", body.c_str());
+      printf("               POST \"%.*s\"\n", (int)bodyLen, body);
     #endif
 
-    HttpResponse* response = request->send(body.c_str(), strlen(body.c_str()));
-    #ifdef PRINT_HTTP
-      printf("\n----- HTTP POST response -----\n");
-      printf("Status: %d - %s\n", response->get_status_code(), response->get_status_message().c_str());
-
-      printf("Headers:\n");
-      for (size_t ix = 0; ix < response->get_headers_length(); ix++) {
-        printf("\t%s: %s\n", response->get_headers_fields()[ix]->c_str(), response->get_headers_values()[ix]->c_str());
-      }
-      printf("\nBody (%d bytes):\n\n%s\n", response->get_body_length(), response->get_body_as_string().c_str());
-    #endif
+    ThingSpeakRequest* request;
+    HttpResponse* response = sendRequest(&request, &status, deadline, HTTP_POST, "/update?headers=false", writeAPIKey, "application/x-www-form-urlencoded", body, bodyLen);
+    if(NULL == response) {
+      return status;
+    }
 
     status = response->get_status_code();
     if(status != OK_SUCCESS) {
-      delete request;
-      printf("get_status_code %d\n", status);
+      endRequest(request);
       return status;
     }
 
-    long entryID = stoi(response->get_body_as_string());
+    char number[THINGSPEAK_NUMBER_LENGTH];
+    copyNumber(number, response->get_body(), response->get_body_length());
+    *entryID = strtol(number, NULL, 10);
 
     #ifdef PRINT_DEBUG_MESSAGES
-      printf("               Entry ID \"%s\" (%ld)", response->get_body_as_string().c_str(), entryID);
+      printf("               Entry ID \"%s\" (%ld)", number, *entryID);
     #endif
 
     #ifdef PRINT_DEBUG_MESSAGES
       printf("disconnected.\n");
     #endif
-    if(entryID == 0) {
+    if(*entryID == 0) {
       // ThingSpeak did not accept the write
-      printf("ERR_NOT_INSERTED\n");
       status = ERR_NOT_INSERTED;
     }
 
-    resetWriteFields();
-    delete request;
+    endRequest(request);
     return status;
   }
 
+  // Reads URLSuffix of a channel into content, returns the read status
+  int getRaw(unsigned long channelNumber, const string & URLSuffix, const char * readAPIKey, string & content) {
+    return getRaw(channelNumber, URLSuffix, readAPIKey, &content, NULL, getReadCacheTTL(), 0);
+  }
+
+  // The TTL of cached responses set by setReadCacheTTL(), 0 without a cache
+  uint32_t getReadCacheTTL() {
+    #if THINGSPEAK_READ_CACHE > 0
+      return this->readCacheTTL;
+    #else
+      return 0;
+    #endif
+  }
 
   /*
-  Function: writeRaw
+  Reads a field holding a number into value (THINGSPEAK_NUMBER_LENGTH bytes) without a copy of the response on the heap,
+  sets lastReadStatus. value is empty in case of an error or if the field does not hold a number.
+  */
+  int readNumberField(unsigned long channelNumber, unsigned int field, const char * readAPIKey, char * value) {
+    value[0] = '\0';
+    if(field < FIELDNUM_MIN || field > FIELDNUM_MAX) {
+      this->lastReadStatus = ERR_INVALID_FIELD_NUM;
+      return this->lastReadStatus;
+    }
 
-  Summary:
-  Write a raw POST to a ThingSpeak channel
+    char URLSuffix[24] = "/fields/";
+    ThingSpeakPayload::formatLong(URLSuffix + 8, field);
+    strcat(URLSuffix, "/last");
 
-  Parameters:
-  channelNumber - Channel number
-  postMessage - Raw URL to write to ThingSpeak as a string.  See the documentation at https://thingspeak.com/docs/channels#update_feed.
-  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+    this->lastReadStatus = getRaw(channelNumber, URLSuffix, readAPIKey, NULL, value, getReadCacheTTL(), 0);
+    return this->lastReadStatus;
+  }
 
-  Returns:
-  200 - successful.
-  404 - Incorrect API key (or invalid ThingSpeak server address)
-  -101 - Value is out of range or string is too long (> 255 characters)
-  -201 - Invalid field number specified
-  -210 - setField() was not called before writeFields()
-  -301 - Failed to connect to ThingSpeak
-  -302 - Unexpected failure during write to ThingSpeak
-  -303 - Unable to parse response
-    -304 - Timeout waiting for server to respond
-  -401 - Point was not inserted (most probable cause is the rate limit of once every 15 seconds)
+  /*
+  Reads URLSuffix of a channel into content or, if content is NULL, into number (see copyNumber()). Returns the read status.
+  A response cached less than maxAge ms ago is returned without a request. A read whose response is cached for longer is
+  sent as conditional request, a 304 Not Modified reply is answered from the cache. The request ends by deadline (0 for none).
+  */
+  int getRaw(unsigned long channelNumber, const string & URLSuffix, const char * readAPIKey, string * content, char * number, uint32_t maxAge, uint64_t deadline) {
+    const char * headers[5] = { NULL };
+    setReadBody(content, number, "", 0);
+
+    #if THINGSPEAK_READ_CACHE > 0
+      uint32_t cacheKey = ThingSpeakReadCache::hash(URLSuffix, readAPIKey);
+      string etag;
+      string lastModified;
+      string cachedContent;
+      bool fCached = false;
+
+      if(readFromCache(channelNumber, cacheKey, maxAge, content, number)) {
+        return OK_SUCCESS;
+      }
 
-  Notes:
-  This is low level functionality that will not be required by most users.
+      this->readCacheMutex.lock();
+      ThingSpeakReadCache::Entry * entry = this->readCache.find(channelNumber, cacheKey);
+      if(NULL != entry) {
+        etag = entry->etag;
+        lastModified = entry->lastModified;
+        cachedContent = entry->content;
+        fCached = true;
+      }
+      this->readCacheMutex.unlock();
 
-  */
-  int writeRaw(unsigned long channelNumber, const char * postMessage, const char * writeAPIKey) {
-    return writeRaw(channelNumber, string(postMessage), writeAPIKey);
-  };
+      size_t nHeaders = 0;
+      if(!etag.empty()) {
+        headers[nHeaders++] = "If-None-Match";
+        headers[nHeaders++] = etag.c_str();
+      }
+      if(!lastModified.empty()) {
+        headers[nHeaders++] = "If-Modified-Since";
+        headers[nHeaders++] = lastModified.c_str();
+      }
+    #endif
 
+    ThingSpeakRequest* request;
+    int status;
+    HttpResponse* response = sendReadRequest(&request, &status, deadline, channelNumber, URLSuffix, readAPIKey, headers);
+    if(NULL == response) {
+      return status;
+    }
 
-  /*
-  Function: writeRaw
+    status = response->get_status_code();
+    if(status == OK_SUCCESS) {
+      setReadBody(content, number, response->get_body(), response->get_body_length());
 
-  Summary:
-  Write a raw POST to a ThingSpeak channel
+      #if THINGSPEAK_READ_CACHE > 0
+        cacheRead(channelNumber, cacheKey, maxAge, getHeader(response, "ETag"), getHeader(response, "Last-Modified"), response->get_body(), response->get_body_length());
+      #endif
+    }
+    #if THINGSPEAK_READ_CACHE > 0
+      else if(status == 304 && fCached) {
+        #ifdef PRINT_DEBUG_MESSAGES
+          printf("               not modified, cached \"%s\"\n", cachedContent.c_str());
+        #endif
+        setReadBody(content, number, cachedContent.c_str(), cachedContent.length());
+        status = OK_SUCCESS;
+
+        // the response is fresh again
+        this->readCacheMutex.lock();
+        entry = this->readCache.find(channelNumber, cacheKey);
+        if(NULL != entry) {
+          entry->fetchedAt = Kernel::get_ms_count();
+        }
+        this->readCacheMutex.unlock();
+      }
+    #endif
+    endRequest(request);
+    return status;
+  }
 
-  Parameters:
-  channelNumber - Channel number
-  postMessage - Raw URL to write to ThingSpeak as a string.  See the documentation at https://thingspeak.com/docs/channels#update_feed.
-  writeAPIKey - Write API key associated with the channel.  *If you share code with others, do _not_ share this key*
+  #if THINGSPEAK_READ_CACHE > 0
+  // Copies a response cached less than maxAge ms ago into content or number, false if there is none
+  bool readFromCache(unsigned long channelNumber, uint32_t cacheKey, uint32_t maxAge, string * content, char * number) {
+    this->readCacheMutex.lock();
+    ThingSpeakReadCache::Entry * entry = this->readCache.find(channelNumber, cacheKey);
+    bool fFresh = NULL != entry && Kernel::get_ms_count() - entry->fetchedAt < maxAge;
+    if(fFresh) {
+      #ifdef PRINT_DEBUG_MESSAGES
+        printf("ts::readRaw   (channelNumber: %lu) cached \"%s\"\n", channelNumber, entry->content.c_str());
+      #endif
+      setReadBody(content, number, entry->content.c_str(), entry->content.length());
+    }
+    this->readCacheMutex.unlock();
+    return fFresh;
+  }
 
-  Returns:
-  200 - successful.
-  404 - Incorrect API key (or invalid ThingSpeak server address)
-  -101 - Value is out of range or string is too long (> 255 characters)
-  -201 - Invalid field number specified
-  -210 - setField() was not called before writeFields()
-  -301 - Failed to connect to ThingSpeak
-  -302 - Unexpected failure during write to ThingSpeak
-  -303 - Unable to parse response
-    -304 - Timeout waiting for server to respond
-  -401 - Point was not inserted (most probable cause is the rate limit of once every 15 seconds)
+  // Keeps a response if it can be returned within maxAge or validated later on
+  void cacheRead(unsigned long channelNumber, uint32_t cacheKey, uint32_t maxAge, const string & etag, const string & lastModified, const char * body, size_t bodyLen) {
+    this->readCacheMutex.lock();
+    if(maxAge > 0 || !etag.empty() || !lastModified.empty()) {
+      this->readCache.store(channelNumber, cacheKey, etag, lastModified, body, bodyLen, Kernel::get_ms_count());
+    }
+    else {
+      this->readCache.remove(channelNumber, cacheKey);
+    }
+    this->readCacheMutex.unlock();
+  }
+  #endif
 
-  Notes:
-  This is low level functionality that will not be required by most users.
+  static void setReadBody(string * content, char * number, const char * body, size_t bodyLen) {
+    if(NULL != content) {
+      content->assign(NULL == body ? "" : body, NULL == body ? 0 : bodyLen);
+    }
+    else {
+      copyNumber(number, body, bodyLen);
+    }
+  }
+
+  // Copies a response body into number (THINGSPEAK_NUMBER_LENGTH bytes) zero terminated, a body too long for a number gives ""
+  static void copyNumber(char * number, const char * body, size_t bodyLen) {
+    if(NULL == body || bodyLen >= THINGSPEAK_NUMBER_LENGTH) {
+      bodyLen = 0;
+    }
+    if(bodyLen > 0) {
+      memcpy(number, body, bodyLen);
+    }
+    number[bodyLen] = '\0';
+  }
 
+  /*
+  Writes the GET requests of the reads batch[0..batchCount-1] onto a connection of the pool, then reads their responses in
+  order into results. Returns the number of reads answered, the connection is closed if that is not all of them.
   */
-  int writeRaw(unsigned long channelNumber, string postMessage, const char * writeAPIKey) {
-    int status;
+  size_t sendPipelined(const ChannelRead * reads, const size_t * batch, size_t batchCount, ReadResult * results, uint32_t maxAge) {
+    PoolSlot * slot = acquirePoolSlot();
+    if(NULL == slot) {
+      return 0;
+    }
+    ThingSpeakConnection & connection = slot->connection;
 
-    #ifdef PRINT_DEBUG_MESSAGES
-      printf("ts::writeRaw   (channelNumber: %lu writeAPIKey: %s", channelNumber, writeAPIKey);
+    #if THINGSPEAK_STATS
+      bool fReused = connection.isConnected();
+    #endif
+    ThingSpeakSocket * socket = connection.acquire(getRequestDeadline(0));
+    if(NULL == socket) {
+      releasePoolSlot(slot);
+      return 0;
+    }
+    #if THINGSPEAK_STATS
+      uint32_t dnsTime = connection.getDNSTime();
+      uint32_t connectTime = connection.getConnectTime();
+      socket->start();
     #endif
 
-    // Post data to thingspeak
-    string body = postMessage + string("&headers=false");
+    string requests;
+    for(size_t k = 0; k < batchCount; k++) {
+      const ChannelRead & read = reads[batch[k]];
+      #ifdef PRINT_DEBUG_MESSAGES
+        printf("ts::readPipelined   (channelNumber: %lu URLSuffix: \"%s\")\n", read.channelNumber, read.URLSuffix.c_str());
+      #endif
+      requests += "GET /channels/" + std::to_string(read.channelNumber) + read.URLSuffix + " HTTP/1.1\r\n";
+      requests += "Host: " + connection.getHostHeader() + "\r\n";
+      requests += "User-Agent: " TS_USER_AGENT "\r\n";
+      requests += (THINGSPEAK_KEEPALIVE || k + 1 < batchCount) ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+      if(NULL != read.readAPIKey) {
+        requests += string("X-THINGSPEAKAPIKEY: ") + read.readAPIKey + "\r\n";
+      }
+      requests += "\r\n";
+    }
 
-    HttpRequest* request = new HttpRequest(this->net, HTTP_POST, "http://api.thingspeak.com/update");
-    request->set_header("User-Agent", TS_USER_AGENT);
-    request->set_header("X-THINGSPEAKAPIKEY", writeAPIKey);
-    request->set_header("Content-Type", "application/x-www-form-urlencoded");
+    size_t sent = 0;
+    while(sent < requests.length()) {
+      nsapi_size_or_error_t n = socket->send(requests.c_str() + sent, requests.length() - sent);
+      if(n <= 0) {
+        break;
+      }
+      sent += n;
+    }
 
+    size_t answered = 0;
+    bool fClose = sent < requests.length();
+    if(!fClose) {
+      ThingSpeakResponseReader reader(socket);
+      string etag;
+      string lastModified;
+      while(answered < batchCount && !fClose) {
+        ReadResult & result = results[batch[answered]];
+        if(!reader.read(result.status, result.value, etag, lastModified, fClose)) {
+          result.value.clear();
+          fClose = true;
+          break;
+        }
+        if(result.status == OK_SUCCESS) {
+          #if THINGSPEAK_READ_CACHE > 0
+            const ChannelRead & read = reads[batch[answered]];
+            cacheRead(read.channelNumber, ThingSpeakReadCache::hash(read.URLSuffix, read.readAPIKey), maxAge, etag, lastModified, result.value.c_str(), result.value.length());
+          #endif
+        }
+        else {
+          result.value.clear();
+        }
+        answered++;
+      }
+    }
     #ifdef PRINT_DEBUG_MESSAGES
-      printf("               POST \"%s\"\n", body.c_str());
+      printf("ts::readPipelined   %u of %u answered\n", (unsigned)answered, (unsigned)batchCount);
     #endif
 
-    HttpResponse* response = request->send(body.c_str(), strlen(body.c_str()));
-    #ifdef PRINT_HTTP
-      printf("\n----- HTTP POST response -----\n");
-      printf("Status: %d - %s\n", response->get_status_code(), response->get_status_message().c_str());
-
-      printf("Headers:\n");
-      for (size_t ix = 0; ix < response->get_headers_length(); ix++) {
-        printf("\t%s: %s\n", response->get_headers_fields()[ix]->c_str(), response->get_headers_values()[ix]->c_str());
+    #if THINGSPEAK_STATS
+      // the batch counts as one request per read answered, the times and sizes go to the first one
+      for(size_t k = 0; k < answered; k++) {
+        ThingSpeakRequestStats requestStats;
+        memset(&requestStats, 0, sizeof(requestStats));
+        requestStats.method = HTTP_GET;
+        requestStats.status = results[batch[k]].status;
+        requestStats.fReused = fReused || k > 0;
+        requestStats.attempts = 1;
+        if(k == 0) {
+          requestStats.dnsTime = dnsTime;
+          requestStats.connectTime = connectTime;
+          requestStats.sendTime = socket->sentAt - socket->startedAt;
+          requestStats.firstByteTime = socket->firstByteAt - socket->startedAt;
+          requestStats.totalTime = us_ticker_read() - socket->startedAt;
+          requestStats.bytesSent = socket->bytesSent;
+          requestStats.bytesReceived = socket->bytesReceived;
+        }
+        recordStats(requestStats);
       }
-      printf("\nBody (%d bytes):\n\n%s\n", response->get_body_length(), response->get_body_as_string().c_str());
     #endif
 
-    status = response->get_status_code();
-    if(status != OK_SUCCESS) {
-      delete request;
-      return status;
+    if(fClose || !THINGSPEAK_KEEPALIVE || answered < batchCount) {
+      connection.close();
     }
+    releasePoolSlot(slot);
+    return answered;
+  }
 
-    long entryID = stoi(response->get_body_as_string());
-
+  // Sends a GET request for URLSuffix of a channel with the further headers given, see sendRequest()
+  HttpResponse * sendReadRequest(ThingSpeakRequest ** pRequest, int * pStatus, uint64_t deadline, unsigned long channelNumber, const string & URLSuffix, const char * readAPIKey, const char * const * headers = NULL) {
     #ifdef PRINT_DEBUG_MESSAGES
-      printf("               Entry ID \"%s\" (%ld)", response->get_body_as_string().c_str(), entryID);
+      printf("ts::readRaw   (channelNumber: %lu", channelNumber);
+      if(NULL != readAPIKey) {
+        printf(" readAPIKey: %s", readAPIKey);
+      }
+      printf(" URLSuffix: \"%s\")\n", URLSuffix.c_str());
     #endif
 
+    string path = string("/channels/") + std::to_string(channelNumber) + URLSuffix;
+
     #ifdef PRINT_DEBUG_MESSAGES
-      printf("disconnected.\n");
+      printf("               GET \"%s\"\n", path.c_str());
     #endif
-    if(entryID == 0) {
-      // ThingSpeak did not accept the write
-      status = ERR_NOT_INSERTED;
-    }
-
-    resetWriteFields();
-    delete request;
-    return status;
-  };
 
+    HttpResponse* response = sendRequest(pRequest, pStatus, deadline, HTTP_GET, path, readAPIKey, NULL, NULL, 0, nullptr, headers);
 
-  /*
-  Function: readStringField
+    #ifdef PRINT_DEBUG_MESSAGES
+      if(NULL != response && response->get_status_code() == OK_SUCCESS) {
+        printf("Read: \"%.*s\"\n", (int)response->get_body_length(), response->get_body());
+      }
+    #endif
+    return response;
+  }
 
-  Summary:
-  Read the latest string from a private ThingSpeak channel
+  // A request executed by the worker thread, either a write (writeDone) or a read (readDone)
+  struct AsyncJob {
+    AsyncJob() : channelNumber(0), fApiKey(false), attempt(0) {}
+    unsigned long channelNumber;
+    string path;
+    string body;
+    string apiKey;
+    bool fApiKey;
+    string storeEntry;        // packed bulk entry of a write, kept by the store if the write fails, empty without a store
+    Callback<void(int, long)> writeDone;
+    Callback<void(int, const string &)> readDone;
+    unsigned int attempt;
+  };
 
-  Parameters:
-  channelNumber - Channel number
-  field - Field number (1-8) within the channel to read from.
-  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
+  void startAsyncQueue() {
+    if(NULL == this->asyncQueue) {
+      this->asyncQueue = new EventQueue(THINGSPEAK_ASYNC_QUEUE_EVENTS * EVENTS_EVENT_SIZE);
+      this->asyncThread = new Thread(osPriorityBelowNormal, THINGSPEAK_ASYNC_STACK_SIZE, NULL, "ThingSpeak");
+      this->asyncThread->start(callback(this->asyncQueue, &EventQueue::dispatch_forever));
+    }
+  }
 
-  Returns:
-  Value read (UTF8 string), or empty string if there is an error.  Use getLastReadStatus() to get more specific information.
+  int postAsyncJob(AsyncJob * job) {
+    startAsyncQueue();
 
-  */
-  string readStringField(unsigned long channelNumber, unsigned int field, const char * readAPIKey) {
-    if(field < FIELDNUM_MIN || field > FIELDNUM_MAX) {
-      this->lastReadStatus = ERR_INVALID_FIELD_NUM;
-      return("");
+    if(this->asyncQueue->call(this, &ThingSpeak::runAsyncJob, job) == 0) {
+      delete job;
+      return ERR_QUEUE_FULL;
     }
-    #ifdef PRINT_DEBUG_MESSAGES
-      printf("ts::readStringField(channelNumber: %lu", channelNumber);
-      if(NULL != readAPIKey) {
-        printf(" readAPIKey: %s", readAPIKey);
-      }
-      printf(" field: %d)\n", field);
-    #endif
-    return readRaw(channelNumber, string("/fields/") + std::to_string(field) + string("/last"), readAPIKey);
+    return OK_SUCCESS;
   }
 
+  void runAsyncJob(AsyncJob * job) {
+    if(job->readDone) {
+      string content;
+      int status = getRaw(job->channelNumber, job->path, job->fApiKey ? job->apiKey.c_str() : NULL, content);
+      job->readDone(status, content);
+    }
+    else {
+      long entryID;
+      int status = sendUpdate(job->channelNumber, job->apiKey.c_str(), job->body.c_str(), job->body.length(), &entryID, 0);
+      if(++job->attempt < this->retryAttempts && isRetryable(status)) {
+        // Send the job again later, the worker serves the other jobs meanwhile
+        if(this->asyncQueue->call_in(getRetryDelay(job->attempt), this, &ThingSpeak::runAsyncJob, job) != 0) {
+          return;
+        }
+      }
 
+      // Keep the update for writeStored() in case ThingSpeak can't be reached
+      if(isStorable(status) && !job->storeEntry.empty()) {
+        this->writeMutex.lock();
+        #ifdef PRINT_DEBUG_MESSAGES
+          printf("ts::writeFieldsAsync   stored for later (%u pending)\n", this->store->getPendingCount() + 1);
+        #endif
+        this->store->append(job->storeEntry.data(), job->storeEntry.length());
+        this->writeMutex.unlock();
+      }
+      if(job->writeDone) {
+        job->writeDone(status, entryID);
+      }
+    }
+    delete job;
+  }
 
-  /*
-  Function: readStringField
-
-  Summary:
-  Read the latest string from a private ThingSpeak channel
+  // The updates of writeChannels(), each thread sending them takes the next one not taken yet
+  struct ChannelFanOut {
+    ChannelFanOut(ThingSpeak * ts, ChannelWrite * writes, size_t count) : ts(ts), writes(writes), count(count), next(0) {}
+
+    void run() {
+      for(;;) {
+        this->mutex.lock();
+        size_t i = this->next++;
+        this->mutex.unlock();
+        if(i >= this->count) {
+          return;
+        }
+        ChannelWrite * write = &this->writes[i];
+        write->status = (NULL == write->entry) ? ERR_SETFIELD_NOT_CALLED : this->ts->writeFields(write->channelNumber, write->writeAPIKey, *write->entry);
+      }
+    }
 
-  Parameters:
-  channelNumber - Channel number
-  field - Field number (1-8) within the channel to read from.
+    #if THINGSPEAK_POOL_SIZE > 1
+    // run() on a helper thread, sets flag once it is done
+    void runHelper(uint32_t flag) {
+      run();
+      this->done.set(flag);
+    }
+    #endif
 
-  Returns:
-  Value read (UTF8 string), or empty string if there is an error.  Use getLastReadStatus() to get more specific information.
+    ThingSpeak * ts;
+    ChannelWrite * writes;
+    size_t count;
+    size_t next;
+    Mutex mutex;
+    #if THINGSPEAK_POOL_SIZE > 1
+    EventFlags done;          // a flag for each helper thread the updates were posted to
+    #endif
+  };
 
-  */
-  string readStringField(unsigned long channelNumber, unsigned int field) {
-    return readStringField(channelNumber, field, NULL);
+  #if THINGSPEAK_POOL_SIZE > 1
+  // Starts the THINGSPEAK_POOL_SIZE - 1 helper threads of writeChannels() on its first call, each one serves its own queue
+  void startFanOut() {
+    this->fanOutMutex.lock();
+    while(this->fanOutCount + 1 < THINGSPEAK_POOL_SIZE && !this->fFanOutFailed) {
+      EventQueue * queue = new EventQueue(THINGSPEAK_ASYNC_QUEUE_EVENTS * EVENTS_EVENT_SIZE);
+      Thread * thread = new Thread(osPriorityNormal, THINGSPEAK_ASYNC_STACK_SIZE, NULL, "ThingSpeak");
+      if(thread->start(callback(queue, &EventQueue::dispatch_forever)) != osOK) {
+        // the updates are sent by the threads started so far
+        delete thread;
+        delete queue;
+        this->fFanOutFailed = true;
+        break;
+      }
+      this->fanOutQueues[this->fanOutCount] = queue;
+      this->fanOutThreads[this->fanOutCount] = thread;
+      this->fanOutCount++;
+    }
+    this->fanOutMutex.unlock();
+  }
+  #endif
+
+  // Connection of the pool and the request using it
+  struct PoolSlot {
+    PoolSlot() : request(NULL) {}
+    ThingSpeakConnection connection;
+    Mutex mutex;
+    ThingSpeakRequest *request;
+    #if THINGSPEAK_POOL_SIZE > 1
+    Mutex payloadMutex;                     // guards payload, taken independently of the connection
+    char payload[THINGSPEAK_PAYLOAD_SIZE];  // for an update serialised while the shared payload buffer is in use
+    #endif
   };
 
+  /*
+  Locks a payload buffer for an update of len bytes and returns its mutex. The shared buffer is locked with writeMutex.
+  With a pool of connections a thread finding it in use takes the buffer of a pool slot instead, so its update goes out
+  over another connection meanwhile. An update too large for THINGSPEAK_PAYLOAD_SIZE waits for the shared buffer.
+  */
+  Mutex * lockPayload(size_t len, char ** payload, size_t * capacity) {
+    #if THINGSPEAK_POOL_SIZE > 1
+      if(!this->writeMutex.trylock()) {
+        for(size_t i = 0; i < THINGSPEAK_POOL_SIZE && len < THINGSPEAK_PAYLOAD_SIZE; i++) {
+          if(this->pool[i].payloadMutex.trylock()) {
+            *payload = this->pool[i].payload;
+            *capacity = THINGSPEAK_PAYLOAD_SIZE;
+            return &this->pool[i].payloadMutex;
+          }
+        }
+        this->writeMutex.lock();
+      }
+    #else
+      (void)len;  // a single connection has only the shared buffer
+      this->writeMutex.lock();
+    #endif
+    *payload = this->payload;
+    *capacity = this->payloadCapacity;
+    return &this->writeMutex;
+  }
 
   /*
-  Function: readFloatField
+  Picks a connection of the pool for a request and locks it for the calling thread. An idle open connection is preferred,
+  then an idle closed one. If all are busy, the threads queue up on the connections in turn. Returns NULL if a power
+  managed interface could not be connected.
+  */
+  PoolSlot * acquirePoolSlot() {
+    // a power managed interface stays connected until the slot is released
+    if(acquireNetwork() != NSAPI_ERROR_OK) {
+      releaseNetwork();
+      return NULL;
+    }
 
-  Summary:
-  ead the latest floating point value from a private ThingSpeak channel
+    for(int pass = 0; pass < 2; pass++) {
+      for(size_t i = 0; i < THINGSPEAK_POOL_SIZE; i++) {
+        PoolSlot * slot = &this->pool[i];
+        // isConnected() is only a hint here, it is checked again once the slot is locked
+        if(pass == 0 && !slot->connection.isConnected()) {
+          continue;
+        }
+        if(slot->mutex.trylock()) {
+          return slot;
+        }
+      }
+    }
 
-  Parameters:
-  channelNumber - Channel number
-  field - Field number (1-8) within the channel to read from.
-  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
+    this->connectionMutex.lock();
+    PoolSlot * slot = &this->pool[this->nextPoolSlot];
+    this->nextPoolSlot = (this->nextPoolSlot + 1) % THINGSPEAK_POOL_SIZE;
+    this->connectionMutex.unlock();
 
-  Returns:
-  Value read, or 0 if the field is text or there is an error.  Use getLastReadStatus() to get more specific information.  Note that NAN, INFINITY, and -INFINITY are valid results.
+    slot->mutex.lock();
+    return slot;
+  }
+
+  void releasePoolSlot(PoolSlot * slot) {
+    slot->mutex.unlock();
+    releaseNetwork();
+  }
 
+  /*
+  Connects a power managed network interface for the first of the requests using it, see setPowerManagement().
+  Returns NSAPI_ERROR_OK or the error of connect(). Each call has to be paired with releaseNetwork(), also a failed one.
   */
-  float readFloatField(unsigned long channelNumber, unsigned int field, const char * readAPIKey) {
-    return stof(readStringField(channelNumber, field, readAPIKey));
-  };
+  nsapi_error_t acquireNetwork() {
+    nsapi_error_t error = NSAPI_ERROR_OK;
+    this->powerMutex.lock();
+    if(this->fPowerManaged && !this->fNetworkUp && NULL != this->net) {
+      #if DEVICE_SLEEP
+        sleep_manager_lock_deep_sleep();
+      #endif
+      this->fDeepSleepLocked = true;
+      error = this->net->connect();
+      if(error == NSAPI_ERROR_IS_CONNECTED) {
+        error = NSAPI_ERROR_OK;
+      }
+      #ifdef PRINT_DEBUG_MESSAGES
+        printf("ts::acquireNetwork   connect (%d)\n", error);
+      #endif
+      if(error == NSAPI_ERROR_OK) {
+        this->fNetworkUp = true;
+      }
+      else {
+        unlockDeepSleep();
+      }
+    }
+    this->networkUsers++;
+    this->powerMutex.unlock();
+    return error;
+  }
 
+  // Disconnects a power managed network interface once the last request using it is done
+  void releaseNetwork() {
+    this->powerMutex.lock();
+    this->networkUsers--;
+    if(this->fPowerManaged && this->networkUsers == 0 && this->fNetworkUp) {
+      sleepNetwork();
+    }
+    this->powerMutex.unlock();
+  }
 
-  /*
-  Function: readFloatField
+  // Closes the connections of the pool and disconnects the interface, called with powerMutex locked and no request running
+  void sleepNetwork() {
+    for(size_t i = 0; i < THINGSPEAK_POOL_SIZE; i++) {
+      this->pool[i].mutex.lock();
+      this->pool[i].connection.close();
+      this->pool[i].mutex.unlock();
+    }
+    if(NULL != this->net) {
+      this->net->disconnect();
+    }
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::sleepNetwork   disconnected\n");
+    #endif
+    this->fNetworkUp = false;
+    unlockDeepSleep();
+  }
 
-  Summary:
-  Read the latest floating point value from a private ThingSpeak channel
+  // Allows deep sleep again if acquireNetwork() locked it, an interface connected by the application never locked it
+  void unlockDeepSleep() {
+    if(this->fDeepSleepLocked) {
+      #if DEVICE_SLEEP
+        sleep_manager_unlock_deep_sleep();
+      #endif
+      this->fDeepSleepLocked = false;
+    }
+  }
 
-  Parameters:
-  channelNumber - Channel number
-  field - Field number (1-8) within the channel to read from.
+  // A wake window of setPowerManagement(), executed by the worker thread
+  void runFlush() {
+    acquireNetwork();
+    flush();
+    if(this->onWake) {
+      this->onWake();
+    }
+    releaseNetwork();
 
-  Returns:
-  Value read, or 0 if the field is text or there is an error.  Use getLastReadStatus() to get more specific information.  Note that NAN, INFINITY, and -INFINITY are valid results.
+    this->powerMutex.lock();
+    if(this->fPowerManaged) {
+      this->flushEventID = this->asyncQueue->call_in(this->flushInterval, this, &ThingSpeak::runFlush);
+    }
+    this->powerMutex.unlock();
+  }
 
+  /*
+  Sends a request for path over a connection of the pool kept by the ThingSpeak object. A kept connection that was closed by the server in the
+  meantime is reopened and the request sent once more. On success the caller has to delete *pRequest, which owns the response.
+  Returns NULL if the request could not be sent or no response was received, *pStatus then receives ERR_TIMEOUT if the
+  request ran out of time and ERR_CONNECT_FAILED otherwise. The request ends by deadline (Kernel::get_ms_count(), 0 for none)
+  and within the timeout set by setTimeout(), whichever comes first.
+  The connection stays locked for the calling thread until the request is passed to endRequest(), requests of other threads use
+  the other connections of the pool meanwhile. headers is a NULL terminated list of names and values of further headers.
   */
-  float readFloatField(unsigned long channelNumber, unsigned int field) {
-    return readFloatField(channelNumber, field, NULL);
-  };
+  HttpResponse * sendRequest(ThingSpeakRequest ** pRequest, int * pStatus, uint64_t deadline, http_method method, const string & path, const char * apiKey, const char * contentType, const char * body, size_t bodyLen, Callback<void(const char *, uint32_t)> bodyCallback = nullptr, const char * const * headers = NULL) {
+    *pRequest = NULL;
+    *pStatus = ERR_CONNECT_FAILED;
 
+    PoolSlot * slot = acquirePoolSlot();
+    if(NULL == slot) {
+      return NULL;
+    }
+    ThingSpeakConnection & connection = slot->connection;
+    deadline = getRequestDeadline(deadline);
+
+    #if THINGSPEAK_STATS
+      ThingSpeakRequestStats requestStats;
+      memset(&requestStats, 0, sizeof(requestStats));
+      requestStats.method = method;
+      requestStats.status = ERR_CONNECT_FAILED;
+      uint32_t startedAt = us_ticker_read();
+    #endif
 
-  /*
-  Function: readLongField
+    for(int attempt = 0; attempt < 2; attempt++) {
+      bool fReused = connection.isConnected();
+
+      ThingSpeakSocket * socket = isExpired(deadline) ? NULL : connection.acquire(deadline);
+      #if THINGSPEAK_STATS
+        requestStats.attempts++;
+        requestStats.fReused = fReused;
+        requestStats.dnsTime += connection.getDNSTime();
+        requestStats.connectTime += connection.getConnectTime();
+        if(NULL != socket) {
+          socket->start();
+        }
+      #endif
+      if(NULL == socket) {
+        break;
+      }
 
-  Summary:
-  Read the latest long value from a private ThingSpeak channel
+      // the URL holds the resolved address, so the request does not resolve the host name again
+      ThingSpeakRequest * request = new ThingSpeakRequest(socket, method, connection.getURL(path).c_str(), bodyCallback);
+      request->set_header("Host", connection.getHostHeader());
+      request->set_header("User-Agent", TS_USER_AGENT);
+      request->set_header("Connection", THINGSPEAK_KEEPALIVE ? "keep-alive" : "close");
+      if(NULL != apiKey)
+        request->set_header("X-THINGSPEAKAPIKEY", apiKey);
+      if(NULL != contentType)
+        request->set_header("Content-Type", contentType);
+      for(const char * const * header = headers; NULL != header && NULL != header[0]; header += 2)
+        request->set_header(header[0], header[1]);
+
+      HttpResponse * response = request->send(body, bodyLen);
+      if(NULL != response) {
+        #ifdef PRINT_HTTP
+          printf("\n----- HTTP %s response -----\n", method == HTTP_GET ? "GET" : "POST");
+          printf("Status: %d - %s\n", response->get_status_code(), response->get_status_message().c_str());
+
+          printf("Headers:\n");
+          for (size_t ix = 0; ix < response->get_headers_length(); ix++) {
+            printf("\t%s: %s\n", response->get_headers_fields()[ix]->c_str(), response->get_headers_values()[ix]->c_str());
+          }
+          printf("\nBody (%d bytes):\n\n%s\n", response->get_body_length(), response->get_body_as_string().c_str());
+        #endif
+
+        #if THINGSPEAK_STATS
+          requestStats.status = response->get_status_code();
+          requestStats.sendTime = socket->sentAt - startedAt;
+          requestStats.firstByteTime = socket->firstByteAt - startedAt;
+          requestStats.totalTime = us_ticker_read() - startedAt;
+          requestStats.bytesSent = socket->bytesSent;
+          requestStats.bytesReceived = socket->bytesReceived;
+        #endif
+
+        if(!THINGSPEAK_KEEPALIVE || isConnectionClose(response)) {
+          connection.close();
+        }
 
-  Parameters:
-  channelNumber - Channel number
-  field - Field number (1-8) within the channel to read from.
-  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
+        #if THINGSPEAK_STATS
+          recordStats(requestStats);
+        #endif
+        slot->request = request;
+        *pRequest = request;
+        return response;
+      }
 
-  Returns:
-  Value read, or 0 if the field is text or there is an error.  Use getLastReadStatus() to get more specific information.  Note that NAN, INFINITY, and -INFINITY are valid results.
+      #ifdef PRINT_DEBUG_MESSAGES
+        printf("ts::sendRequest failed (%d)%s\n", request->get_error(), fReused ? ", reconnecting" : "");
+      #endif
+      delete request;
+      connection.close();
 
-  */
-  long readLongField(unsigned long channelNumber, unsigned int field, const char * readAPIKey) {
-    // Note that although the function is called "toInt" it really returns a long.
-    return stoi(readStringField(channelNumber, field, readAPIKey));
+      // only a reused connection may have been closed by the server, a new one failed for real
+      if(!fReused || isExpired(deadline)) {
+        break;
+      }
+    }
+
+    if(isExpired(deadline)) {
+      #ifdef PRINT_DEBUG_MESSAGES
+        printf("ts::sendRequest timed out\n");
+      #endif
+      *pStatus = ERR_TIMEOUT;
+    }
+
+    #if THINGSPEAK_STATS
+      requestStats.status = *pStatus;
+      requestStats.totalTime = us_ticker_read() - startedAt;
+      recordStats(requestStats);
+    #endif
+    releasePoolSlot(slot);
+    return NULL;
   }
 
+  // The deadline of a request of a call ending by deadline (0 for none), the request itself may take up to requestTimeout ms
+  uint64_t getRequestDeadline(uint64_t deadline) {
+    if(this->requestTimeout == 0) {
+      return deadline;
+    }
+    uint64_t requestDeadline = Kernel::get_ms_count() + this->requestTimeout;
+    return (deadline != 0 && deadline < requestDeadline) ? deadline : requestDeadline;
+  }
 
-  /*
-  Function: readLongField
+  // The deadline of a call that may take up to timeout ms, 0 for none
+  static uint64_t getDeadline(uint32_t timeout) {
+    return timeout == 0 ? 0 : Kernel::get_ms_count() + timeout;
+  }
 
-  Summary:
-  Read the latest long value from a private ThingSpeak channel
+  static bool isExpired(uint64_t deadline) {
+    return deadline != 0 && Kernel::get_ms_count() >= deadline;
+  }
 
-  Parameters:
-  channelNumber - Channel number
-  field - Field number (1-8) within the channel to read from.
+  #if THINGSPEAK_STATS
+  // Adds a request to the statistics and passes it to the hook
+  void recordStats(const ThingSpeakRequestStats & requestStats) {
+    ThingSpeakStats & stats = this->stats;
 
-  Returns:
-  Value read, or 0 if the field is text or there is an error.  Use getLastReadStatus() to get more specific information.  Note that NAN, INFINITY, and -INFINITY are valid results.
+    this->connectionMutex.lock();
 
-  */
-  long readLongField(unsigned long channelNumber, unsigned int field) {
-    return readLongField(channelNumber, field, NULL);
-  };
+    stats.requests++;
+    if(requestStats.attempts > 1) {
+      stats.retries++;
+    }
+    if(requestStats.dnsTime > 0) {
+      stats.resolves++;
+    }
+    if(requestStats.connectTime > 0) {
+      stats.connects++;
+    }
+    stats.bytesSent += requestStats.bytesSent;
+    stats.bytesReceived += requestStats.bytesReceived;
+    stats.dnsTime += requestStats.dnsTime;
+    stats.connectTime += requestStats.connectTime;
+    stats.sendTime += requestStats.sendTime;
+    stats.firstByteTime += requestStats.firstByteTime;
+    stats.totalTime += requestStats.totalTime;
+    if(requestStats.totalTime > stats.maxTotalTime) {
+      stats.maxTotalTime = requestStats.totalTime;
+    }
 
+    if(requestStats.status < 100) {
+      stats.failures++;
+    }
+    size_t iCode = 0;
+    while(iCode < THINGSPEAK_STATS_CODES && stats.statusCode[iCode] != 0 && stats.statusCode[iCode] != requestStats.status) {
+      iCode++;
+    }
+    if(iCode < THINGSPEAK_STATS_CODES) {
+      stats.statusCode[iCode] = requestStats.status;
+      stats.statusCount[iCode]++;
+    }
+    else {
+      stats.otherStatusCount++;
+    }
 
-  /*
-  Function: readIntField
+    size_t iBucket = 0;
+    for(uint32_t bucketEnd = 50000; iBucket < THINGSPEAK_STATS_BUCKETS - 1 && requestStats.totalTime >= bucketEnd; bucketEnd *= 2) {
+      iBucket++;
+    }
+    stats.histogram[iBucket]++;
 
-  Summary:
-  Read the latest int value from a private ThingSpeak channel
+    Callback<void(const ThingSpeakRequestStats &)> hook = this->statsHook;
+    this->connectionMutex.unlock();
 
-  Parameters:
-  channelNumber - Channel number
-  field - Field number (1-8) within the channel to read from.
-  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
+    if(hook) {
+      hook(requestStats);
+    }
+  }
+  #endif
+
+  void endRequest(ThingSpeakRequest * request) {
+    for(size_t i = 0; i < THINGSPEAK_POOL_SIZE; i++) {
+      PoolSlot * slot = &this->pool[i];
+      if(slot->request == request) {
+        slot->request = NULL;
+        delete request;
+        releasePoolSlot(slot);
+        return;
+      }
+    }
+  }
 
-  Returns:
-  Value read, or 0 if the field is text or there is an error.  Use getLastReadStatus() to get more specific information.  Note that NAN, INFINITY, and -INFINITY are valid results.
+  bool isConnectionClose(HttpResponse * response) {
+    return strcasecmp(getHeader(response, "Connection").c_str(), "close") == 0;
+  }
 
-  */
-  int readIntField(unsigned long channelNumber, unsigned int field, const char * readAPIKey) {
-    return readLongField(channelNumber, field, readAPIKey);
+  // Value of a response header, empty if the response has none of that name
+  string getHeader(HttpResponse * response, const char * name) {
+    for(size_t ix = 0; ix < response->get_headers_length(); ix++) {
+      if(strcasecmp(response->get_headers_fields()[ix]->c_str(), name) == 0) {
+        return *response->get_headers_values()[ix];
+      }
+    }
+    return string("");
   }
 
+  int getWriteFieldsContentLength(){
+    return getWriteFieldsContentLength(this->nextWrite);
+  }
 
-  /*
-  Function: readIntField
+  int getWriteFieldsContentLength(const ThingSpeakEntry & entry){
+    size_t contentLen = entry.getContentLength();
 
-  Summary:
-  Read the latest int value from a private ThingSpeak channel
+    if(contentLen == 0){
+      return 0;
+    }
 
-  Parameters:
-  channelNumber - Channel number
-  field - Field number (1-8) within the channel to read from.
+    // the location items are formatted when set, so they are counted like the fields
+    return (int)contentLen - 1; // subtract 1 for missing first '&'
+  }
 
-  Returns:
-  Value read, or 0 if the field is text or there is an error.  Use getLastReadStatus() to get more specific information.  Note that NAN, INFINITY, and -INFINITY are valid results.
+  // Index of the lowest set bit, mask must not be 0
+  static size_t ctz(uint16_t mask) {
+    size_t bit = 0;
+    while(!(mask & 1)) {
+      mask >>= 1;
+      bit++;
+    }
+    return bit;
+  }
 
-  */
-  int readIntField(unsigned long channelNumber, unsigned int field) {
-    return readLongField(channelNumber, field, NULL);
-  };
+  // Fills entry from the members of a flat JSON object in one pass, members unknown to a feed entry are skipped
+  bool parseFeedEntry(const char * json, size_t len, FeedEntry & entry) {
+    static const char * const keys[] = {
+      "field1", "field2", "field3", "field4", "field5", "field6", "field7", "field8",
+      "created_at", "entry_id", "status", "latitude", "longitude", "elevation"
+    };
+    const size_t keyCount = sizeof(keys) / sizeof(keys[0]);
+    ThingSpeakJSONValue values[keyCount];
+
+    if(!ThingSpeakJSON::scan(json, len, keys, values, keyCount)) {
+      return false;
+    }
 
+    char value[FIELDLENGTH_MAX + 1];
+    for(size_t i = 0; i < keyCount; i++) {
+      if(values[i].fFound && !values[i].fNull) {
+        entry.setValue(keys[i], value, ThingSpeakJSON::unescape(values[i], value, sizeof(value)));
+      }
+    }
+    return true;
+  }
 
-  /*
-  Function: readStatus
+  string getJSONValueByKey(const string & textToSearch, const char * key) {
+    ThingSpeakJSONValue value;
 
-  Summary:
-  Read the latest status from a private ThingSpeak channel
+    // values found before a syntax error are still valid
+    ThingSpeakJSON::scan(textToSearch.c_str(), textToSearch.length(), &key, &value, 1);
+    if(!value.fFound || value.fNull) {
+      // there is no such key or it's null
+      return string("");
+    }
 
-  Parameters:
-  channelNumber - Channel number
-  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
+    char unescaped[FIELDLENGTH_MAX + 1];
+    return string(unescaped, ThingSpeakJSON::unescape(value, unescaped, sizeof(unescaped)));
+  }
 
-  Results:
-  Value read (UTF8 string). An empty string is returned if there was no status written to the channel or in case of an error.  Use getLastReadStatus() to get more specific information.
 
-  */
-  string readStatus(unsigned long channelNumber, const char * readAPIKey) {
-    string content = readRaw(channelNumber, "/feeds/last.txt?status=true", readAPIKey);
+  // Size of the current multi-field update in the packed bulk entry format, 0 if there is nothing to send:
+  // 2 bytes item mask [, 4 bytes delta_t], then length byte and value for each item
+  size_t getBulkEntryLength(const ThingSpeakEntry & entry) {
+    uint16_t mask = entry.getMask() & BULK_ITEMS;
+    size_t entryLen = 2;
 
-    if(getLastReadStatus() != OK_SUCCESS) {
-      return string("");
+    if(!(mask & ~(1 << ThingSpeakEntry::ITEM_CREATED_AT))) {
+      return 0;
     }
 
-    return getJSONValueByKey(content, "status");
-  };
+    for(; mask != 0; mask &= (uint16_t)(mask - 1)) {
+      entryLen += 1 + entry.getLength(ctz(mask));
+    }
 
+    if(!entry.isSet(ThingSpeakEntry::ITEM_CREATED_AT)) {
+      entryLen += 4;
+    }
 
-  /*
-  Function: readStatus
+    return entryLen;
+  }
 
-  Summary:
-  Read the latest status from a private ThingSpeak channel
+  void encodeBulkEntry(char * record, unsigned long deltaT, const ThingSpeakEntry & entry) {
+    uint16_t mask = entry.getMask() & BULK_ITEMS;
+    size_t pos = 2;
 
-  Parameters:
-  channelNumber - Channel number
+    if(!entry.isSet(ThingSpeakEntry::ITEM_CREATED_AT)) {
+      for(size_t iByte = 0; iByte < 4; iByte++) {
+        record[pos++] = (char)((deltaT >> (8 * iByte)) & 0xFF);
+      }
+      mask |= BULK_FLAG_DELTA_T;
+    }
 
-  Results:
-  Value read (UTF8 string). An empty string is returned if there was no status written to the channel or in case of an error.  Use getLastReadStatus() to get more specific information.
+    for(uint16_t items = mask & BULK_ITEMS; items != 0; items &= (uint16_t)(items - 1)) {
+      size_t iItem = ctz(items);
+      size_t len = entry.getLength(iItem);
+      record[pos++] = (char)len;
+      memcpy(record + pos, entry.get(iItem), len);
+      pos += len;
+    }
 
-  */
-  string readStatus(unsigned long channelNumber) {
-    return readStatus(channelNumber, NULL);
-  };
+    record[0] = (char)(mask & 0xFF);
+    record[1] = (char)(mask >> 8);
+  }
 
+  size_t getBulkRecordLength(const char * record) {
+    uint16_t mask = (uint16_t)((uint8_t)record[0] | ((uint8_t)record[1] << 8));
+    size_t pos = 2;
 
-  /*
-  Function: readCreatedAt
+    if(mask & BULK_FLAG_DELTA_T) {
+      pos += 4;
+    }
+    for(uint16_t items = mask & BULK_ITEMS; items != 0; items &= (uint16_t)(items - 1)) {
+      pos += 1 + (uint8_t)record[pos];
+    }
+    return pos;
+  }
 
-  Summary:
-  Read the created-at timestamp associated with the latest update to a private ThingSpeak channel
+  // Serialises the collected bulk entries in the format set with setBulkFormat() and sets the path, returns the content type
+  const char * buildBulkBody(string & path, string & body) {
+    path = string("/channels/") + std::to_string(this->bulkChannelNumber);
+    const char * record = this->bulkBuffer;
+
+    const char * timeFormat = (this->bulkFormat == BULK_FORMAT_CSV) ? getBulkTimeFormat() : NULL;
+    if(NULL != timeFormat) {
+      path += "/bulk_update.csv";
+      body = "write_api_key=";
+      appendFormEscaped(body, this->bulkWriteAPIKey.c_str(), this->bulkWriteAPIKey.length());
+      body += "&time_format=";
+      body += timeFormat;
+      body += "&updates=";
+      for(unsigned int iEntry = 0; iEntry < this->bulkCount; iEntry++) {
+        if(iEntry > 0)
+          body += "|";
+        record += appendBulkEntryCSV(body, record);
+      }
+      return "application/x-www-form-urlencoded";
+    }
 
-  Parameters:
-  channelNumber - Channel number
-  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
+    path += "/bulk_update.json";
+    body = "{\"write_api_key\":\"";
+    appendJSONEscaped(body, this->bulkWriteAPIKey.c_str(), this->bulkWriteAPIKey.length());
+    body += "\",\"updates\":[";
+    for(unsigned int iEntry = 0; iEntry < this->bulkCount; iEntry++) {
+      if(iEntry > 0)
+        body += ",";
+      record += appendBulkEntryJSON(body, record);
+    }
+    body += "]}";
+    return "application/json";
+  }
 
-  Results:
-  Value read (UTF8 string). An empty string is returned if there was no created-at timestamp written to the channel or in case of an error.  Use getLastReadStatus() to get more specific information.
+  // Time format of the collected entries for the CSV format, NULL if relative and absolute ones are mixed
+  const char * getBulkTimeFormat() {
+    unsigned int relative = 0;
+    const char * record = this->bulkBuffer;
+    for(unsigned int iEntry = 0; iEntry < this->bulkCount; iEntry++) {
+      if((uint8_t)record[1] & (BULK_FLAG_DELTA_T >> 8)) {
+        relative++;
+      }
+      record += getBulkRecordLength(record);
+    }
+    if(relative == this->bulkCount) {
+      return "relative";
+    }
+    return (relative == 0) ? "absolute" : NULL;
+  }
 
+  /*
+  Appends one packed bulk entry as CSV row, returns the size of the packed entry. The columns are the timestamp, field1 to
+  field8, latitude, longitude, elevation and status, trailing empty columns are left out.
   */
-  string readCreatedAt(unsigned long channelNumber, const char * readAPIKey) {
-    string content = readRaw(channelNumber, "/feeds/last.txt", readAPIKey);
-
-    if(getLastReadStatus() != OK_SUCCESS) {
-      return string("");
+  size_t appendBulkEntryCSV(string & body, const char * record) {
+    uint16_t mask = (uint16_t)((uint8_t)record[0] | ((uint8_t)record[1] << 8));
+    size_t pos = 2;
+    const char * values[ThingSpeakEntry::ITEM_COUNT];
+    size_t lengths[ThingSpeakEntry::ITEM_COUNT];
+
+    if(mask & BULK_FLAG_DELTA_T) {
+      unsigned long deltaT = 0;
+      for(size_t iByte = 0; iByte < 4; iByte++) {
+        deltaT |= (unsigned long)(uint8_t)record[pos++] << (8 * iByte);
+      }
+      char number[THINGSPEAK_NUMBER_LENGTH];
+      body.append(number, ThingSpeakPayload::formatLong(number, (long)deltaT));
+    }
+    for(uint16_t items = mask & BULK_ITEMS; items != 0; items &= (uint16_t)(items - 1)) {
+      size_t iItem = ctz(items);
+      lengths[iItem] = (uint8_t)record[pos++];
+      values[iItem] = record + pos;
+      pos += lengths[iItem];
+    }
+    if(mask & (1 << ThingSpeakEntry::ITEM_CREATED_AT)) {
+      appendCSVValue(body, values[ThingSpeakEntry::ITEM_CREATED_AT], lengths[ThingSpeakEntry::ITEM_CREATED_AT]);
     }
 
-    return getJSONValueByKey(content, "created_at");
-  };
+    // the items in the order of the columns after the timestamp, up to the last one set
+    static const uint8_t columns[] = { 0, 1, 2, 3, 4, 5, 6, 7, ThingSpeakEntry::ITEM_LATITUDE, ThingSpeakEntry::ITEM_LONGITUDE,
+      ThingSpeakEntry::ITEM_ELEVATION, ThingSpeakEntry::ITEM_STATUS };
+    size_t columnCount = sizeof(columns);
+    while(columnCount > 0 && !(mask & (1 << columns[columnCount - 1]))) {
+      columnCount--;
+    }
+    for(size_t iColumn = 0; iColumn < columnCount; iColumn++) {
+      size_t iItem = columns[iColumn];
+      body += ",";
+      if(mask & (1 << iItem)) {
+        appendCSVValue(body, values[iItem], lengths[iItem]);
+      }
+    }
 
+    return pos;
+  }
 
-  /*
-  Function: readCreatedAt
+  // Appends a CSV value form encoded, values holding a separator are quoted
+  void appendCSVValue(string & out, const char * value, size_t len) {
+    bool fQuote = false;
+    for(size_t ix = 0; ix < len && !fQuote; ix++) {
+      fQuote = (value[ix] == ',' || value[ix] == '|' || value[ix] == '"' || value[ix] == '\n' || value[ix] == '\r');
+    }
+    if(!fQuote) {
+      appendFormEscaped(out, value, len);
+      return;
+    }
 
-  Summary:
-  Read the created-at timestamp associated with the latest update to a private ThingSpeak channel
+    out += "%22";
+    for(size_t ix = 0; ix < len; ix++) {
+      if(value[ix] == '"') {
+        out += "%22%22";
+      }
+      else {
+        appendFormEscaped(out, value + ix, 1);
+      }
+    }
+    out += "%22";
+  }
 
-  Parameters:
-  channelNumber - Channel number
+  // Appends a value of an application/x-www-form-urlencoded body, characters with a meaning in it are percent-encoded
+  void appendFormEscaped(string & out, const char * value, size_t len) {
+    static const char hexDigits[] = "0123456789ABCDEF";
+    for(size_t ix = 0; ix < len; ix++) {
+      unsigned char c = (unsigned char)value[ix];
+      if(c <= 0x20 || c >= 0x7F || c == '%' || c == '&' || c == '+' || c == '=' || c == '#' || c == '"') {
+        out += '%';
+        out += hexDigits[c >> 4];
+        out += hexDigits[c & 0x0F];
+      }
+      else {
+        out += (char)c;
+      }
+    }
+  }
 
-  Results:
-  Value read (UTF8 string). An empty string is returned if there was no created-at timestamp written to the channel or in case of an error.  Use getLastReadStatus() to get more specific information.
+  // Appends one packed bulk entry as JSON object, returns the size of the packed entry
+  size_t appendBulkEntryJSON(string & body, const char * record) {
+    uint16_t mask = (uint16_t)((uint8_t)record[0] | ((uint8_t)record[1] << 8));
+    size_t pos = 2;
+    bool fFirstItem = true;
 
-  */
-  string readCreatedAt(unsigned long channelNumber) {
-    return readCreatedAt(channelNumber, NULL);
-  };
+    body += "{";
+    if(mask & BULK_FLAG_DELTA_T) {
+      unsigned long deltaT = 0;
+      for(size_t iByte = 0; iByte < 4; iByte++) {
+        deltaT |= (unsigned long)(uint8_t)record[pos++] << (8 * iByte);
+      }
+      body += "\"delta_t\":";
+      body += std::to_string(deltaT);
+      fFirstItem = false;
+    }
+
+    for(uint16_t items = mask & BULK_ITEMS; items != 0; items &= (uint16_t)(items - 1)) {
+      size_t len = (uint8_t)record[pos++];
+      if(!fFirstItem)
+        body += ",";
+      body += "\"";
+      body += ThingSpeakEntry::getBulkItemName(ctz(items));
+      body += "\":\"";
+      appendJSONEscaped(body, record + pos, len);
+      body += "\"";
+      pos += len;
+      fFirstItem = false;
+    }
+    body += "}";
 
+    return pos;
+  }
 
   /*
-  Function: readRaw
+  Implements queueFields(), with fElapsed deltaT is derived from the time since the previously queued entry. The queue is
+  read and changed with writeMutex locked only, flush(), writeStored() and the wake windows send it from other threads.
+  */
+  int queueEntry(unsigned long channelNumber, const char * writeAPIKey, unsigned long deltaT, bool fElapsed) {
+    THINGSPEAK_HEAP_PROBE("queueFields");
+    int status = OK_SUCCESS;
 
-  Summary:
-  Read a raw response from a public ThingSpeak channel
+    this->writeMutex.lock();
+    closeAccumulators();
 
-  Parameters:
-  channelNumber - Channel number
-  URLSuffix - Raw URL to write to ThingSpeak as a String.  See the documentation at https://thingspeak.com/docs/channels#get_feed
+    if(fElapsed) {
+      deltaT = 0;
+      if(this->bulkCount > 0) {
+        deltaT = (unsigned long)((Kernel::get_ms_count() - this->bulkLastQueued + 500) / 1000);
+      }
+    }
 
-  Returns:
-  Response if successful, or empty string. Use getLastReadStatus() to get more specific information.
+    size_t entryLen = getBulkEntryLength(this->nextWrite);
+    if(entryLen == 0) {
+      this->writeMutex.unlock();
+      #ifdef PRINT_DEBUG_MESSAGES
+        printf("ERR_SETFIELD_NOT_CALLED\n");
+      #endif
+      return ERR_SETFIELD_NOT_CALLED;
+    }
+    if(entryLen > THINGSPEAK_BULK_BUFFER_SIZE) {
+      this->writeMutex.unlock();
+      return ERR_OUT_OF_RANGE;
+    }
 
-  Notes:
-  This is low level functionality that will not be required by most users.
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::queueFields   (channelNumber: %lu writeAPIKey: %s deltaT: %lu entries: %u)\n", channelNumber, writeAPIKey, deltaT, this->bulkCount);
+    #endif
 
-  */
-  string readRaw(unsigned long channelNumber, string URLSuffix) {
-    return readRaw(channelNumber, URLSuffix, NULL);
-  }
+    // A bulk update belongs to one channel, send what was collected for the previous one
+    if(this->bulkCount > 0 && this->bulkChannelNumber != channelNumber) {
+      status = writeBulk();
+      if(status != OK_SUCCESS) {
+        this->writeMutex.unlock();
+        return status;
+      }
+    }
 
+    // Make room for the new entry, store or drop the oldest ones if they can't be sent
+    while(this->bulkCount > 0 && (this->bulkCount >= THINGSPEAK_BULK_MAX_ENTRIES || this->bulkLength + entryLen > THINGSPEAK_BULK_BUFFER_SIZE)) {
+      status = writeBulk();
+      if(status != OK_SUCCESS)
+        evictOldestBulkEntry();
+    }
 
-  /*
-  Function: readRaw
+    if(this->bulkCount == 0) {
+      this->bulkChannelNumber = channelNumber;
+      this->bulkWriteAPIKey = writeAPIKey;
+    }
 
-  Summary:
-  Read a raw response from a public ThingSpeak channel
+    encodeBulkEntry(this->bulkBuffer + this->bulkLength, deltaT, this->nextWrite);
+    this->bulkLength += entryLen;
+    this->bulkCount++;
+    this->bulkLastQueued = Kernel::get_ms_count();
+    resetWriteFields();
 
-  Parameters:
-  channelNumber - Channel number
-  URLSuffix - Raw URL to write to ThingSpeak as a String.  See the documentation at https://thingspeak.com/docs/channels#get_feed
-  readAPIKey - Read API key associated with the channel.  *If you share code with others, do _not_ share this key*
+    if(this->bulkCount >= THINGSPEAK_BULK_MAX_ENTRIES) {
+      status = writeBulk();
+    }
 
-  Returns:
-  Response if successful, or empty string. Use getLastReadStatus() to get more specific information.
+    this->writeMutex.unlock();
+    return status;
+  };
 
-  Notes:
-  This is low level functionality that will not be required by most users.
+  // Removes the oldest collected entry, it is moved to the store if one is mounted. Call with writeMutex locked.
+  void evictOldestBulkEntry() {
+    size_t recordLen = getBulkRecordLength(this->bulkBuffer);
+    bool fStored = NULL != this->store && storeBulkRecord(this->bulkBuffer, recordLen);
 
-  */
-  string readRaw(unsigned long channelNumber, string URLSuffix, const char * readAPIKey) {
     #ifdef PRINT_DEBUG_MESSAGES
-      printf("ts::readRaw   (channelNumber: %lu", channelNumber);
-      if(NULL != readAPIKey) {
-        printf(" readAPIKey: %s", readAPIKey);
+      printf("ts::queueFields   oldest entry %s\n", fStored ? "stored" : "dropped");
+    #endif
+    #if THINGSPEAK_STATS
+      this->connectionMutex.lock();
+      if(fStored) {
+        this->stats.bulkStored++;
       }
-      printf(" URLSuffix: \"%s\")\n", URLSuffix.c_str());
+      else {
+        this->stats.bulkDropped++;
+      }
+      this->connectionMutex.unlock();
+    #else
+      (void)fStored;
     #endif
 
-    string URL = string("http://api.thingspeak.com/channels/") + std::to_string(channelNumber) + URLSuffix;
+    memmove(this->bulkBuffer, this->bulkBuffer + recordLen, this->bulkLength - recordLen);
+    this->bulkLength -= recordLen;
+    this->bulkCount--;
+  }
+
+  // Appends the oldest collected entry to the store, a relative timestamp is replaced by a created-at time first
+  bool storeBulkRecord(const char * record, size_t recordLen) {
+    uint16_t mask = (uint16_t)((uint8_t)record[0] | ((uint8_t)record[1] << 8));
+    if(!(mask & BULK_FLAG_DELTA_T)) {
+      return recordLen <= THINGSPEAK_STORE_BUFFER_SIZE && this->store->append(record, recordLen);
+    }
 
-    #ifdef PRINT_DEBUG_MESSAGES
-      printf("               GET \"%s\"\n", URL.c_str());
-    #endif
+    time_t createdAt;
+    if(!getOldestBulkTime(&createdAt)) {
+      return false;
+    }
+    char stamp[CREATED_AT_LENGTH];
+    size_t stampLen = formatCreatedAt(stamp, createdAt);
+    if(recordLen - 4 + 1 + stampLen > THINGSPEAK_STORE_BUFFER_SIZE) {
+      return false;
+    }
 
-    // Post data to thingspeak
-    HttpRequest* request = new HttpRequest(this->net, HTTP_GET, URL.c_str());
-    request->set_header("User-Agent", TS_USER_AGENT);
-    if(NULL != readAPIKey)
-      request->set_header("X-THINGSPEAKAPIKEY", readAPIKey);
+    // the items in the same order, with created_at inserted at its place
+    char * entry = this->store->getEntryBuffer();
+    uint16_t entryMask = (uint16_t)((mask & BULK_ITEMS) | (1 << ThingSpeakEntry::ITEM_CREATED_AT));
+    size_t pos = 6;
+    size_t entryLen = 2;
+    entry[0] = (char)(entryMask & 0xFF);
+    entry[1] = (char)(entryMask >> 8);
+    for(uint16_t items = entryMask; items != 0; items &= (uint16_t)(items - 1)) {
+      if(ctz(items) == ThingSpeakEntry::ITEM_CREATED_AT) {
+        entry[entryLen++] = (char)stampLen;
+        memcpy(entry + entryLen, stamp, stampLen);
+        entryLen += stampLen;
+      }
+      else {
+        size_t len = 1 + (uint8_t)record[pos];
+        memcpy(entry + entryLen, record + pos, len);
+        entryLen += len;
+        pos += len;
+      }
+    }
+    return this->store->append(entry, entryLen);
+  }
 
-    const char body[] = "";
-    HttpResponse* response = request->send(body, strlen(body));
-    #ifdef PRINT_HTTP
-      printf("\n----- HTTP GET response -----\n");
-      printf("Status: %d - %s\n", response->get_status_code(), response->get_status_message().c_str());
+  /*
+  Traces the time of the oldest collected entry back from the RTC over the relative timestamps of the entries after it.
+  Returns false if the RTC is not set or one of them has a created-at time instead.
+  */
+  bool getOldestBulkTime(time_t * createdAt) {
+    time_t now = time(NULL);
+    if(now <= THINGSPEAK_RTC_VALID) {
+      return false;
+    }
 
-      printf("Headers:\n");
-      for (size_t ix = 0; ix < response->get_headers_length(); ix++) {
-        printf("\t%s: %s\n", response->get_headers_fields()[ix]->c_str(), response->get_headers_values()[ix]->c_str());
+    uint64_t age = (Kernel::get_ms_count() - this->bulkLastQueued + 500) / 1000;
+    const char * record = this->bulkBuffer + getBulkRecordLength(this->bulkBuffer);
+    for(unsigned int iEntry = 1; iEntry < this->bulkCount; iEntry++) {
+      if(!((uint8_t)record[1] & (BULK_FLAG_DELTA_T >> 8))) {
+        return false;
       }
-      printf("\nBody (%d bytes):\n%s\n", response->get_body_length(), response->get_body_as_string().c_str());
-    #endif
+      for(size_t iByte = 0; iByte < 4; iByte++) {
+        age += (uint64_t)(uint8_t)record[2 + iByte] << (8 * iByte);
+      }
+      record += getBulkRecordLength(record);
+    }
+    *createdAt = now - (time_t)age;
+    return true;
+  }
 
-    this->lastReadStatus = response->get_status_code();
+  void appendJSONEscaped(string & out, const char * value, size_t len) {
+    static const char hexDigits[] = "0123456789abcdef";
+    for(size_t ix = 0; ix < len; ix++) {
+      char c = value[ix];
+      if(c == '"' || c == '\\') {
+        out += '\\';
+        out += c;
+      }
+      else if((unsigned char)c < 0x20) {
+        out += "\\u00";
+        out += hexDigits[(c >> 4) & 0x0F];
+        out += hexDigits[c & 0x0F];
+      }
+      else {
+        out += c;
+      }
+    }
+  }
 
+  // Ends a write that ran out of time, the update may have been inserted anyway so it is not kept for the next write
+  int abortWriteRaw(int status) {
     #ifdef PRINT_DEBUG_MESSAGES
-      if(this->lastReadStatus == OK_SUCCESS) {
-        printf("Read: \"%s\"\n", response->get_body_as_string().c_str());
-      }
+      printf("WriteRaw abort (%d).\n", status);
     #endif
-    string ret =string(response->get_body_as_string().c_str());
-    delete request;
+    resetWriteFields();
+    return status;
+  }
 
+  string abortReadRaw(int status) {
     #ifdef PRINT_DEBUG_MESSAGES
-      printf("disconnected.\n");
+      printf("ReadRaw abort (%d).\n", status);
     #endif
+    this->lastReadStatus = status;
+    return string("");
+  }
 
-    if(this->lastReadStatus != OK_SUCCESS) {
-      return string("");
+  void resetWriteFields() {
+    this->nextWrite.reset();
+  };
+
+  // Sets the aggregates of the fields fed with accumulate() in the multi-field update and starts new windows
+  void closeAccumulators() {
+    for(unsigned int iField = 0; iField < FIELDNUM_MAX; iField++) {
+      float value;
+      if(this->accumulators[iField].take(&value)) {
+        if(this->accumulators[iField].aggregation == AGGREGATE_COUNT) {
+          this->nextWrite.setField(iField + 1, (long)value);
+        }
+        else {
+          this->nextWrite.setField(iField + 1, value);
+        }
+      }
     }
+  };
+
+  // Update transport over HTTP POST /update, the default
+  class HTTPTransport : public ThingSpeakTransport
+  {
+    public:
+    virtual int update(unsigned long, const char * writeAPIKey, const char * body, size_t bodyLen, long * entryID) {
+      return this->ts->postUpdate(writeAPIKey, body, bodyLen, entryID, 0);
+    };
 
-    return ret;
+    ThingSpeak *ts;
   };
 
+  // Pending update of a channel written with scheduleFields()
+  struct Schedule {
+    unsigned long channelNumber;
+    string writeAPIKey;
+    unsigned long interval;
+    uint64_t lastWrite;
+    bool fWritten;
+    int eventID;
+    ThingSpeakEntry pending;
+    uint8_t aggregation[FIELDNUM_MAX];
+    float aggregate[FIELDNUM_MAX];
+    unsigned int samples[FIELDNUM_MAX];
+  };
 
-  /*
-  Function: getLastReadStatus
+  // Finds the schedule of a channel or creates it, returns NULL if all are in use. Call with scheduleMutex locked.
+  Schedule * getSchedule(unsigned long channelNumber) {
+    for(size_t i = 0; i < THINGSPEAK_SCHEDULE_CHANNELS; i++) {
+      if(NULL != this->schedules[i] && this->schedules[i]->channelNumber == channelNumber) {
+        return this->schedules[i];
+      }
+    }
+    for(size_t i = 0; i < THINGSPEAK_SCHEDULE_CHANNELS; i++) {
+      if(NULL == this->schedules[i]) {
+        Schedule * schedule = new Schedule();
+        schedule->channelNumber = channelNumber;
+        schedule->interval = THINGSPEAK_UPDATE_INTERVAL;
+        schedule->lastWrite = 0;
+        schedule->fWritten = false;
+        schedule->eventID = 0;
+        for(size_t iField = 0; iField < FIELDNUM_MAX; iField++) {
+          schedule->aggregation[iField] = AGGREGATE_LAST;
+          schedule->samples[iField] = 0;
+        }
+        this->schedules[i] = schedule;
+        return schedule;
+      }
+    }
+    return NULL;
+  }
 
-  Summary:
-  Get the status of the previous read.
+  // Merges the items of entry into the pending update, returns false if they don't fit. Call with scheduleMutex locked.
+  bool mergeScheduled(Schedule * schedule, const ThingSpeakEntry & entry) {
+    bool fMerged = true;
+
+    for(uint16_t mask = entry.getMask(); mask != 0; mask &= (uint16_t)(mask - 1)) {
+      size_t iItem = ctz(mask);
+      const char * value = entry.get(iItem);
+      size_t valueLen = entry.getLength(iItem);
+      char number[THINGSPEAK_NUMBER_LENGTH];
+
+      if(iItem < FIELDNUM_MAX && schedule->aggregation[iItem] != AGGREGATE_LAST && valueLen < sizeof(number)) {
+        memcpy(number, value, valueLen);
+        number[valueLen] = '\0';
+        char * numberEnd;
+        float sample = strtof(number, &numberEnd);
+        if(valueLen > 0 && *numberEnd == '\0') {
+          // Min and max keep the text of the sample, the mean is formatted
+          bool fReplace = true;
+          if(schedule->samples[iItem] == 0 || !schedule->pending.isSet(iItem)) {
+            schedule->samples[iItem] = 0;
+            schedule->aggregate[iItem] = sample;
+          }
+          else if(schedule->aggregation[iItem] == AGGREGATE_MIN) {
+            fReplace = sample < schedule->aggregate[iItem];
+            schedule->aggregate[iItem] = fReplace ? sample : schedule->aggregate[iItem];
+          }
+          else if(schedule->aggregation[iItem] == AGGREGATE_MAX) {
+            fReplace = sample > schedule->aggregate[iItem];
+            schedule->aggregate[iItem] = fReplace ? sample : schedule->aggregate[iItem];
+          }
+          else {
+            schedule->aggregate[iItem] += sample;
+          }
+          schedule->samples[iItem]++;
+
+          if(schedule->aggregation[iItem] == AGGREGATE_MEAN && schedule->samples[iItem] > 1) {
+            valueLen = ThingSpeakPayload::formatFloat(number, schedule->aggregate[iItem] / schedule->samples[iItem], THINGSPEAK_FLOAT_DECIMALS, true);
+            value = number;
+          }
+          else if(!fReplace) {
+            continue;
+          }
+        }
+        else {
+          schedule->samples[iItem] = 0;
+        }
+      }
 
-  Returns:
-  Generally, these are HTTP status codes.  Negative values indicate an error generated by the library.
-  Possible response codes...
-  200 - OK / Success
-  404 - Incorrect API key (or invalid ThingSpeak server address)
-  -101 - Value is out of range or string is too long (> 255 characters)
-  -201 - Invalid field number specified
-  -210 - setField() was not called before writeFields()
-  -301 - Failed to connect to ThingSpeak
-  -302 -  Unexpected failure during write to ThingSpeak
-  -303 - Unable to parse response
-    -304 - Timeout waiting for server to respond
-  -401 - Point was not inserted (most probable cause is exceeding the rate limit)
+      fMerged = schedule->pending.set(iItem, value, valueLen) && fMerged;
+    }
 
-  Notes:
-  The read functions will return zero or empty if there is an error.  Use this function to retrieve the details.
-  */
-  int getLastReadStatus() {
-    return this->lastReadStatus;
-  };
+    return fMerged;
+  }
 
-  
-  private:
+  // Queues the send of the pending update for the end of the interval. Call with scheduleMutex locked.
+  int armSchedule(Schedule * schedule) {
+    uint64_t now = Kernel::get_ms_count();
+    uint64_t due = schedule->fWritten ? schedule->lastWrite + schedule->interval : now;
+    int delay = due > now ? (int)(due - now) : 0;
 
-  int getWriteFieldsContentLength(){
-    size_t iField;
-    int contentLen = 0;
+    startAsyncQueue();
+    schedule->eventID = this->asyncQueue->call_in(delay, this, &ThingSpeak::runSchedule, schedule);
+    return schedule->eventID == 0 ? ERR_QUEUE_FULL : OK_SUCCESS;
+  }
+
+  void runSchedule(Schedule * schedule) {
+    this->scheduleMutex.lock();
+    schedule->eventID = 0;
+
+    // Keep the update sent so it can be merged again if ThingSpeak does not accept it
+    ThingSpeakEntry sending = schedule->pending;
+    float aggregate[FIELDNUM_MAX];
+    unsigned int samples[FIELDNUM_MAX];
+    memcpy(aggregate, schedule->aggregate, sizeof(aggregate));
+    memcpy(samples, schedule->samples, sizeof(samples));
+    string writeAPIKey = schedule->writeAPIKey;
+    schedule->pending.reset();
+    for(size_t iField = 0; iField < FIELDNUM_MAX; iField++) {
+      schedule->samples[iField] = 0;
+    }
+    this->scheduleMutex.unlock();
+
+    size_t bodyCapacity = sending.getContentLength() + 16;
+    char * bodyBuffer = new char[bodyCapacity];
+    ThingSpeakPayload body(bodyBuffer, bodyCapacity);
+    long entryID = 0;
+    int status = ERR_OUT_OF_RANGE;
+    if(buildWriteFieldsBody(body, sending)) {
+      status = this->transport->update(schedule->channelNumber, writeAPIKey.c_str(), body.c_str(), body.length(), &entryID);
+    }
+    delete[] bodyBuffer;
 
-    for(iField = 0; iField < FIELDNUM_MAX; iField++) {
-      if(this->nextWriteField[iField].length() > 0) {
-        contentLen = contentLen + 8 + this->nextWriteField[iField].length();  // &fieldX=[value]
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::runSchedule   (channelNumber: %lu status: %d entryID: %ld)\n", schedule->channelNumber, status, entryID);
+    #endif
 
-        // future-proof in case ThingSpeak allows 999 fields someday
-        if(iField > 9) {
-          contentLen = contentLen + 1;
-        }
-        else if(iField > 99) {
-          contentLen = contentLen + 2;
+    this->scheduleMutex.lock();
+    // The interval starts again with any answer, a rejected update counts as a write attempt
+    schedule->lastWrite = Kernel::get_ms_count();
+    schedule->fWritten = true;
+    if(status != OK_SUCCESS && status != ERR_OUT_OF_RANGE) {
+      // Newer values win, the aggregates continue with the older samples
+      for(uint16_t mask = sending.getMask() & ~schedule->pending.getMask(); mask != 0; mask &= (uint16_t)(mask - 1)) {
+        size_t iItem = ctz(mask);
+        schedule->pending.set(iItem, sending.get(iItem), sending.getLength(iItem));
+        if(iItem < FIELDNUM_MAX) {
+          schedule->aggregate[iItem] = aggregate[iItem];
+          schedule->samples[iItem] = samples[iItem];
         }
       }
     }
-
-    /*
-     * ToDo oh
-    if(!isnan(this->nextWriteLatitude)){
-      contentLen = contentLen + 5 + string(this->nextWriteLatitude).length(); // &lat=[value]
+    if(schedule->pending.getContentLength() > 0) {
+      armSchedule(schedule);
     }
+    Callback<void(unsigned long, int, long)> done = this->scheduleDone;
+    this->scheduleMutex.unlock();
 
-    if(!isnan(this->nextWriteLongitude)){
-      contentLen = contentLen + 6 + string(this->nextWriteLongitude).length(); // &long=[value]
+    if(done) {
+      done(schedule->channelNumber, status, entryID);
     }
+  }
 
-    if(!isnan(this->nextWriteElevation)){
-      contentLen = contentLen + 11 + string(this->nextWriteElevation).length(); // &elevation=[value]
-    }
-    */
+  // Moves the stored updates to ThingSpeak with bulk updates. Call with writeMutex locked.
+  int forwardStored(unsigned long channelNumber, const char * writeAPIKey) {
+    int status = OK_SUCCESS;
+
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::writeStored   (channelNumber: %lu writeAPIKey: %s pending: %u)\n", channelNumber, writeAPIKey, this->store->getPendingCount());
+    #endif
+
+    while(this->store->getPendingCount() > 0) {
+      // A bulk update belongs to one channel, send what was collected for another one
+      if(this->bulkCount > 0 && this->bulkChannelNumber != channelNumber) {
+        status = writeBulk();
+        if(status != OK_SUCCESS)
+          return status;
+      }
+      if(this->bulkCount == 0) {
+        this->bulkChannelNumber = channelNumber;
+        this->bulkWriteAPIKey = writeAPIKey;
+      }
+
+      // Stored entries have the bulk entry format, they go to the bulk buffer as they are
+      size_t bulkStart = this->bulkLength;
+      unsigned int count = 0;
+      uint32_t sequence, offset;
+      this->store->getReadPosition(&sequence, &offset);
+      while(this->bulkCount < THINGSPEAK_BULK_MAX_ENTRIES) {
+        uint32_t nextSequence = sequence;
+        uint32_t nextOffset = offset;
+        size_t entryLen = this->store->readNext(&nextSequence, &nextOffset, this->bulkBuffer + this->bulkLength, THINGSPEAK_BULK_BUFFER_SIZE - this->bulkLength);
+        if(entryLen == 0)
+          break;
+        sequence = nextSequence;
+        offset = nextOffset;
+        this->bulkLength += entryLen;
+        this->bulkCount++;
+        count++;
+      }
+
+      if(count == 0) {
+        if(this->bulkCount == 0) {
+          // Pending entries which can't be read back
+          return ERR_STORE_FAILED;
+        }
+        // No room left next to the queued entries
+        status = writeBulk();
+        if(status != OK_SUCCESS)
+          return status;
+        continue;
+      }
 
-    if(this->nextWriteStatus.length() > 0){
-      contentLen = contentLen + 8 + this->nextWriteStatus.length();  // &status=[value]
+      status = writeBulk();
+      if(status != OK_SUCCESS) {
+        // Leave the entries in the store
+        this->bulkLength = bulkStart;
+        this->bulkCount -= count;
+        return status;
+      }
+      if(!this->store->commit(sequence, offset, count)) {
+        return ERR_STORE_FAILED;
+      }
     }
 
-    if(this->nextWriteTwitter.length() > 0){
-      contentLen = contentLen + 9 + this->nextWriteTwitter.length();  // &twitter=[value]
+    return status;
+  };
+
+  // Sets the created-at time of entry from the RTC if it is set and entry has none, returns false if entry has no time then
+  bool stampCreatedAt(ThingSpeakEntry & entry) {
+    if(entry.isSet(ThingSpeakEntry::ITEM_CREATED_AT)) {
+      return true;
+    }
+    time_t now = time(NULL);
+    if(now <= THINGSPEAK_RTC_VALID) {
+      return false;
     }
+    char createdAt[CREATED_AT_LENGTH];
+    return entry.set(ThingSpeakEntry::ITEM_CREATED_AT, createdAt, formatCreatedAt(createdAt, now));
+  };
+
+  // Writes t as created-at time in ISO 8601 to createdAt (CREATED_AT_LENGTH bytes), returns the number of characters
+  static size_t formatCreatedAt(char * createdAt, time_t t) {
+    return strftime(createdAt, CREATED_AT_LENGTH, "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+  };
+
+  // True if an update that failed with status is kept by the store for writeStored()
+  bool isStorable(int status) {
+    return NULL != this->store && (status == ERR_CONNECT_FAILED || status == ERR_TIMEOUT || status >= 500);
+  };
 
-    if(this->nextWriteTweet.length() > 0){
-      contentLen = contentLen + 7 + this->nextWriteTweet.length();  // &tweet=[value]
+  /*
+  Completes the packed bulk entry of a failed TypedChannel update and appends it to the store. TypedChannel encoded the
+  items of mask into the entry buffer of the store from offset 2 up to entryLen, the created-at time of the RTC is added
+  as the last item. Returns false if the RTC is not set or the store failed. Call with writeMutex locked.
+  */
+  bool storeTypedEntry(uint16_t mask, size_t entryLen) {
+    time_t now = time(NULL);
+    char * entry = this->store->getEntryBuffer();
+    if(now <= THINGSPEAK_RTC_VALID || entryLen + 1 + CREATED_AT_LENGTH > THINGSPEAK_STORE_BUFFER_SIZE) {
+      return false;
     }
 
-    if(this->nextWriteCreatedAt.length() > 0){
-      contentLen = contentLen + 12 + this->nextWriteCreatedAt.length();  // &created_at=[value]
+    mask |= (uint16_t)(1 << ThingSpeakEntry::ITEM_CREATED_AT);
+    entry[0] = (char)(mask & 0xFF);
+    entry[1] = (char)(mask >> 8);
+    size_t createdAtLen = formatCreatedAt(entry + entryLen + 1, now);
+    entry[entryLen] = (char)createdAtLen;
+    entryLen += 1 + createdAtLen;
+
+    #ifdef PRINT_DEBUG_MESSAGES
+      printf("ts::TypedChannel::write   stored for later (%u pending)\n", this->store->getPendingCount() + 1);
+    #endif
+    return this->store->append(entry, entryLen);
+  };
+
+  /*
+  Encodes the staged update into the entry buffer of the store and sets *entryLen. Stored entries are replayed after a
+  reset, so relative timestamps would be meaningless and an entry needs a created-at time. Returns OK_SUCCESS,
+  ERR_NO_TIMESTAMP or ERR_OUT_OF_RANGE if the entry does not fit into the store.
+  */
+  int prepareStoreEntry(ThingSpeakEntry & entry, size_t * entryLen) {
+    if(!stampCreatedAt(entry)) {
+      return ERR_NO_TIMESTAMP;
     }
 
-    if(contentLen == 0){
-      return 0;
+    *entryLen = getBulkEntryLength(entry);
+    if(*entryLen == 0 || *entryLen > THINGSPEAK_STORE_BUFFER_SIZE) {
+      return ERR_OUT_OF_RANGE;
     }
+    encodeBulkEntry(this->store->getEntryBuffer(), 0, entry);
+    return OK_SUCCESS;
+  };
+
+  // Items of a bulk entry, twitter and tweet are not supported by bulk updates
+  static const uint16_t BULK_ITEMS = 0x00FF | (1 << ThingSpeakEntry::ITEM_STATUS) | (1 << ThingSpeakEntry::ITEM_CREATED_AT) |
+    (1 << ThingSpeakEntry::ITEM_LATITUDE) | (1 << ThingSpeakEntry::ITEM_LONGITUDE) | (1 << ThingSpeakEntry::ITEM_ELEVATION);
+  static const uint16_t BULK_FLAG_DELTA_T = 0x8000;
+  static const size_t CREATED_AT_LENGTH = 24;  // "YYYY-MM-DDTHH:MM:SSZ" and the terminating zero
+
+  PoolSlot pool[THINGSPEAK_POOL_SIZE];
+  unsigned int nextPoolSlot;
+  unsigned int retryAttempts;
+  uint32_t retryBaseDelay;
+  uint32_t retryMaxDelay;
+  Callback<bool(int)> retryable;
+  uint32_t jitterState;
+  uint32_t requestTimeout;
+  Mutex connectionMutex;    // guards nextPoolSlot, the statistics and the hook
+  bool fPowerManaged;
+  bool fNetworkUp;
+  bool fDeepSleepLocked;
+  unsigned int networkUsers;
+  uint32_t flushInterval;
+  int flushEventID;
+  Callback<void()> onWake;
+  Mutex powerMutex;         // guards the power management and the state of the interface
+  #if THINGSPEAK_READ_CACHE > 0
+  ThingSpeakReadCache readCache;
+  Mutex readCacheMutex;
+  uint32_t readCacheTTL;
+  #endif
+  Mutex writeMutex;
+  HTTPTransport httpTransport;
+  ThingSpeakTransport *transport;
+  #if THINGSPEAK_STATS
+  ThingSpeakStats stats;
+  Callback<void(const ThingSpeakRequestStats &)> statsHook;
+  #endif
+  EventQueue *asyncQueue;
+  Thread *asyncThread;
+  #if THINGSPEAK_POOL_SIZE > 1
+  EventQueue *fanOutQueues[THINGSPEAK_POOL_SIZE - 1];
+  Thread *fanOutThreads[THINGSPEAK_POOL_SIZE - 1];
+  size_t fanOutCount;
+  bool fFanOutFailed;
+  Mutex fanOutMutex;        // guards the start of the helper threads
+  #endif
+  NetworkInterface *net;
+  WriteContext nextWrite;
+  ThingSpeakAccumulator accumulators[FIELDNUM_MAX];
+  int lastReadStatus;
+  char payloadBuffer[THINGSPEAK_PAYLOAD_SIZE];
+  char *payload;
+  size_t payloadCapacity;
+  char bulkBuffer[THINGSPEAK_BULK_BUFFER_SIZE];
+  size_t bulkLength;
+  unsigned int bulkCount;
+  unsigned long bulkChannelNumber;
+  string bulkWriteAPIKey;
+  uint64_t bulkLastQueued;
+  int bulkFormat;
+  ThingSpeakStore *store;
+  Mutex scheduleMutex;
+  Schedule *schedules[THINGSPEAK_SCHEDULE_CHANNELS];
+  Callback<void(unsigned long, int, long)> scheduleDone;
+};
 
-    contentLen = contentLen + 13; // add 14 for '&headers=false', subtract 1 for missing first '&'
+// Field of a TypedChannel, its number and the type of its value: float (with Decimals decimals at most), int, long or const char *
+template<unsigned int Field, typename T, int Decimals = THINGSPEAK_FLOAT_DECIMALS>
+struct TypedField
+{
+  static_assert(Field >= FIELDNUM_MIN && Field <= FIELDNUM_MAX, "TypedField: invalid field number");
+  static const unsigned int field = Field;
+  static const int decimals = Decimals;
+  typedef T type;
+};
 
-    return contentLen;
+// Formatting of the values of a TypedField, maxLength bytes at most. Types without a specialisation are not supported.
+template<typename T>
+struct TypedFieldFormat;
 
-  }
+template<>
+struct TypedFieldFormat<float>
+{
+  static const size_t maxLength = THINGSPEAK_NUMBER_LENGTH - 1;
+  static bool append(ThingSpeakPayload & body, float value, int decimals) {
+    char valueString[THINGSPEAK_NUMBER_LENGTH];
+    body.append(valueString, ThingSpeakPayload::formatFloat(valueString, value, decimals, true));
+    return true;
+  };
+};
 
-  string getJSONValueByKey(string textToSearch, string key) {
-    if(textToSearch.length() == 0) {
-      return string("");
+template<>
+struct TypedFieldFormat<long>
+{
+  static const size_t maxLength = THINGSPEAK_NUMBER_LENGTH - 1;
+  static bool append(ThingSpeakPayload & body, long value, int) {
+    body.appendLong(value);
+    return true;
+  };
+};
+
+template<>
+struct TypedFieldFormat<int> : public TypedFieldFormat<long> {};
+
+template<>
+struct TypedFieldFormat<const char *>
+{
+  static const size_t maxLength = FIELDLENGTH_MAX;
+  static bool append(ThingSpeakPayload & body, const char * value, int) {
+    size_t valueLen = strlen(value);
+    // Max # bytes for ThingSpeak field is 255 (UTF-8)
+    if(valueLen > FIELDLENGTH_MAX) {
+      return false;
     }
+    body.append(value, valueLen);
+    return true;
+  };
+};
 
-    string searchPhrase = string("\"") + key + string("\":\"");
+// Key of a field in the body of an update, "field1=" for the first field and "&field1=" for the next ones
+template<unsigned int Field, bool fFirst>
+struct TypedFieldKey
+{
+  static constexpr char value[] = { '&', 'f', 'i', 'e', 'l', 'd', (char)('0' + Field), '=', '\0' };
+  static const size_t length = sizeof(value) - 1;
+};
+
+template<unsigned int Field>
+struct TypedFieldKey<Field, true>
+{
+  static constexpr char value[] = { 'f', 'i', 'e', 'l', 'd', (char)('0' + Field), '=', '\0' };
+  static const size_t length = sizeof(value) - 1;
+};
 
-    int fromPosition = textToSearch.find(searchPhrase);
+template<unsigned int Field, bool fFirst>
+constexpr char TypedFieldKey<Field, fFirst>::value[];
 
-    if(fromPosition == string::npos) {
-      // return because there is no status or it's null
-      return string("");
-    }
+template<unsigned int Field>
+constexpr char TypedFieldKey<Field, true>::value[];
 
-    fromPosition = fromPosition + searchPhrase.length();
+// Body layout of the fields of a TypedChannel: the bytes it takes at most and the serialisation of the values
+template<bool fFirst, typename... Fields>
+struct TypedLayout
+{
+  static const size_t capacity = 1;  // the terminating zero
+  static const unsigned int firstField = FIELDNUM_MAX + 1;
+  static const bool fAscending = true;
+  static const uint16_t mask = 0;
+  static bool append(ThingSpeakPayload &) {
+    return true;
+  };
+  static bool appendItems(char *, size_t, size_t &) {
+    return true;
+  };
+};
 
-    int toPosition = textToSearch.find("\"", fromPosition);
+template<bool fFirst, typename Field, typename... Rest>
+struct TypedLayout<fFirst, Field, Rest...>
+{
+  typedef TypedFieldKey<Field::field, fFirst> Key;
+  typedef TypedFieldFormat<typename Field::type> Format;
+  typedef TypedLayout<false, Rest...> Next;
+
+  static const size_t capacity = Key::length + Format::maxLength + Next::capacity;
+  static const unsigned int firstField = Field::field;
+  static const bool fAscending = Field::field < Next::firstField && Next::fAscending;
+  static const uint16_t mask = (uint16_t)((1 << (Field::field - 1)) | Next::mask);  // items of the packed bulk entry
+
+  static bool append(ThingSpeakPayload & body, typename Field::type value, typename Rest::type... rest) {
+    body.append(Key::value, Key::length);
+    if(!Format::append(body, value, Field::decimals)) {
+      return false;
+    }
+    return Next::append(body, rest...);
+  };
 
-    if(toPosition == string::npos) {
-      // return because there is no end quote
-      return string("");
+  // Appends the values as length byte and value to the packed bulk entry in record (size bytes) at pos
+  static bool appendItems(char * record, size_t size, size_t & pos, typename Field::type value, typename Rest::type... rest) {
+    if(pos + 1 >= size) {
+      return false;
+    }
+    ThingSpeakPayload item(record + pos + 1, size - pos - 1);
+    if(!Format::append(item, value, Field::decimals) || item.overflow()) {
+      return false;
     }
+    record[pos] = (char)item.length();
+    pos += 1 + item.length();
+    return Next::appendItems(record, size, pos, rest...);
+  };
+};
 
-    textToSearch.erase(toPosition);
+/*
+A channel written with a fixed set of typed fields, e.g.
+  TypedChannel<TypedField<1, float>, TypedField<2, int>, TypedField<5, const char *>> channel(thingSpeak, 12345, "WRITEKEY");
+  channel.write(21.5f, 3, "ok");
+The field numbers are checked at compile time, the keys of the body are constants and the body is serialised into a
+buffer on the stack sized for the largest values of the fields, so only the values are formatted at runtime.
+Updates are serialised with the other writers of the ThingSpeak instance. A failed update is kept by the store like one
+of writeFields(), with the created-at time of the RTC.
+*/
+template<typename... Fields>
+class TypedChannel
+{
+  typedef TypedLayout<true, Fields...> Layout;
+  static_assert(sizeof...(Fields) > 0, "TypedChannel: no fields");
+  static_assert(Layout::fAscending, "TypedChannel: fields have to be given in ascending order of their numbers");
 
-    return textToSearch.substr(fromPosition);
-  }
+  public:
+  // Bytes of the largest body of an update, taken on the stack by write(): the keys, THINGSPEAK_NUMBER_LENGTH - 1 per number
+  // and 255 (FIELDLENGTH_MAX) per const char * field, so a channel of eight string fields needs more than 2 KB of stack.
+  static const size_t capacity = Layout::capacity;
 
-  int abortWriteRaw() {
-    resetWriteFields();
-    return ERR_UNEXPECTED_FAIL;
-  }
+  TypedChannel(ThingSpeak & ts, unsigned long channelNumber, const char * writeAPIKey) :
+    ts(ts), channelNumber(channelNumber), writeAPIKey(writeAPIKey) {}
+
+  /*
+  Writes one update with a value for each of the fields, in the order of the fields. Returns the status as writeFields() does,
+  -101 if a string is longer than 255 characters. The update is sent with the retry policy. If ThingSpeak can't be reached
+  it is kept by the store (see beginStore()) if the RTC is set, an update without a time is not stored.
+  */
+  int write(typename Fields::type... values) {
+    #if THINGSPEAK_HEAP_STATS
+      ThingSpeakHeapProbe heapProbe(this->ts.stats, "TypedChannel::write");
+    #endif
+    char buffer[capacity];
+    ThingSpeakPayload body(buffer, capacity);
+    if(!Layout::append(body, values...)) {
+      return ERR_OUT_OF_RANGE;
+    }
 
-  string abortReadRaw() {
     #ifdef PRINT_DEBUG_MESSAGES
-      printf("ReadRaw abort - disconnected.\n");
+      printf("ts::TypedChannel::write   (channelNumber: %lu writeAPIKey: %s) \"%s\"\n", this->channelNumber, this->writeAPIKey, body.c_str());
     #endif
-    this->lastReadStatus = ERR_UNEXPECTED_FAIL;
-    return string("");
-  }
 
-  void resetWriteFields() {
-    for(size_t iField = 0; iField < FIELDNUM_MAX; iField++) {
-      this->nextWriteField[iField] = "";
+    this->ts.writeMutex.lock();
+    long entryID;
+    int status = this->ts.updateWithRetry(this->channelNumber, this->writeAPIKey, body.c_str(), body.length(), &entryID, 0);
+
+    // Keep the update for writeStored() in case ThingSpeak can't be reached
+    if(this->ts.isStorable(status)) {
+      size_t entryLen = 2;
+      if(Layout::appendItems(this->ts.store->getEntryBuffer(), THINGSPEAK_STORE_BUFFER_SIZE, entryLen, values...)) {
+        this->ts.storeTypedEntry(Layout::mask, entryLen);
+      }
     }
-    this->nextWriteLatitude = NAN;
-    this->nextWriteLongitude = NAN;
-    this->nextWriteElevation = NAN;
-    this->nextWriteStatus = "";
-    this->nextWriteTwitter = "";
-    this->nextWriteTweet = "";
-    this->nextWriteCreatedAt = "";
+    this->ts.writeMutex.unlock();
+    return status;
   };
 
-  TCPSocket *socket;
-  NetworkInterface *net;
-  string nextWriteField[8];
-  float nextWriteLatitude;
-  float nextWriteLongitude;
-  float nextWriteElevation;
-  int lastReadStatus;
-  string nextWriteStatus;
-  string nextWriteTwitter;
-  string nextWriteTweet;
-  string nextWriteCreatedAt;
+  private:
+  ThingSpeak & ts;
+  unsigned long channelNumber;
+  const char * writeAPIKey;
 };
 
 extern ThingSpeak thingSpeak;
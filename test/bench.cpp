@@ -0,0 +1,77 @@
+// Throughput and heap use of the hot paths of ThingSpeak.h against the fake server.
+// Usage: bench [iterations], the default of 100000 is scaled down for the calls sending a request.
+#include "ThingSpeak.h"
+#include "heap_tracking.h"
+
+ThingSpeak thingSpeak;
+NetworkInterface network;
+
+static const char feed[] = "{\"created_at\":\"2024-01-02T03:04:05Z\",\"entry_id\":1234,\"field1\":\"21.5\",\"field2\":\"48\","
+  "\"field3\":null,\"status\":\"all \\\"fine\\\" here\"}";
+
+// Runs task iterations times and prints the calls per second, the allocations per call and the peak heap above the start
+template<typename T>
+static void bench(const char * name, unsigned long iterations, T task) {
+  task();
+
+  uint32_t allocations = hostHeap().allocations;
+  int64_t heapAtStart = hostHeap().current;
+  resetHeapPeak();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for(unsigned long i = 0; i < iterations; i++) {
+    task();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%-34s %12.0f calls/s %8.2f allocs/call %8lld bytes peak heap\n", name, iterations / seconds,
+    (double)(hostHeap().allocations - allocations) / iterations, (long long)(hostHeap().peak - heapAtStart));
+}
+
+int main(int argc, char * argv[]) {
+  unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+  unsigned long requests = iterations / 10 > 0 ? iterations / 10 : 1;
+
+  thingSpeak.begin(&network);
+  FakeServer::instance().replyAlways(200, "1");
+
+  bench("setField(int)", iterations, [] { thingSpeak.setField(1, 42); });
+  bench("setField(float)", iterations, [] { thingSpeak.setField(2, 21.53f); });
+  bench("setField(const char *)", iterations, [] { thingSpeak.setField(3, "some text"); });
+
+  bench("ThingSpeakPayload 4 fields", iterations, [] {
+    char buffer[THINGSPEAK_PAYLOAD_SIZE];
+    ThingSpeakPayload body(buffer, sizeof(buffer));
+    body.append("field1=");
+    body.appendLong(42);
+    body.append("&field2=");
+    body.appendFloat(21.53f, THINGSPEAK_FLOAT_DECIMALS);
+    body.append("&field3=");
+    body.appendFloat(-0.001f, THINGSPEAK_FLOAT_DECIMALS);
+    body.append("&status=");
+    body.append("some text");
+  });
+
+  // the lookup of getJSONValueByKey(), without the copy into the returned string
+  bench("JSON lookup (status)", iterations, [] {
+    const char * key = "status";
+    ThingSpeakJSONValue value;
+    char unescaped[FIELDLENGTH_MAX + 1];
+    ThingSpeakJSON::scan(feed, sizeof(feed) - 1, &key, &value, 1);
+    ThingSpeakJSON::unescape(value, unescaped, sizeof(unescaped));
+  });
+
+  bench("writeFields 4 fields", requests, [] {
+    thingSpeak.setField(1, 42);
+    thingSpeak.setField(2, 21.53f);
+    thingSpeak.setField(3, "some text");
+    thingSpeak.setStatus("ok");
+    thingSpeak.writeFields(1, "WKEY");
+  });
+
+  bench("readFloatField", requests, [] { thingSpeak.readFloatField(1, 1, "RKEY"); });
+
+  FakeServer::instance().replyAlways(200, feed);
+  bench("readStatus (getJSONValueByKey)", requests, [] { thingSpeak.readStatus(1, "RKEY"); });
+
+  return 0;
+}
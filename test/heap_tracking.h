@@ -0,0 +1,69 @@
+// Counts the allocations of the test process and provides mbed_stats_heap_get() for the heap profiling of ThingSpeak.h.
+// Include it in exactly one translation unit of a test.
+#pragma once
+
+#include "mbed.h"
+#include <new>
+
+struct HostHeap
+{
+  std::atomic<uint32_t> allocations;
+  std::atomic<uint32_t> failures;
+  std::atomic<int64_t> current;
+  std::atomic<int64_t> peak;
+  std::atomic<uint64_t> total;
+};
+
+inline HostHeap & hostHeap() {
+  static HostHeap heap;
+  return heap;
+}
+
+// Forgets the peak, so that the next peak is measured from the current size on
+inline void resetHeapPeak() {
+  hostHeap().peak = hostHeap().current.load();
+}
+
+void mbed_stats_heap_get(mbed_stats_heap_t * stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->current_size = (uint32_t)hostHeap().current;
+  stats->max_size = (uint32_t)hostHeap().peak;
+  stats->total_size = (uint32_t)hostHeap().total;
+  stats->alloc_cnt = hostHeap().allocations;
+  stats->alloc_fail_cnt = hostHeap().failures;
+}
+
+// The size is stored in front of each block, so that delete can account for it
+void * operator new(size_t size) {
+  size_t * block = (size_t *)malloc(size + sizeof(max_align_t));
+  if(NULL == block) {
+    hostHeap().failures++;
+    throw std::bad_alloc();
+  }
+  *block = size;
+  if(HostHeapPause::depth() > 0) {
+    // not accounted, delete must not take it off either
+    *block = 0;
+    return (char *)block + sizeof(max_align_t);
+  }
+  hostHeap().allocations++;
+  hostHeap().total += size;
+  int64_t current = hostHeap().current += (int64_t)size;
+  int64_t peak = hostHeap().peak;
+  while(current > peak && !hostHeap().peak.compare_exchange_weak(peak, current)) {}
+  return (char *)block + sizeof(max_align_t);
+}
+
+void operator delete(void * pointer) noexcept {
+  if(NULL == pointer) {
+    return;
+  }
+  size_t * block = (size_t *)((char *)pointer - sizeof(max_align_t));
+  hostHeap().current -= (int64_t)*block;
+  free(block);
+}
+
+void * operator new[](size_t size) { return operator new(size); }
+void operator delete[](void * pointer) noexcept { operator delete(pointer); }
+void operator delete(void * pointer, size_t) noexcept { operator delete(pointer); }
+void operator delete[](void * pointer, size_t) noexcept { operator delete(pointer); }
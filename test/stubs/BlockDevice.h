@@ -0,0 +1,85 @@
+// Host stand-in for the mbed BlockDevice interface with a RAM backed device that behaves like NOR flash:
+// programming needs erased bytes and aligned sizes, erasing works on whole sectors.
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+typedef uint64_t bd_addr_t;
+typedef uint64_t bd_size_t;
+
+namespace mbed {
+class BlockDevice
+{
+  public:
+  virtual ~BlockDevice() {}
+  virtual int init() = 0;
+  virtual int deinit() { return 0; }
+  virtual int read(void * buffer, bd_addr_t addr, bd_size_t size) = 0;
+  virtual int program(const void * buffer, bd_addr_t addr, bd_size_t size) = 0;
+  virtual int erase(bd_addr_t addr, bd_size_t size) = 0;
+  virtual int sync() { return 0; }
+  virtual bd_size_t get_read_size() const = 0;
+  virtual bd_size_t get_program_size() const = 0;
+  virtual bd_size_t get_erase_size() const = 0;
+  virtual int get_erase_value() const { return -1; }
+  virtual bd_size_t size() const = 0;
+};
+
+class HeapBlockDevice : public BlockDevice
+{
+  public:
+  HeapBlockDevice(bd_size_t size, bd_size_t programSize, bd_size_t eraseSize) :
+    memory(size, 0xFF), programSize(programSize), eraseSize(eraseSize), erases(0), faults(0) {}
+
+  virtual int init() { return 0; }
+
+  virtual int read(void * buffer, bd_addr_t addr, bd_size_t size) {
+    if(addr + size > this->memory.size()) {
+      this->faults++;
+      return -1;
+    }
+    memcpy(buffer, &this->memory[addr], size);
+    return 0;
+  }
+
+  virtual int program(const void * buffer, bd_addr_t addr, bd_size_t size) {
+    if(addr % this->programSize != 0 || size % this->programSize != 0 || addr + size > this->memory.size()) {
+      this->faults++;
+      return -1;
+    }
+    for(bd_size_t i = 0; i < size; i++) {
+      if(this->memory[addr + i] != 0xFF) {
+        this->faults++;
+        return -1;
+      }
+      this->memory[addr + i] = ((const uint8_t *)buffer)[i];
+    }
+    return 0;
+  }
+
+  virtual int erase(bd_addr_t addr, bd_size_t size) {
+    if(addr % this->eraseSize != 0 || size % this->eraseSize != 0 || addr + size > this->memory.size()) {
+      this->faults++;
+      return -1;
+    }
+    memset(&this->memory[addr], 0xFF, size);
+    this->erases++;
+    return 0;
+  }
+
+  virtual bd_size_t get_read_size() const { return 1; }
+  virtual bd_size_t get_program_size() const { return this->programSize; }
+  virtual bd_size_t get_erase_size() const { return this->eraseSize; }
+  virtual int get_erase_value() const { return 0xFF; }
+  virtual bd_size_t size() const { return this->memory.size(); }
+
+  std::vector<uint8_t> memory;
+  bd_size_t programSize;
+  bd_size_t eraseSize;
+  int erases;
+  int faults;                   // misaligned accesses and programs over bytes not erased
+};
+}
+using namespace mbed;
@@ -0,0 +1,248 @@
+// Fake ThingSpeak server for the host tests. Replies are queued by the test and handed out in order, each request is
+// logged. A reply can be delayed, a socket whose timeout is shorter than the delay fails the way it does with a hung server.
+// serveRaw() turns it into a server of another protocol, e.g. a MQTT broker.
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+struct FakeReply
+{
+  int status;                                          // 0 drops the connection without a response
+  string body;
+  std::vector<std::pair<string, string> > headers;
+  uint32_t latency;                                    // ms before the response, added to the server latency
+};
+
+// Bytes queued for a socket by the server, available from dueAt (Kernel::get_ms_count()) on
+struct FakeChunk
+{
+  uint64_t dueAt;
+  string bytes;
+  bool fClose;                                         // the server closes the connection
+};
+
+struct FakeRequest
+{
+  string method;
+  string path;                                         // with the query
+  std::vector<std::pair<string, string> > headers;
+  string body;
+
+  string header(const string & name) const {
+    for(size_t i = 0; i < this->headers.size(); i++) {
+      if(this->headers[i].first == name) {
+        return this->headers[i].second;
+      }
+    }
+    return string();
+  }
+};
+
+class FakeServer
+{
+  public:
+  static FakeServer & instance() {
+    static FakeServer server;
+    return server;
+  }
+
+  // Forgets the queued replies, the log and the failure settings
+  void reset() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->replies.clear();
+    this->log.clear();
+    this->fDefault = false;
+    this->latency = 0;
+    this->fFailConnect = false;
+    this->fFailResolve = false;
+    this->fFailInterface = false;
+    this->connects = 0;
+    this->resolves = 0;
+    this->interfaceConnects = 0;
+    this->interfaceDisconnects = 0;
+    this->rawHandler = nullptr;
+    this->rawLog.clear();
+  }
+
+  void reply(int status, const string & body = string(), std::vector<std::pair<string, string> > headers = {}, uint32_t latency = 0) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->replies.push_back(FakeReply{status, body, headers, latency});
+  }
+
+  // Answers every request with the reply once the queue is empty, e.g. for benchmarks
+  void replyAlways(int status, const string & body = string()) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->fDefault = true;
+    this->defaultReply = FakeReply{status, body, {}, 0};
+  }
+
+  // Serves a protocol other than HTTP, e.g. as MQTT broker: handler gets the bytes of each send and returns the answer, if any
+  void serveRaw(std::function<string(const string &)> handler) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->rawHandler = handler;
+  }
+
+  // All bytes sent to serveRaw() since the reset
+  string rawReceived() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->rawLog;
+  }
+
+  void setLatency(uint32_t latency) { this->latency = latency; }
+  void failConnect(bool fFail) { this->fFailConnect = fFail; }
+  void failResolve(bool fFail) { this->fFailResolve = fFail; }
+  void failInterface(bool fFail) { this->fFailInterface = fFail; }
+
+  std::vector<FakeRequest> requests() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->log;
+  }
+
+  FakeRequest lastRequest() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->log.empty() ? FakeRequest() : this->log.back();
+  }
+
+  size_t requestCount() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->log.size();
+  }
+
+  size_t pendingReplies() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->replies.size();
+  }
+
+  void clearLog() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->log.clear();
+  }
+
+  int connectCount() { return this->connects; }
+  int resolveCount() { return this->resolves; }
+  int interfaceConnectCount() { return this->interfaceConnects; }
+  int interfaceDisconnectCount() { return this->interfaceDisconnects; }
+
+  // Logs request and returns the reply to it
+  FakeReply serve(const FakeRequest & request) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->log.push_back(request);
+    if(!this->replies.empty()) {
+      FakeReply reply = this->replies.front();
+      this->replies.pop_front();
+      return reply;
+    }
+    if(this->fDefault) {
+      return this->defaultReply;
+    }
+    return FakeReply{0, string(), {}, 0};
+  }
+
+  /*
+  Parses the complete HTTP requests in outbound and queues their responses in inbound, each one due after its latency.
+  A reply with status 0 queues the end of the connection instead.
+  */
+  void receive(string & outbound, const string & data, std::deque<FakeChunk> & inbound) {
+    std::function<string(const string &)> handler;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      handler = this->rawHandler;
+      if(handler) {
+        this->rawLog += data;
+      }
+    }
+    if(handler) {
+      string answer = handler(data);
+      if(!answer.empty()) {
+        inbound.push_back(FakeChunk{rtos::Kernel::get_ms_count() + this->latency, answer, false});
+      }
+      return;
+    }
+
+    outbound += data;
+    for(;;) {
+      size_t headerEnd = outbound.find("\r\n\r\n");
+      if(headerEnd == string::npos) {
+        return;
+      }
+      FakeRequest request;
+      size_t lineEnd = outbound.find("\r\n");
+      string requestLine = outbound.substr(0, lineEnd);
+      size_t space = requestLine.find(' ');
+      request.method = requestLine.substr(0, space);
+      request.path = requestLine.substr(space + 1, requestLine.rfind(' ') - space - 1);
+      size_t contentLength = 0;
+      for(size_t pos = lineEnd + 2; pos < headerEnd; ) {
+        size_t end = outbound.find("\r\n", pos);
+        string line = outbound.substr(pos, end - pos);
+        size_t colon = line.find(':');
+        request.headers.push_back(std::make_pair(line.substr(0, colon), line.substr(colon + 2)));
+        if(line.substr(0, colon) == "Content-Length") {
+          contentLength = strtoul(line.c_str() + colon + 2, NULL, 10);
+        }
+        pos = end + 2;
+      }
+      if(outbound.length() < headerEnd + 4 + contentLength) {
+        return;
+      }
+      request.body = outbound.substr(headerEnd + 4, contentLength);
+      outbound.erase(0, headerEnd + 4 + contentLength);
+
+      FakeReply reply = serve(request);
+      FakeChunk chunk;
+      chunk.dueAt = rtos::Kernel::get_ms_count() + this->latency + reply.latency;
+      chunk.fClose = (reply.status == 0);
+      if(!chunk.fClose) {
+        chunk.bytes = "HTTP/1.1 " + std::to_string(reply.status) + " Status\r\n";
+        for(size_t i = 0; i < reply.headers.size(); i++) {
+          chunk.bytes += reply.headers[i].first + ": " + reply.headers[i].second + "\r\n";
+        }
+        chunk.bytes += "Content-Length: " + std::to_string(reply.body.length()) + "\r\n\r\n" + reply.body;
+      }
+      inbound.push_back(chunk);
+    }
+  }
+
+  nsapi_error_t connect() {
+    this->connects++;
+    return this->fFailConnect ? NSAPI_ERROR_NO_CONNECTION : NSAPI_ERROR_OK;
+  }
+
+  nsapi_error_t resolve(const char *) {
+    this->resolves++;
+    return this->fFailResolve ? NSAPI_ERROR_DNS_FAILURE : NSAPI_ERROR_OK;
+  }
+
+  nsapi_error_t connectInterface() {
+    this->interfaceConnects++;
+    return this->fFailInterface ? NSAPI_ERROR_NO_CONNECTION : NSAPI_ERROR_OK;
+  }
+
+  nsapi_error_t disconnectInterface() {
+    this->interfaceDisconnects++;
+    return NSAPI_ERROR_OK;
+  }
+
+  private:
+  FakeServer() {
+    reset();
+  }
+
+  std::mutex mutex;
+  std::deque<FakeReply> replies;
+  std::vector<FakeRequest> log;
+  bool fDefault;
+  FakeReply defaultReply;
+  std::atomic<uint32_t> latency;
+  std::atomic<bool> fFailConnect;
+  std::atomic<bool> fFailResolve;
+  std::atomic<bool> fFailInterface;
+  std::atomic<int> connects;
+  std::atomic<int> resolves;
+  std::atomic<int> interfaceConnects;
+  std::atomic<int> interfaceDisconnects;
+  std::function<string(const string &)> rawHandler;
+  string rawLog;
+};
@@ -0,0 +1,165 @@
+// Host stand-in for mbed-http, requests are served by the FakeServer
+#pragma once
+
+#include "mbed.h"
+#include <vector>
+
+enum http_method {
+  HTTP_DELETE = 0,
+  HTTP_GET = 1,
+  HTTP_HEAD = 2,
+  HTTP_POST = 3,
+  HTTP_PUT = 4
+};
+
+class HttpResponse
+{
+  public:
+  HttpResponse() : status(0) {}
+
+  ~HttpResponse() {
+    for(size_t i = 0; i < this->fields.size(); i++) {
+      delete this->fields[i];
+      delete this->values[i];
+    }
+  }
+
+  int get_status_code() { return this->status; }
+  string get_status_message() { return this->message; }
+  size_t get_headers_length() { return this->fields.size(); }
+  std::vector<string *> get_headers_fields() { return this->fields; }
+  std::vector<string *> get_headers_values() { return this->values; }
+  char * get_body() { return &this->body[0]; }
+  size_t get_body_length() { return this->body.length(); }
+  string get_body_as_string() { return this->body; }
+
+  private:
+  friend class HttpRequest;
+  int status;
+  string message;
+  string body;
+  std::vector<string *> fields;
+  std::vector<string *> values;
+};
+
+// Sends the request over the socket and parses the response, like mbed-http does for a response with a Content-Length
+class HttpRequest
+{
+  public:
+  HttpRequest(TCPSocket * socket, http_method method, const char * url, Callback<void(const char *, uint32_t)> bodyCallback = nullptr) {
+    this->socket = socket;
+    this->method = method;
+    this->bodyCallback = bodyCallback;
+    this->response = NULL;
+    this->error = NSAPI_ERROR_OK;
+
+    // http://host:port/path?query
+    const char * path = strstr(url, "://");
+    path = (NULL == path) ? url : strchr(path + 3, '/');
+    this->path = (NULL == path) ? string("/") : string(path);
+  }
+
+  virtual ~HttpRequest() {
+    delete this->response;
+  }
+
+  void set_header(string key, string value) {
+    this->headers.push_back(std::make_pair(key, value));
+  }
+
+  HttpResponse * send(const void * body = NULL, nsapi_size_t bodySize = 0) {
+    static const char * const methods[] = { "DELETE", "GET", "HEAD", "POST", "PUT" };
+    string request = string(methods[this->method]) + " " + this->path + " HTTP/1.1\r\n";
+    for(size_t i = 0; i < this->headers.size(); i++) {
+      request += this->headers[i].first + ": " + this->headers[i].second + "\r\n";
+    }
+    if(NULL != body) {
+      request += "Content-Length: " + std::to_string(bodySize) + "\r\n\r\n";
+      request.append((const char *)body, bodySize);
+    }
+    else {
+      request += "\r\n";
+    }
+
+    nsapi_size_or_error_t sent = this->socket->send(request.data(), (nsapi_size_t)request.length());
+    if(sent < 0) {
+      this->error = sent;
+      return NULL;
+    }
+
+    // the head of the response
+    string received;
+    size_t headerEnd;
+    while((headerEnd = received.find("\r\n\r\n")) == string::npos) {
+      if(!receive(received)) {
+        return NULL;
+      }
+    }
+
+    this->response = new HttpResponse();
+    size_t lineEnd = received.find("\r\n");
+    this->response->status = atoi(received.c_str() + received.find(' ') + 1);
+    size_t messageStart = received.find(' ', received.find(' ') + 1) + 1;
+    this->response->message = received.substr(messageStart, lineEnd - messageStart);
+    size_t contentLength = 0;
+    for(size_t pos = lineEnd + 2; pos < headerEnd; ) {
+      size_t end = received.find("\r\n", pos);
+      string line = received.substr(pos, end - pos);
+      size_t colon = line.find(':');
+      this->response->fields.push_back(new string(line.substr(0, colon)));
+      this->response->values.push_back(new string(line.substr(colon + 2)));
+      if(line.substr(0, colon) == "Content-Length") {
+        contentLength = strtoul(line.c_str() + colon + 2, NULL, 10);
+      }
+      pos = end + 2;
+    }
+    received.erase(0, headerEnd + 4);
+
+    // the body, passed to the body callback as it arrives if there is one
+    size_t bodyReceived = 0;
+    for(;;) {
+      size_t n = received.length() < contentLength - bodyReceived ? received.length() : contentLength - bodyReceived;
+      if(this->bodyCallback) {
+        for(size_t pos = 0; pos < n; pos += 16) {
+          this->bodyCallback(received.data() + pos, (uint32_t)(n - pos < 16 ? n - pos : 16));
+        }
+      }
+      else {
+        this->response->body.append(received, 0, n);
+      }
+      bodyReceived += n;
+      received.clear();
+      if(bodyReceived == contentLength) {
+        return this->response;
+      }
+      if(!receive(received)) {
+        delete this->response;
+        this->response = NULL;
+        return NULL;
+      }
+    }
+  }
+
+  nsapi_error_t get_error() { return this->error; }
+
+  private:
+  // Appends the next bytes of the response to received, false if the socket failed or was closed
+  bool receive(string & received) {
+    char buffer[256];
+    nsapi_size_or_error_t n = this->socket->recv(buffer, sizeof(buffer));
+    if(n <= 0) {
+      this->error = (n == 0) ? NSAPI_ERROR_CONNECTION_LOST : n;
+      return false;
+    }
+    received.append(buffer, n);
+    return true;
+  }
+
+  TCPSocket * socket;
+  http_method method;
+  string path;
+  std::vector<std::pair<string, string> > headers;
+  Callback<void(const char *, uint32_t)> bodyCallback;
+  HttpResponse * response;
+  nsapi_error_t error;
+};
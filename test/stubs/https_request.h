@@ -0,0 +1,18 @@
+// Host stand-in for the HTTPS part of mbed-http, TLS is not simulated
+#pragma once
+
+#include "http_request.h"
+
+class TLSSocket : public TCPSocket
+{
+  public:
+  nsapi_error_t set_hostname(const char *) { return NSAPI_ERROR_OK; }
+  nsapi_error_t set_root_ca_cert(const char *) { return NSAPI_ERROR_OK; }
+};
+
+class HttpsRequest : public HttpRequest
+{
+  public:
+  HttpsRequest(TLSSocket * socket, http_method method, const char * url, Callback<void(const char *, uint32_t)> bodyCallback = nullptr) :
+    HttpRequest(socket, method, url, bodyCallback) {}
+};
@@ -0,0 +1,435 @@
+// Host stand-in for the parts of mbed OS used by ThingSpeak.h. Threads, mutexes and the event queue run on std::thread,
+// the clocks on std::chrono::steady_clock. The network is served by the FakeServer of fake_server.h.
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using std::string;
+
+// ---- time
+
+inline std::chrono::steady_clock::time_point & hostStartTime() {
+  static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return start;
+}
+
+inline uint32_t us_ticker_read() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - hostStartTime()).count();
+}
+
+namespace rtos {
+namespace Kernel {
+  // starts at 1 s, so that no deadline or timestamp of the library is 0
+  inline uint64_t get_ms_count() {
+    return 1000 + (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - hostStartTime()).count();
+  }
+}
+namespace ThisThread {
+  inline void sleep_for(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  }
+}
+}
+
+// The RTC counts from 0 (1970) like an mbed target whose RTC was never set, until set_time() is called
+struct HostRTC
+{
+  time_t setTo;
+  std::chrono::steady_clock::time_point setAt;
+};
+
+inline HostRTC & hostRTC() {
+  static HostRTC rtc = { 0, hostStartTime() };
+  return rtc;
+}
+
+inline time_t hostTime(time_t * now) {
+  time_t seconds = hostRTC().setTo + (time_t)std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - hostRTC().setAt).count();
+  if(NULL != now) {
+    *now = seconds;
+  }
+  return seconds;
+}
+
+inline void set_time(time_t t) {
+  hostRTC().setTo = t;
+  hostRTC().setAt = std::chrono::steady_clock::now();
+}
+
+#define time(now) hostTime(now)
+
+// ---- callbacks
+
+namespace mbed {
+template<typename F> class Callback;
+
+template<typename R, typename... A>
+class Callback<R(A...)>
+{
+  public:
+  Callback() {}
+  Callback(std::nullptr_t) {}
+  Callback(R (*function)(A...)) : function(function) {}
+  template<typename T, typename M> Callback(T * object, M method) : function([object, method](A... args) { return (object->*method)(args...); }) {}
+  template<typename L> Callback(L lambda) : function(lambda) {}
+
+  R operator()(A... args) const { return this->function(args...); }
+  R call(A... args) const { return this->function(args...); }
+  explicit operator bool() const { return (bool)this->function; }
+
+  private:
+  std::function<R(A...)> function;
+};
+
+template<typename T, typename M>
+auto callback(T * object, M method) {
+  return [object, method](auto... args) { return (object->*method)(args...); };
+}
+}
+using mbed::Callback;
+using mbed::callback;
+
+// ---- critical sections, sleep manager, statistics
+
+inline std::recursive_mutex & hostCriticalSection() {
+  static std::recursive_mutex mutex;
+  return mutex;
+}
+inline void core_util_critical_section_enter() { hostCriticalSection().lock(); }
+inline void core_util_critical_section_exit() { hostCriticalSection().unlock(); }
+
+#define DEVICE_SLEEP 1
+inline int & hostDeepSleepLocks() {
+  static int locks = 0;
+  return locks;
+}
+inline void sleep_manager_lock_deep_sleep() { hostDeepSleepLocks()++; }
+inline void sleep_manager_unlock_deep_sleep() { hostDeepSleepLocks()--; }
+
+// Allocations made while one of these exists on a thread are not counted, for the work of the fake server
+struct HostHeapPause
+{
+  HostHeapPause() { depth()++; }
+  ~HostHeapPause() { depth()--; }
+  static int & depth() {
+    static thread_local int pauses = 0;
+    return pauses;
+  }
+};
+
+typedef struct {
+  uint32_t current_size;
+  uint32_t max_size;
+  uint32_t total_size;
+  uint32_t reserved_size;
+  uint32_t alloc_cnt;
+  uint32_t alloc_fail_cnt;
+  uint32_t overhead_size;
+} mbed_stats_heap_t;
+// Defined by heap_tracking.h
+void mbed_stats_heap_get(mbed_stats_heap_t * stats);
+
+typedef void * osThreadId_t;
+inline osThreadId_t osThreadGetId() { return NULL; }
+inline uint32_t osThreadGetStackSize(osThreadId_t) { return 0; }
+inline uint32_t osThreadGetStackSpace(osThreadId_t) { return 0; }
+
+// ---- RTOS
+
+typedef enum { osOK = 0, osError = -1 } osStatus;
+typedef enum { osPriorityLow = 8, osPriorityBelowNormal = 16, osPriorityNormal = 24, osPriorityAboveNormal = 32 } osPriority;
+
+namespace rtos {
+class Mutex
+{
+  public:
+  void lock() { this->mutex.lock(); }
+  void unlock() { this->mutex.unlock(); }
+  bool trylock() { return this->mutex.try_lock(); }
+
+  private:
+  std::recursive_mutex mutex;
+};
+
+class EventFlags
+{
+  public:
+  EventFlags() : flags(0) {}
+
+  uint32_t set(uint32_t flags) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->flags |= flags;
+    this->changed.notify_all();
+    return this->flags;
+  }
+
+  // Waits until all of flags are set and clears them
+  uint32_t wait_all(uint32_t flags) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->changed.wait(lock, [this, flags] { return (this->flags & flags) == flags; });
+    uint32_t set = this->flags;
+    this->flags &= ~flags;
+    return set;
+  }
+
+  private:
+  std::mutex mutex;
+  std::condition_variable changed;
+  uint32_t flags;
+};
+
+class Thread
+{
+  public:
+  Thread(osPriority = osPriorityNormal, uint32_t = 0, unsigned char * = NULL, const char * = NULL) {}
+  ~Thread() {
+    if(this->thread.joinable()) {
+      this->thread.detach();
+    }
+  }
+
+  osStatus start(mbed::Callback<void()> task) {
+    starts()++;
+    this->thread = std::thread([task] { task(); });
+    return osOK;
+  }
+
+  osStatus join() {
+    if(this->thread.joinable()) {
+      this->thread.join();
+    }
+    return osOK;
+  }
+
+  // Threads started so far
+  static std::atomic<int> & starts() {
+    static std::atomic<int> count(0);
+    return count;
+  }
+
+  private:
+  std::thread thread;
+};
+}
+using namespace rtos;
+
+// ---- events
+
+#define EVENTS_EVENT_SIZE 64
+
+namespace events {
+class EventQueue
+{
+  public:
+  EventQueue(unsigned = 0, unsigned char * = NULL) : nextID(1) {}
+
+  template<typename T, typename M, typename... A>
+  int call(T * object, M method, A... args) {
+    return post(0, [object, method, args...]() { (object->*method)(args...); });
+  }
+
+  template<typename T, typename M, typename... A>
+  int call_in(int ms, T * object, M method, A... args) {
+    return post(ms, [object, method, args...]() { (object->*method)(args...); });
+  }
+
+  bool cancel(int id) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for(auto event = this->events.begin(); event != this->events.end(); ++event) {
+      if(event->second.id == id) {
+        this->events.erase(event);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Runs the events as they fall due, never returns
+  void dispatch_forever() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    for(;;) {
+      if(this->events.empty()) {
+        this->changed.wait(lock);
+        continue;
+      }
+      auto first = this->events.begin();
+      if(std::chrono::steady_clock::now() < first->first) {
+        this->changed.wait_until(lock, first->first);
+        continue;
+      }
+      std::function<void()> task = first->second.task;
+      this->events.erase(first);
+      lock.unlock();
+      task();
+      lock.lock();
+    }
+  }
+
+  private:
+  struct Event {
+    int id;
+    std::function<void()> task;
+  };
+
+  int post(int ms, std::function<void()> task) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    int id = this->nextID++;
+    this->events.insert(std::make_pair(std::chrono::steady_clock::now() + std::chrono::milliseconds(ms), Event{id, task}));
+    this->changed.notify_all();
+    return id;
+  }
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::multimap<std::chrono::steady_clock::time_point, Event> events;
+  int nextID;
+};
+}
+using events::EventQueue;
+
+// ---- network
+
+typedef int nsapi_error_t;
+typedef int nsapi_size_or_error_t;
+typedef unsigned int nsapi_size_t;
+
+enum {
+  NSAPI_ERROR_OK = 0,
+  NSAPI_ERROR_WOULD_BLOCK = -3001,
+  NSAPI_ERROR_PARAMETER = -3003,
+  NSAPI_ERROR_NO_CONNECTION = -3004,
+  NSAPI_ERROR_NO_SOCKET = -3005,
+  NSAPI_ERROR_NO_MEMORY = -3007,
+  NSAPI_ERROR_DNS_FAILURE = -3009,
+  NSAPI_ERROR_IS_CONNECTED = -3015,
+  NSAPI_ERROR_CONNECTION_LOST = -3016,
+  NSAPI_ERROR_TIMEOUT = -3017
+};
+
+typedef enum { NSAPI_UNSPEC = 0, NSAPI_IPv4, NSAPI_IPv6 } nsapi_version_t;
+
+class SocketAddress
+{
+  public:
+  SocketAddress() : port(0) {}
+  const char * get_ip_address() const { return "10.0.0.1"; }
+  void set_port(uint16_t port) { this->port = port; }
+  uint16_t get_port() const { return this->port; }
+  nsapi_version_t get_ip_version() const { return NSAPI_IPv4; }
+  operator bool() const { return true; }
+
+  private:
+  uint16_t port;
+};
+
+class NetworkInterface;
+class TCPSocket;
+
+#include "fake_server.h"
+
+class NetworkInterface
+{
+  public:
+  virtual ~NetworkInterface() {}
+  virtual nsapi_error_t connect() { return FakeServer::instance().connectInterface(); }
+  virtual nsapi_error_t disconnect() { return FakeServer::instance().disconnectInterface(); }
+  virtual nsapi_error_t gethostbyname(const char * host, SocketAddress *, nsapi_version_t = NSAPI_UNSPEC) {
+    return FakeServer::instance().resolve(host);
+  }
+};
+
+class Socket
+{
+  public:
+  virtual ~Socket() {}
+};
+
+// Plain socket, the bytes sent are parsed as HTTP requests by the fake server, which queues the responses to be received
+class TCPSocket : public Socket
+{
+  public:
+  TCPSocket() : timeout(-1), fClosed(false) {}
+  virtual nsapi_error_t open(NetworkInterface *) { return NSAPI_ERROR_OK; }
+  virtual nsapi_error_t connect(const SocketAddress &) {
+    HostHeapPause pause;
+    this->outbound.clear();
+    this->inbound.clear();
+    this->fClosed = false;
+    return FakeServer::instance().connect();
+  }
+  virtual nsapi_error_t close() {
+    HostHeapPause pause;
+    this->outbound.clear();
+    this->inbound.clear();
+    return NSAPI_ERROR_OK;
+  }
+  virtual void set_timeout(int timeout) { this->timeout = timeout; }
+  virtual void set_blocking(bool fBlocking) { this->timeout = fBlocking ? -1 : 0; }
+
+  virtual nsapi_size_or_error_t send(const void * data, nsapi_size_t size) {
+    HostHeapPause pause;
+    if(this->fClosed) {
+      return NSAPI_ERROR_CONNECTION_LOST;
+    }
+    FakeServer::instance().receive(this->outbound, string((const char *)data, size), this->inbound);
+    return (nsapi_size_or_error_t)size;
+  }
+
+  // Waits up to the timeout for the next response, returns 0 once the server closed the connection
+  virtual nsapi_size_or_error_t recv(void * data, nsapi_size_t size) {
+    HostHeapPause pause;
+    if(this->fClosed) {
+      return 0;
+    }
+    if(this->inbound.empty()) {
+      if(this->timeout > 0) {
+        rtos::ThisThread::sleep_for((uint32_t)this->timeout);
+      }
+      return NSAPI_ERROR_WOULD_BLOCK;
+    }
+
+    FakeChunk & chunk = this->inbound.front();
+    uint64_t now = rtos::Kernel::get_ms_count();
+    if(chunk.dueAt > now) {
+      if(this->timeout >= 0 && chunk.dueAt - now > (uint64_t)this->timeout) {
+        rtos::ThisThread::sleep_for((uint32_t)this->timeout);
+        return NSAPI_ERROR_WOULD_BLOCK;
+      }
+      rtos::ThisThread::sleep_for((uint32_t)(chunk.dueAt - now));
+    }
+    if(chunk.fClose) {
+      this->fClosed = true;
+      this->inbound.clear();
+      return 0;
+    }
+
+    size_t n = size < chunk.bytes.size() ? size : chunk.bytes.size();
+    memcpy(data, chunk.bytes.data(), n);
+    chunk.bytes.erase(0, n);
+    if(chunk.bytes.empty()) {
+      this->inbound.pop_front();
+    }
+    return (nsapi_size_or_error_t)n;
+  }
+
+  private:
+  int timeout;
+  bool fClosed;
+  string outbound;
+  std::deque<FakeChunk> inbound;
+};
@@ -0,0 +1,43 @@
+// Minimal checks for the host tests, a test fails with the number of failed checks as exit code
+#pragma once
+
+#include <stdio.h>
+#include <string>
+
+inline int & testFailures() {
+  static int failures = 0;
+  return failures;
+}
+
+#define CHECK(condition) do { \
+    if(!(condition)) { \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      testFailures()++; \
+    } \
+  } while(0)
+
+#define CHECK_EQUAL(expected, actual) do { \
+    long long e_ = (long long)(expected); \
+    long long a_ = (long long)(actual); \
+    if(e_ != a_) { \
+      printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, a_, e_); \
+      testFailures()++; \
+    } \
+  } while(0)
+
+#define CHECK_STRING(expected, actual) do { \
+    std::string e_ = (expected); \
+    std::string a_ = (actual); \
+    if(e_ != a_) { \
+      printf("%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #actual, a_.c_str(), e_.c_str()); \
+      testFailures()++; \
+    } \
+  } while(0)
+
+#define RUN(test) do { \
+    int before_ = testFailures(); \
+    test(); \
+    printf("%s %s\n", testFailures() == before_ ? "PASS" : "FAIL", #test); \
+  } while(0)
+
+#define TEST_RESULT() (testFailures() == 0 ? 0 : 1)
@@ -0,0 +1,167 @@
+// Bulk updates collected with queueFields(), in the JSON and the CSV format
+#include "ThingSpeak.h"
+#include "heap_tracking.h"
+#include "test.h"
+
+ThingSpeak thingSpeak;
+NetworkInterface network;
+
+static void testJSON() {
+  FakeServer::instance().reset();
+  thingSpeak.setBulkFormat(BULK_FORMAT_JSON);
+  thingSpeak.setField(1, 1);
+  thingSpeak.setStatus("a\"b");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.queueFields(9, "KEY", 0));
+  thingSpeak.setField(2, 2.5f);
+  thingSpeak.setLatitude(1.5f);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.queueFields(9, "KEY", 15));
+  thingSpeak.setField(3, "x");
+  thingSpeak.setCreatedAt("2024-01-02T03:04:05Z");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.queueFields(9, "KEY", 30));
+  CHECK_EQUAL(3, thingSpeak.getBulkCount());
+  CHECK_EQUAL(0, FakeServer::instance().requestCount());
+
+  FakeServer::instance().reply(202, "{\"success\":true}");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeBulk());
+  CHECK_EQUAL(0, thingSpeak.getBulkCount());
+  FakeRequest request = FakeServer::instance().lastRequest();
+  CHECK_STRING("POST", request.method);
+  CHECK_STRING("/channels/9/bulk_update.json", request.path);
+  CHECK_STRING("application/json", request.header("Content-Type"));
+  CHECK_STRING("{\"write_api_key\":\"KEY\",\"updates\":["
+    "{\"delta_t\":0,\"field1\":\"1\",\"status\":\"a\\\"b\"},"
+    "{\"delta_t\":15,\"field2\":\"2.5\",\"latitude\":\"1.5\"},"
+    "{\"field3\":\"x\",\"created_at\":\"2024-01-02T03:04:05Z\"}]}", request.body);
+}
+
+static void testCSV() {
+  FakeServer::instance().reset();
+  thingSpeak.setBulkFormat(BULK_FORMAT_CSV);
+  thingSpeak.setField(1, 1);
+  thingSpeak.setField(3, "a,b");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.queueFields(9, "K&Y", 0));
+  thingSpeak.setField(2, 2);
+  thingSpeak.setStatus("s");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.queueFields(9, "K&Y", 20));
+
+  FakeServer::instance().reply(202);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeBulk());
+  FakeRequest request = FakeServer::instance().lastRequest();
+  CHECK_STRING("/channels/9/bulk_update.csv", request.path);
+  CHECK_STRING("application/x-www-form-urlencoded", request.header("Content-Type"));
+  CHECK_STRING("write_api_key=K%26Y&time_format=relative&updates=0,1,,%22a,b%22|20,,2,,,,,,,,,,s", request.body);
+
+  // absolute and relative timestamps can't be mixed in one CSV update, it falls back to JSON
+  thingSpeak.setField(1, 1);
+  thingSpeak.setCreatedAt("2024-01-02T03:04:05Z");
+  thingSpeak.queueFields(9, "KEY", 0);
+  thingSpeak.setField(1, 2);
+  thingSpeak.queueFields(9, "KEY", 5);
+  FakeServer::instance().reply(202);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeBulk());
+  CHECK_STRING("/channels/9/bulk_update.json", FakeServer::instance().lastRequest().path);
+  thingSpeak.setBulkFormat(BULK_FORMAT_JSON);
+}
+
+static void testFailedBulkIsKept() {
+  FakeServer::instance().reset();
+  thingSpeak.setField(1, 1);
+  thingSpeak.queueFields(9, "KEY", 0);
+  FakeServer::instance().reply(500);
+  CHECK_EQUAL(500, thingSpeak.writeBulk());
+  CHECK_EQUAL(1, thingSpeak.getBulkCount());
+  FakeServer::instance().reply(202);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeBulk());
+  CHECK_EQUAL(0, thingSpeak.getBulkCount());
+  CHECK_EQUAL(ERR_SETFIELD_NOT_CALLED, thingSpeak.writeBulk());
+}
+
+static void testChannelChangeAndFullQueue() {
+  FakeServer::instance().reset();
+  thingSpeak.setField(1, 1);
+  thingSpeak.queueFields(9, "KEY", 0);
+
+  // entries for another channel send the collected ones first
+  FakeServer::instance().reply(202);
+  thingSpeak.setField(1, 2);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.queueFields(10, "KEY2", 0));
+  CHECK_EQUAL(1, FakeServer::instance().requestCount());
+  CHECK_STRING("/channels/9/bulk_update.json", FakeServer::instance().lastRequest().path);
+  CHECK_EQUAL(1, thingSpeak.getBulkCount());
+
+  // the queue is sent once THINGSPEAK_BULK_MAX_ENTRIES are collected
+  FakeServer::instance().reply(202);
+  for(int i = 1; i < THINGSPEAK_BULK_MAX_ENTRIES; i++) {
+    thingSpeak.setField(1, i);
+    CHECK_EQUAL(OK_SUCCESS, thingSpeak.queueFields(10, "KEY2", 1));
+  }
+  CHECK_EQUAL(2, FakeServer::instance().requestCount());
+  CHECK_EQUAL(0, thingSpeak.getBulkCount());
+}
+
+static void testElapsedDeltaT() {
+  FakeServer::instance().reset();
+  thingSpeak.setField(1, 1);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.queueFields(9, "KEY"));
+  ThisThread::sleep_for(1000);
+  thingSpeak.setField(1, 2);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.queueFields(9, "KEY"));
+
+  FakeServer::instance().reply(202);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeBulk());
+  CHECK_STRING("{\"write_api_key\":\"KEY\",\"updates\":[{\"delta_t\":0,\"field1\":\"1\"},{\"delta_t\":1,\"field1\":\"2\"}]}",
+    FakeServer::instance().lastRequest().body);
+}
+
+static void testQueueWhileSending() {
+  FakeServer::instance().reset();
+  FakeServer::instance().replyAlways(202);
+
+  // entries queued while another thread sends the queue are each sent once
+  std::atomic<bool> fQueued(false);
+  Thread sender;
+  sender.start([&fQueued] {
+    while(!fQueued) {
+      thingSpeak.writeBulk();
+    }
+  });
+  for(int i = 0; i < 50; i++) {
+    thingSpeak.setField(1, i);
+    CHECK_EQUAL(OK_SUCCESS, thingSpeak.queueFields(9, "KEY"));
+  }
+  fQueued = true;
+  sender.join();
+
+  size_t sent = 0;
+  std::vector<FakeRequest> requests = FakeServer::instance().requests();
+  for(size_t i = 0; i < requests.size(); i++) {
+    for(size_t pos = 0; (pos = requests[i].body.find("\"field1\"", pos)) != string::npos; pos++) {
+      sent++;
+    }
+  }
+  CHECK_EQUAL(50, sent + thingSpeak.getBulkCount());
+  thingSpeak.writeBulk();
+}
+
+static void testNothingSet() {
+  CHECK_EQUAL(ERR_SETFIELD_NOT_CALLED, thingSpeak.queueFields(9, "KEY", 0));
+  // a created-at time alone is no entry
+  thingSpeak.setCreatedAt("2024-01-02T03:04:05Z");
+  CHECK_EQUAL(ERR_SETFIELD_NOT_CALLED, thingSpeak.queueFields(9, "KEY", 0));
+}
+
+int main() {
+  thingSpeak.begin(&network);
+  #if THINGSPEAK_HTTPS
+    // the stand-in for TLS accepts any certificate
+    thingSpeak.setRootCA("-----BEGIN CERTIFICATE-----");
+  #endif
+  RUN(testJSON);
+  RUN(testCSV);
+  RUN(testFailedBulkIsKept);
+  RUN(testChannelChangeAndFullQueue);
+  RUN(testElapsedDeltaT);
+  RUN(testQueueWhileSending);
+  RUN(testNothingSet);
+  return TEST_RESULT();
+}
@@ -0,0 +1,131 @@
+// Number formatting of ThingSpeakPayload and the bodies built from fields set with setField()
+#include "ThingSpeak.h"
+#include "heap_tracking.h"
+#include "test.h"
+#include <float.h>
+#include <limits.h>
+
+ThingSpeak thingSpeak;
+NetworkInterface network;
+
+static string formatLong(long value) {
+  char out[THINGSPEAK_NUMBER_LENGTH];
+  size_t len = ThingSpeakPayload::formatLong(out, value);
+  CHECK_EQUAL(strlen(out), len);
+  return string(out, len);
+}
+
+static string formatUnsigned(uint64_t value) {
+  char out[THINGSPEAK_NUMBER_LENGTH];
+  size_t len = ThingSpeakPayload::formatUnsigned(out, value);
+  CHECK_EQUAL(strlen(out), len);
+  return string(out, len);
+}
+
+static string formatFloat(float value, int decimals, bool fTrim = false) {
+  char out[THINGSPEAK_NUMBER_LENGTH];
+  size_t len = ThingSpeakPayload::formatFloat(out, value, decimals, fTrim);
+  CHECK_EQUAL(strlen(out), len);
+  return string(out, len);
+}
+
+// Body of the update sent by writeFields() for the fields set before
+static string writtenBody() {
+  FakeServer::instance().reply(200, "1");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeFields(1, "KEY"));
+  return FakeServer::instance().lastRequest().body;
+}
+
+static void testFormatLong() {
+  CHECK_STRING("0", formatLong(0));
+  CHECK_STRING("7", formatLong(7));
+  CHECK_STRING("-7", formatLong(-7));
+  CHECK_STRING("2147483647", formatLong(2147483647L));
+  CHECK_STRING(std::to_string(LONG_MAX), formatLong(LONG_MAX));
+  CHECK_STRING(std::to_string(LONG_MIN), formatLong(LONG_MIN));
+}
+
+static void testFormatUnsigned() {
+  CHECK_STRING("0", formatUnsigned(0));
+  CHECK_STRING("4294967296", formatUnsigned(4294967296ULL));
+  CHECK_STRING("18446744073709551615", formatUnsigned(UINT64_MAX));
+}
+
+static void testFormatFloat() {
+  CHECK_STRING("0.000000", formatFloat(0.0f, 6));
+  CHECK_STRING("0", formatFloat(0.0f, 6, true));
+  CHECK_STRING("1.500000", formatFloat(1.5f, 6));
+  CHECK_STRING("1.5", formatFloat(1.5f, 6, true));
+  CHECK_STRING("-1.25", formatFloat(-1.25f, 6, true));
+  CHECK_STRING("-0.5", formatFloat(-0.5f, 2, true));
+  CHECK_STRING("3", formatFloat(2.5f, 0));
+  CHECK_STRING("0.1", formatFloat(0.1f, 3, true));
+  CHECK_STRING("0.01", formatFloat(0.0051f, 2));
+  CHECK_STRING("2", formatFloat(1.999f, 2, true));
+  CHECK_STRING("nan", formatFloat(NAN, 6));
+  CHECK_STRING("inf", formatFloat(INFINITY, 6));
+  CHECK_STRING("-inf", formatFloat(-INFINITY, 6));
+}
+
+static void testFormatFloatLarge() {
+  CHECK_STRING("2147483648", formatFloat(2147483648.0f, 6, true));
+  CHECK_STRING("998999982080.000000", formatFloat(9.99e11f, 6));
+  CHECK_STRING("2.000000e+12", formatFloat(2e12f, 6));
+  CHECK_STRING("-1e+20", formatFloat(-1e20f, 6, true));
+  CHECK_STRING("3.402823e+38", formatFloat(FLT_MAX, 6));
+}
+
+// An integral from 10^(18 - decimals) on does not fit into 64 bits once scaled, it takes the exponent notation
+static void testFormatFloatNineDecimals() {
+  CHECK_STRING("2.147483648e+9", formatFloat(2147483648.0f, 9));
+  CHECK_STRING("9.989999821e+11", formatFloat(9.99e11f, 9));
+  CHECK_STRING("9.999999795e+10", formatFloat(1e11f, 9));
+  CHECK_STRING("4e+9", formatFloat(4e9f, 9, true));
+  CHECK_STRING("123.456001282", formatFloat(123.456f, 9));
+  CHECK_STRING("2147483648.000000", formatFloat(2147483648.0f, 6));
+
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setField(1, 2147483648.0f, 9));
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setField(2, 9.99e11f, 9));
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setField(3, 1e11f, 9));
+  CHECK_STRING("field1=2.147483648e+9&field2=9.989999821e+11&field3=9.999999795e+10", writtenBody());
+}
+
+static void testSetField() {
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setField(1, 42));
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setField(2, -7L));
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setField(3, 21.5f));
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setField(4, 3.14159f, 2));
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setField(5, "abc"));
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setField(6, string("xyz")));
+  CHECK_STRING("field1=42&field2=-7&field3=21.5&field4=3.14&field5=abc&field6=xyz", writtenBody());
+}
+
+static void testSetFieldErrors() {
+  CHECK_EQUAL(ERR_INVALID_FIELD_NUM, thingSpeak.setField(0, 1));
+  CHECK_EQUAL(ERR_INVALID_FIELD_NUM, thingSpeak.setField(9, 1));
+  CHECK_EQUAL(ERR_OUT_OF_RANGE, thingSpeak.setField(1, string(256, 'x')));
+  CHECK_EQUAL(ERR_SETFIELD_NOT_CALLED, thingSpeak.writeFields(1, "KEY"));
+}
+
+static void testLocationAndStatus() {
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setField(1, 1));
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setLatitude(42.5f));
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setLongitude(-71.25f));
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setElevation(100.0f));
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setStatus("ok"));
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setCreatedAt("2024-01-02T03:04:05Z"));
+  CHECK_STRING("field1=1&status=ok&created_at=2024-01-02T03:04:05Z&lat=42.5&long=-71.25&elevation=100", writtenBody());
+}
+
+int main() {
+  thingSpeak.begin(&network);
+  RUN(testFormatLong);
+  RUN(testFormatUnsigned);
+  RUN(testFormatFloat);
+  RUN(testFormatFloatLarge);
+  RUN(testFormatFloatNineDecimals);
+  RUN(testSetField);
+  RUN(testSetFieldErrors);
+  RUN(testLocationAndStatus);
+  return TEST_RESULT();
+}
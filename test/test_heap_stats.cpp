@@ -0,0 +1,71 @@
+// Heap profiling of the public calls, built with THINGSPEAK_HEAP_STATS 1
+#include "ThingSpeak.h"
+#include "heap_tracking.h"
+#include "test.h"
+
+ThingSpeak thingSpeak;
+NetworkInterface network;
+
+// Copies the entry of api from a snapshot of the statistics, false if there is none
+static bool find(const char * api, ThingSpeakHeapStats * entry = NULL) {
+  ThingSpeakStats stats = thingSpeak.getStats();
+  for(size_t i = 0; i < THINGSPEAK_HEAP_STATS_APIS && NULL != stats.heap[i].api; i++) {
+    if(strcmp(stats.heap[i].api, api) == 0) {
+      if(NULL != entry) {
+        *entry = stats.heap[i];
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+static void testSetters() {
+  thingSpeak.resetStats();
+  for(int i = 0; i < 10; i++) {
+    thingSpeak.setField(1, i);
+    thingSpeak.setField(2, (float)i);
+  }
+  thingSpeak.setStatus("ok");
+  ThingSpeakHeapStats setField;
+  bool fFound = find("setField", &setField);
+  CHECK(fFound);
+  if(fFound) {
+    // the overloads share the entry, they don't allocate
+    CHECK_EQUAL(20, setField.calls);
+    CHECK_EQUAL(0, setField.allocatedBytes);
+    CHECK_EQUAL(0, setField.maxAllocatedBytes);
+  }
+  CHECK(find("setStatus"));
+}
+
+static void testRequests() {
+  FakeServer::instance().reset();
+  FakeServer::instance().replyAlways(200, "1");
+  thingSpeak.writeFields(1, "KEY");
+  thingSpeak.readLongField(1, 1, "KEY");
+
+  ThingSpeakHeapStats writeFields;
+  bool fFound = find("writeFields", &writeFields);
+  CHECK(fFound);
+  if(fFound) {
+    CHECK_EQUAL(1, writeFields.calls);
+    CHECK(writeFields.maxAllocatedBytes > 0);
+    CHECK(writeFields.allocatedBytes >= writeFields.maxAllocatedBytes);
+    CHECK_EQUAL(0, writeFields.allocFailures);
+  }
+  CHECK(find("readLongField"));
+  TypedChannel<TypedField<1, int>> channel(thingSpeak, 1, "KEY");
+  channel.write(5);
+  CHECK(find("TypedChannel::write"));
+
+  thingSpeak.resetStats();
+  CHECK(!find("writeFields"));
+}
+
+int main() {
+  thingSpeak.begin(&network);
+  RUN(testSetters);
+  RUN(testRequests);
+  return TEST_RESULT();
+}
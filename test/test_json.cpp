@@ -0,0 +1,94 @@
+// JSON scanning of ThingSpeakJSON and the feeds parsed by readLastFeed() and readFeed()
+#include "ThingSpeak.h"
+#include "heap_tracking.h"
+#include "test.h"
+
+ThingSpeak thingSpeak;
+NetworkInterface network;
+
+static const char * const keys[] = { "entry_id", "field1", "status", "nested", "missing" };
+
+static void testScan() {
+  const char json[] = " { \"entry_id\" : 12 , \"field1\":\"2.5\", \"nested\":{\"a\":[1,{\"b\":\"}\"}]}, \"status\":null } ";
+  ThingSpeakJSONValue values[5];
+  CHECK(ThingSpeakJSON::scan(json, strlen(json), keys, values, 5));
+
+  CHECK(values[0].fFound && !values[0].fString);
+  CHECK_STRING("12", string(values[0].value, values[0].length));
+  CHECK(values[1].fFound && values[1].fString);
+  CHECK_STRING("2.5", string(values[1].value, values[1].length));
+  CHECK(values[2].fFound && values[2].fNull);
+  CHECK(values[3].fFound);
+  CHECK_STRING("{\"a\":[1,{\"b\":\"}\"}]}", string(values[3].value, values[3].length));
+  CHECK(!values[4].fFound);
+}
+
+static void testScanErrors() {
+  ThingSpeakJSONValue values[5];
+  CHECK(!ThingSpeakJSON::scan("", 0, keys, values, 5));
+  CHECK(!ThingSpeakJSON::scan("[1,2]", 5, keys, values, 5));
+
+  // the values before the truncation are valid
+  const char truncated[] = "{\"entry_id\":3,\"field1\":\"ab";
+  CHECK(!ThingSpeakJSON::scan(truncated, strlen(truncated), keys, values, 5));
+  CHECK(values[0].fFound);
+  CHECK_STRING("3", string(values[0].value, values[0].length));
+  CHECK(!values[1].fFound);
+}
+
+static void testUnescape() {
+  const char json[] = "{\"field1\":\"a\\\"b\\\\c\\/d\\n\\u00e9\\u20ac\"}";
+  ThingSpeakJSONValue values[5];
+  CHECK(ThingSpeakJSON::scan(json, strlen(json), keys, values, 5));
+  char out[32];
+  size_t len = ThingSpeakJSON::unescape(values[1], out, sizeof(out));
+  CHECK_STRING("a\"b\\c/d\n\xC3\xA9\xE2\x82\xAC", string(out, len));
+
+  // truncated to the capacity, still terminated
+  len = ThingSpeakJSON::unescape(values[1], out, 4);
+  CHECK_EQUAL(3, len);
+  CHECK_STRING("a\"b", out);
+}
+
+static void testReadLastFeed() {
+  FakeServer::instance().reply(200, "{\"created_at\":\"2024-01-02T03:04:05Z\",\"entry_id\":77,\"field1\":\"1.5\",\"field3\":null,\"status\":\"ok \\\"x\\\"\"}");
+  FeedEntry entry;
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.readLastFeed(5, "RK", entry));
+  CHECK_STRING("/channels/5/feeds/last.json?status=true&location=true", FakeServer::instance().lastRequest().path);
+  CHECK_EQUAL(77, entry.entryID);
+  CHECK_STRING("2024-01-02T03:04:05Z", entry.createdAt);
+  CHECK_STRING("1.5", entry.getField(1));
+  CHECK_STRING("", entry.getField(3));
+  CHECK_STRING("ok \"x\"", entry.status);
+
+  FakeServer::instance().reply(200, "-1");
+  CHECK_EQUAL(ERR_BAD_RESPONSE, thingSpeak.readLastFeed(5, "RK", entry));
+}
+
+static void testReadFeed() {
+  FakeServer::instance().reply(200, "{\"channel\":{\"id\":5,\"name\":\"x\"},\"feeds\":["
+    "{\"created_at\":\"2024-01-01T00:00:00Z\",\"entry_id\":1,\"field1\":\"10\"},"
+    "{\"created_at\":\"2024-01-01T00:01:00Z\",\"entry_id\":2,\"field1\":\"11\",\"field2\":\"a,b\"},"
+    "{\"created_at\":\"2024-01-01T00:02:00Z\",\"entry_id\":3,\"field1\":null}]}");
+  std::vector<FeedEntry> entries;
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.readFeed(5, "results=3", "RK", [&entries](const FeedEntry & entry) { entries.push_back(entry); }));
+  CHECK_STRING("/channels/5/feeds.json?results=3", FakeServer::instance().lastRequest().path);
+  CHECK_EQUAL(3, entries.size());
+  if(entries.size() == 3) {
+    CHECK_EQUAL(1, entries[0].entryID);
+    CHECK_STRING("10", entries[0].getField(1));
+    CHECK_STRING("a,b", entries[1].getField(2));
+    CHECK_STRING("2024-01-01T00:02:00Z", entries[2].createdAt);
+    CHECK_STRING("", entries[2].getField(1));
+  }
+}
+
+int main() {
+  thingSpeak.begin(&network);
+  RUN(testScan);
+  RUN(testScanErrors);
+  RUN(testUnescape);
+  RUN(testReadLastFeed);
+  RUN(testReadFeed);
+  return TEST_RESULT();
+}
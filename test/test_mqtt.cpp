@@ -0,0 +1,118 @@
+// MQTT publishing with ThingSpeakMQTT against a fake broker: the CONNECT and PUBLISH packets, reconnects and refusals.
+// Built with THINGSPEAK_MQTT_KEEPALIVE 1, so the keep-alive period passes within a test.
+#include "ThingSpeak.h"
+#include "heap_tracking.h"
+#include "test.h"
+
+ThingSpeak thingSpeak;
+NetworkInterface network;
+
+static int connackCode;
+
+// Answers a CONNECT with a CONNACK carrying connackCode, PUBLISH with QoS 0 has no answer
+static string broker(const string & packet) {
+  if(!packet.empty() && (uint8_t)packet[0] == 0x10) {
+    return string("\x20\x02\x00", 3) + (char)connackCode;
+  }
+  return string();
+}
+
+static void startBroker(int code) {
+  FakeServer::instance().reset();
+  FakeServer::instance().serveRaw(broker);
+  connackCode = code;
+}
+
+static const string connectPacket = string("\x10\x19\x00\x04MQTT\x04\xC2\x00\x01", 12) + string("\x00\x03""cid", 5) +
+  string("\x00\x03""usr", 5) + string("\x00\x03""pwd", 5);
+static const string publishPacket = string("\x30\x1D\x00\x13", 4) + "channels/42/publish" + "field1=1";
+static const string disconnectPacket = string("\xE0\x00", 2);
+
+static void testConnectAndPublish() {
+  startBroker(0);
+  ThingSpeakMQTT mqtt;
+  mqtt.begin(&network, "cid", "usr", "pwd");
+
+  // the first update connects and is published in full after the CONNACK
+  long entryID = -1;
+  CHECK_EQUAL(OK_SUCCESS, mqtt.update(42, "KEY", "field1=1", 8, &entryID));
+  CHECK_EQUAL(0, entryID);
+  CHECK(connectPacket + publishPacket == FakeServer::instance().rawReceived());
+
+  // the next one reuses the connection
+  CHECK_EQUAL(OK_SUCCESS, mqtt.update(42, "KEY", "field1=1", 8, &entryID));
+  CHECK(connectPacket + publishPacket + publishPacket == FakeServer::instance().rawReceived());
+  CHECK_EQUAL(1, FakeServer::instance().connectCount());
+}
+
+static void testReconnectAfterKeepAlive() {
+  startBroker(0);
+  ThingSpeakMQTT mqtt;
+  mqtt.begin(&network, "cid", "usr", "pwd");
+  long entryID;
+  CHECK_EQUAL(OK_SUCCESS, mqtt.update(42, "KEY", "field1=1", 8, &entryID));
+
+  // idle past the keep-alive period, the connection is closed and opened again before the PUBLISH
+  ThisThread::sleep_for(1100);
+  CHECK_EQUAL(OK_SUCCESS, mqtt.update(42, "KEY", "field1=1", 8, &entryID));
+  CHECK(connectPacket + publishPacket + disconnectPacket + connectPacket + publishPacket == FakeServer::instance().rawReceived());
+  CHECK_EQUAL(2, FakeServer::instance().connectCount());
+}
+
+static void testRefused() {
+  long entryID;
+
+  // 4: bad user name or password, 5: not authorized, both mean wrong credentials
+  for(int code = 4; code <= 5; code++) {
+    startBroker(code);
+    ThingSpeakMQTT mqtt;
+    mqtt.begin(&network, "cid", "usr", "pwd");
+    CHECK_EQUAL(ERR_BADAPIKEY, mqtt.update(42, "KEY", "field1=1", 8, &entryID));
+    CHECK(connectPacket + disconnectPacket == FakeServer::instance().rawReceived());
+  }
+
+  // other codes, e.g. 3: server unavailable
+  startBroker(3);
+  ThingSpeakMQTT mqtt;
+  mqtt.begin(&network, "cid", "usr", "pwd");
+  CHECK_EQUAL(ERR_CONNECT_FAILED, mqtt.update(42, "KEY", "field1=1", 8, &entryID));
+}
+
+static void testConcurrentUpdates() {
+  startBroker(0);
+  ThingSpeakMQTT mqtt;
+  mqtt.begin(&network, "cid", "usr", "pwd");
+
+  // updates of two threads go out as whole packets, each encoded with the lock held
+  static const string otherPacket = string("\x30\x1D\x00\x13", 4) + "channels/43/publish" + "field2=2";
+  Thread other;
+  other.start([&mqtt] {
+    long entryID;
+    for(int i = 0; i < 20; i++) {
+      mqtt.update(43, "KEY", "field2=2", 8, &entryID);
+    }
+  });
+  long entryID;
+  for(int i = 0; i < 20; i++) {
+    mqtt.update(42, "KEY", "field1=1", 8, &entryID);
+  }
+  other.join();
+
+  string received = FakeServer::instance().rawReceived();
+  CHECK(received.compare(0, connectPacket.length(), connectPacket) == 0);
+  size_t publishes = 0;
+  for(size_t pos = connectPacket.length(); pos < received.length(); pos += publishPacket.length()) {
+    string packet = received.substr(pos, publishPacket.length());
+    CHECK(packet == publishPacket || packet == otherPacket);
+    publishes++;
+  }
+  CHECK_EQUAL(40, publishes);
+}
+
+int main() {
+  RUN(testConnectAndPublish);
+  RUN(testReconnectAfterKeepAlive);
+  RUN(testRefused);
+  RUN(testConcurrentUpdates);
+  return TEST_RESULT();
+}
@@ -0,0 +1,86 @@
+// Concurrent writes and writeChannels() over a pool of two connections, built with THINGSPEAK_POOL_SIZE 2
+#include "ThingSpeak.h"
+#include "heap_tracking.h"
+#include "test.h"
+
+ThingSpeak thingSpeak;
+NetworkInterface network;
+
+static void write(int value, int * status) {
+  WriteContext context;
+  context.setField(1, value);
+  *status = thingSpeak.writeFields(1, "KEY", context);
+}
+
+static void testConcurrentWrites() {
+  FakeServer::instance().reset();
+  FakeServer::instance().replyAlways(200, "1");
+  FakeServer::instance().setLatency(300);
+
+  // the second writer finds the shared payload buffer in use and takes the one of a pool slot
+  int status[3] = { 0, 0, 0 };
+  uint64_t start = Kernel::get_ms_count();
+  std::thread first(write, 1, &status[0]);
+  ThisThread::sleep_for(50);
+  std::thread second(write, 2, &status[1]);
+  first.join();
+  second.join();
+  uint64_t elapsed = Kernel::get_ms_count() - start;
+
+  CHECK_EQUAL(OK_SUCCESS, status[0]);
+  CHECK_EQUAL(OK_SUCCESS, status[1]);
+  CHECK(elapsed < 550);
+  std::vector<FakeRequest> requests = FakeServer::instance().requests();
+  CHECK_EQUAL(2, requests.size());
+  if(requests.size() == 2) {
+    CHECK_STRING("field1=1", requests[0].body);
+    CHECK_STRING("field1=2", requests[1].body);
+  }
+  FakeServer::instance().setLatency(0);
+
+  // one after the other the shared buffer is used again
+  write(3, &status[2]);
+  CHECK_EQUAL(OK_SUCCESS, status[2]);
+  CHECK_STRING("field1=3", FakeServer::instance().lastRequest().body);
+}
+
+static void testWriteChannels() {
+  FakeServer::instance().reset();
+  FakeServer::instance().replyAlways(200, "1");
+  FakeServer::instance().setLatency(200);
+  int threads = Thread::starts();
+
+  // the calling thread and one helper send the updates, the helper is started once and kept
+  for(int call = 0; call < 2; call++) {
+    WriteContext contexts[3];
+    ChannelWrite writes[3];
+    for(int i = 0; i < 3; i++) {
+      contexts[i].setField(1, i);
+      writes[i] = ChannelWrite(10 + i, "KEY", contexts[i]);
+    }
+    uint64_t start = Kernel::get_ms_count();
+    CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeChannels(writes, 3));
+    uint64_t elapsed = Kernel::get_ms_count() - start;
+    CHECK(elapsed >= 400 && elapsed < 550);
+    for(int i = 0; i < 3; i++) {
+      CHECK_EQUAL(OK_SUCCESS, writes[i].status);
+    }
+  }
+  CHECK_EQUAL(threads + 1, Thread::starts());
+  CHECK_EQUAL(6, FakeServer::instance().requestCount());
+  FakeServer::instance().setLatency(0);
+
+  // an update without a context fails alone
+  WriteContext context;
+  context.setField(1, 1);
+  ChannelWrite writes[2] = { ChannelWrite(), ChannelWrite(11, "KEY", context) };
+  CHECK_EQUAL(ERR_SETFIELD_NOT_CALLED, thingSpeak.writeChannels(writes, 2));
+  CHECK_EQUAL(OK_SUCCESS, writes[1].status);
+}
+
+int main() {
+  thingSpeak.begin(&network);
+  RUN(testConcurrentWrites);
+  RUN(testWriteChannels);
+  return TEST_RESULT();
+}
@@ -0,0 +1,312 @@
+// Offline store: the log of ThingSpeakStore on a RAM block device and the updates kept and forwarded by ThingSpeak
+#include "ThingSpeak.h"
+#include "heap_tracking.h"
+#include "test.h"
+
+ThingSpeak thingSpeak;
+NetworkInterface network;
+
+// 4 segments of 512 bytes, programmed in units of 8 bytes
+static HeapBlockDevice * newDevice() {
+  return new HeapBlockDevice(2048, 8, 512);
+}
+
+// Reads all pending entries, returns them separated by '|'
+static string readAll(ThingSpeakStore & store, uint32_t * sequence, uint32_t * offset, unsigned int * count) {
+  string entries;
+  char entry[THINGSPEAK_STORE_BUFFER_SIZE];
+  store.getReadPosition(sequence, offset);
+  *count = 0;
+  for(size_t len; (len = store.readNext(sequence, offset, entry, sizeof(entry))) > 0; (*count)++) {
+    if(!entries.empty())
+      entries += "|";
+    entries.append(entry, len);
+  }
+  return entries;
+}
+
+static void testAppendAndCommit() {
+  HeapBlockDevice * bd = newDevice();
+  ThingSpeakStore store;
+  CHECK(store.mount(bd));
+  CHECK_EQUAL(0, store.getPendingCount());
+  CHECK(store.append("one", 3));
+  CHECK(store.append("two", 3));
+  CHECK(store.append("three", 5));
+  CHECK_EQUAL(3, store.getPendingCount());
+
+  uint32_t sequence, offset;
+  unsigned int count;
+  CHECK_STRING("one|two|three", readAll(store, &sequence, &offset, &count));
+  CHECK_EQUAL(3, count);
+  CHECK(store.commit(sequence, offset, count));
+  CHECK_EQUAL(0, store.getPendingCount());
+  CHECK(store.append("four", 4));
+  CHECK_STRING("four", readAll(store, &sequence, &offset, &count));
+  CHECK_EQUAL(0, bd->faults);
+  delete bd;
+}
+
+static void testRemount() {
+  HeapBlockDevice * bd = newDevice();
+  {
+    ThingSpeakStore store;
+    CHECK(store.mount(bd));
+    store.append("a", 1);
+    store.append("b", 1);
+    uint32_t sequence, offset;
+    char entry[8];
+    store.getReadPosition(&sequence, &offset);
+    CHECK_EQUAL(1, store.readNext(&sequence, &offset, entry, sizeof(entry)));
+    CHECK(store.commit(sequence, offset, 1));
+    store.append("c", 1);
+  }
+
+  // a reset keeps the entries not forwarded and the write position
+  ThingSpeakStore store;
+  CHECK(store.mount(bd));
+  CHECK_EQUAL(2, store.getPendingCount());
+  CHECK(store.append("d", 1));
+  uint32_t sequence, offset;
+  unsigned int count;
+  CHECK_STRING("b|c|d", readAll(store, &sequence, &offset, &count));
+  CHECK_EQUAL(0, bd->faults);
+  delete bd;
+}
+
+static void testFullLogDropsOldest() {
+  HeapBlockDevice * bd = newDevice();
+  ThingSpeakStore store;
+  CHECK(store.mount(bd));
+  string entry(100, 'x');
+  for(int i = 0; i < 40; i++) {
+    entry[0] = (char)('A' + i % 26);
+    CHECK(store.append(entry.data(), entry.length()));
+  }
+
+  // the oldest segments were erased in ring order, the newest entries are kept
+  CHECK(store.getPendingCount() > 0);
+  CHECK(store.getPendingCount() < 40);
+  uint32_t sequence, offset;
+  unsigned int count;
+  string entries = readAll(store, &sequence, &offset, &count);
+  CHECK_EQUAL(store.getPendingCount(), count);
+  CHECK_EQUAL((char)('A' + 39 % 26), entries[entries.length() - entry.length()]);
+  CHECK(bd->erases >= 10);
+  CHECK_EQUAL(0, bd->faults);
+
+  ThingSpeakStore remounted;
+  CHECK(remounted.mount(bd));
+  CHECK_EQUAL(count, remounted.getPendingCount());
+  delete bd;
+}
+
+static void testTornRecord() {
+  HeapBlockDevice * bd = newDevice();
+  {
+    ThingSpeakStore store;
+    CHECK(store.mount(bd));
+    store.append("good", 4);
+    store.append("torn", 4);
+  }
+  // break the payload of the last record, its checksum does not match
+  for(size_t i = 0; i + 4 <= bd->memory.size(); i++) {
+    if(memcmp(&bd->memory[i], "torn", 4) == 0) {
+      bd->memory[i] = 'X';
+    }
+  }
+
+  ThingSpeakStore store;
+  CHECK(store.mount(bd));
+  CHECK_EQUAL(1, store.getPendingCount());
+  CHECK(store.append("next", 4));
+  uint32_t sequence, offset;
+  unsigned int count;
+  CHECK_STRING("good|next", readAll(store, &sequence, &offset, &count));
+  CHECK_EQUAL(0, bd->faults);
+  delete bd;
+}
+
+static void testGeometry() {
+  // the log needs at least two segments
+  HeapBlockDevice single(512, 8, 512);
+  ThingSpeakStore store;
+  CHECK(!store.mount(&single));
+  CHECK(!thingSpeak.beginStore(&single));
+  CHECK_EQUAL(ERR_STORE_FAILED, thingSpeak.storeFields());
+}
+
+static void testWriteFieldsStoresFailedUpdates() {
+  HeapBlockDevice * bd = newDevice();
+  CHECK(thingSpeak.beginStore(bd));
+  CHECK_EQUAL(0, thingSpeak.getStoredCount());
+  set_time(1704164645);  // 2024-01-02T03:04:05Z
+
+  FakeServer::instance().reset();
+  FakeServer::instance().reply(500);
+  thingSpeak.setField(1, 1);
+  CHECK_EQUAL(500, thingSpeak.writeFields(3, "KEY"));
+  FakeServer::instance().failConnect(true);
+  thingSpeak.setField(1, 2);
+  CHECK_EQUAL(ERR_CONNECT_FAILED, thingSpeak.writeFields(3, "KEY"));
+  FakeServer::instance().failConnect(false);
+  thingSpeak.setField(1, 3);
+  thingSpeak.setCreatedAt("2024-01-02T03:04:05Z");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.storeFields());
+  CHECK_EQUAL(3, thingSpeak.getStoredCount());
+
+  // forwarded with one bulk update, the store is empty once it was accepted
+  FakeServer::instance().clearLog();
+  FakeServer::instance().reply(500);
+  CHECK_EQUAL(500, thingSpeak.writeStored(3, "KEY"));
+  CHECK_EQUAL(3, thingSpeak.getStoredCount());
+  FakeServer::instance().reply(202);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeStored(3, "KEY"));
+  CHECK_EQUAL(0, thingSpeak.getStoredCount());
+  FakeRequest request = FakeServer::instance().lastRequest();
+  CHECK_STRING("/channels/3/bulk_update.json", request.path);
+  CHECK_STRING("{\"write_api_key\":\"KEY\",\"updates\":["
+    "{\"field1\":\"1\",\"created_at\":\"2024-01-02T03:04:05Z\"},"
+    "{\"field1\":\"2\",\"created_at\":\"2024-01-02T03:04:05Z\"},"
+    "{\"field1\":\"3\",\"created_at\":\"2024-01-02T03:04:05Z\"}]}", request.body);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeStored(3, "KEY"));
+  CHECK_EQUAL(0, bd->faults);
+}
+
+static void testCreatedAtOnlyWhenStored() {
+  set_time(1704164645);
+
+  // a live write goes out without a timestamp, ThingSpeak takes the time it receives it
+  FakeServer::instance().reset();
+  FakeServer::instance().reply(200, "5");
+  thingSpeak.setField(1, 1);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeFields(3, "KEY"));
+  CHECK_STRING("field1=1", FakeServer::instance().lastRequest().body);
+}
+
+static void testNoTimestampIsNotStored() {
+  set_time(0);
+  unsigned int stored = thingSpeak.getStoredCount();
+
+  thingSpeak.setField(1, 7);
+  CHECK_EQUAL(ERR_NO_TIMESTAMP, thingSpeak.storeFields());
+  CHECK_EQUAL(stored, thingSpeak.getStoredCount());
+
+  // the update stays staged, with a created-at time it can be stored
+  thingSpeak.setCreatedAt("2024-01-02T03:04:05Z");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.storeFields());
+  CHECK_EQUAL(stored + 1, thingSpeak.getStoredCount());
+
+  FakeServer::instance().reset();
+  FakeServer::instance().reply(500);
+  thingSpeak.setField(1, 8);
+  CHECK_EQUAL(500, thingSpeak.writeFields(3, "KEY"));
+  CHECK_EQUAL(stored + 1, thingSpeak.getStoredCount());
+}
+
+static void testFullQueueMovesOldestToStore() {
+  set_time(1704164645);
+  thingSpeak.resetStats();
+  FakeServer::instance().reset();
+  FakeServer::instance().replyAlways(500);
+  unsigned int stored = thingSpeak.getStoredCount();
+
+  // the queue fills up and can't be sent, the oldest entry goes to the store with the time traced back from the RTC
+  for(int i = 0; i < THINGSPEAK_BULK_MAX_ENTRIES; i++) {
+    thingSpeak.setField(1, i);
+    thingSpeak.queueFields(3, "KEY", i == 0 ? 0 : 10);
+  }
+  thingSpeak.setField(1, 99);
+  CHECK_EQUAL(500, thingSpeak.queueFields(3, "KEY", 10));
+  CHECK_EQUAL(stored + 1, thingSpeak.getStoredCount());
+  CHECK_EQUAL(1, thingSpeak.getStats().bulkStored);
+  CHECK_EQUAL(0, thingSpeak.getStats().bulkDropped);
+
+  // without the RTC a relative timestamp can't be stored, the entry is dropped and counted
+  set_time(0);
+  thingSpeak.setField(1, 100);
+  CHECK_EQUAL(500, thingSpeak.queueFields(3, "KEY", 10));
+  CHECK_EQUAL(stored + 1, thingSpeak.getStoredCount());
+  CHECK_EQUAL(1, thingSpeak.getStats().bulkDropped);
+
+  // the stored entry is forwarded ahead of the queue
+  FakeServer::instance().reset();
+  FakeServer::instance().replyAlways(202);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeStored(3, "KEY"));
+  CHECK_EQUAL(0, thingSpeak.getStoredCount());
+  std::vector<FakeRequest> requests = FakeServer::instance().requests();
+  CHECK(!requests.empty());
+  CHECK(requests.back().body.find("{\"field1\":\"0\",\"created_at\":\"2024-01-02T03:01:35Z\"}") != string::npos);
+}
+
+static void testTypedChannelFailedWritesAreStored() {
+  TypedChannel<TypedField<1, float>, TypedField<3, int>, TypedField<5, const char *>> channel(thingSpeak, 3, "KEY");
+  unsigned int stored = thingSpeak.getStoredCount();
+  FakeServer::instance().reset();
+  FakeServer::instance().failConnect(true);
+
+  // without the RTC the update has no time and is not stored
+  set_time(0);
+  CHECK_EQUAL(ERR_CONNECT_FAILED, channel.write(21.5f, 4, "a&b"));
+  CHECK_EQUAL(stored, thingSpeak.getStoredCount());
+
+  set_time(1704164645);
+  CHECK_EQUAL(ERR_CONNECT_FAILED, channel.write(21.5f, 4, "a&b"));
+  CHECK_EQUAL(stored + 1, thingSpeak.getStoredCount());
+
+  FakeServer::instance().failConnect(false);
+  FakeServer::instance().replyAlways(202);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeStored(3, "KEY"));
+  CHECK(FakeServer::instance().lastRequest().body.find(
+    "{\"field1\":\"21.5\",\"field3\":\"4\",\"field5\":\"a&b\",\"created_at\":\"2024-01-02T03:04:05Z\"}") != string::npos);
+}
+
+static void testFailedAsyncWriteIsStored() {
+  set_time(1704164645);
+  unsigned int stored = thingSpeak.getStoredCount();
+  FakeServer::instance().reset();
+  FakeServer::instance().replyAlways(503);
+
+  static std::atomic<int> doneStatus;
+  doneStatus = 0;
+  thingSpeak.setField(1, 6);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeFieldsAsync(3, "KEY", [](int status, long) { doneStatus = status; }));
+  for(int i = 0; i < 200 && doneStatus == 0; i++) {
+    ThisThread::sleep_for(10);
+  }
+
+  // the update is stored by the time done is called, with the time it was queued
+  CHECK_EQUAL(503, doneStatus);
+  CHECK_EQUAL(stored + 1, thingSpeak.getStoredCount());
+  FakeServer::instance().reset();
+  FakeServer::instance().replyAlways(202);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeStored(3, "KEY"));
+  CHECK(FakeServer::instance().lastRequest().body.find("{\"field1\":\"6\",\"created_at\":\"2024-01-02T03:04:05Z\"}") != string::npos);
+
+  // a write that was answered is not stored
+  doneStatus = 0;
+  FakeServer::instance().replyAlways(400);
+  thingSpeak.setField(1, 7);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeFieldsAsync(3, "KEY", [](int status, long) { doneStatus = status; }));
+  for(int i = 0; i < 200 && doneStatus == 0; i++) {
+    ThisThread::sleep_for(10);
+  }
+  CHECK_EQUAL(ERR_BADAPIKEY, doneStatus);
+  CHECK_EQUAL(0, thingSpeak.getStoredCount());
+}
+
+int main() {
+  thingSpeak.begin(&network);
+  RUN(testAppendAndCommit);
+  RUN(testRemount);
+  RUN(testFullLogDropsOldest);
+  RUN(testTornRecord);
+  RUN(testGeometry);
+  RUN(testWriteFieldsStoresFailedUpdates);
+  RUN(testCreatedAtOnlyWhenStored);
+  RUN(testNoTimestampIsNotStored);
+  RUN(testFullQueueMovesOldestToStore);
+  RUN(testTypedChannelFailedWritesAreStored);
+  RUN(testFailedAsyncWriteIsStored);
+  return TEST_RESULT();
+}
@@ -0,0 +1,251 @@
+// Writes and reads against the fake server: status codes, connection failures, timeouts, retries, pipelined reads and
+// a power managed interface that fails to connect
+#include "ThingSpeak.h"
+#include "heap_tracking.h"
+#include "test.h"
+
+ThingSpeak thingSpeak;
+NetworkInterface network;
+
+static void testWrite() {
+  FakeServer::instance().reset();
+  FakeServer::instance().reply(200, "17");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeField(4, 2, 1.5f, "WKEY"));
+  FakeRequest request = FakeServer::instance().lastRequest();
+  CHECK_STRING("POST", request.method);
+  CHECK_STRING("/update?headers=false", request.path);
+  CHECK_STRING("WKEY", request.header("X-THINGSPEAKAPIKEY"));
+  CHECK_STRING("application/x-www-form-urlencoded", request.header("Content-Type"));
+  CHECK_STRING("field2=1.5", request.body);
+
+  FakeServer::instance().reply(200, "18");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeRaw(4, "field1=3&status=x", "WKEY"));
+  CHECK_STRING("field1=3&status=x", FakeServer::instance().lastRequest().body);
+}
+
+static void testWriteErrors() {
+  FakeServer::instance().reset();
+
+  // ThingSpeak answers 0 if the update was not inserted, e.g. due to the rate limit
+  FakeServer::instance().reply(200, "0");
+  CHECK_EQUAL(ERR_NOT_INSERTED, thingSpeak.writeField(4, 1, 1, "WKEY"));
+  FakeServer::instance().reply(400);
+  CHECK_EQUAL(ERR_BADAPIKEY, thingSpeak.writeField(4, 1, 1, "WRONG"));
+
+  FakeServer::instance().failConnect(true);
+  CHECK_EQUAL(ERR_CONNECT_FAILED, thingSpeak.writeField(4, 1, 1, "WKEY"));
+  FakeServer::instance().failConnect(false);
+  CHECK_EQUAL(ERR_INVALID_FIELD_NUM, thingSpeak.writeField(4, 9, 1, "WKEY"));
+}
+
+static void testReconnect() {
+  FakeServer::instance().reset();
+  FakeServer::instance().reply(200, "1");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeField(4, 1, 1, "WKEY"));
+  int connects = FakeServer::instance().connectCount();
+
+  // the kept connection is reused, once the server closed it the request is sent again on a new one
+  FakeServer::instance().reply(200, "2");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeField(4, 1, 2, "WKEY"));
+  CHECK_EQUAL(connects, FakeServer::instance().connectCount());
+  FakeServer::instance().reply(0);
+  FakeServer::instance().reply(200, "3");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeField(4, 1, 3, "WKEY"));
+  CHECK_EQUAL(connects + 1, FakeServer::instance().connectCount());
+  CHECK_EQUAL(4, FakeServer::instance().requestCount());
+
+  // a new connection closed without a response fails the write
+  FakeServer::instance().reply(0);
+  FakeServer::instance().reply(0);
+  CHECK_EQUAL(ERR_CONNECT_FAILED, thingSpeak.writeField(4, 1, 4, "WKEY"));
+}
+
+static void testRead() {
+  FakeServer::instance().reset();
+  FakeServer::instance().reply(200, "42");
+  CHECK_EQUAL(42, thingSpeak.readLongField(7, 3, "RKEY"));
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.getLastReadStatus());
+  FakeRequest request = FakeServer::instance().lastRequest();
+  CHECK_STRING("GET", request.method);
+  CHECK_STRING("/channels/7/fields/3/last", request.path);
+  CHECK_STRING("RKEY", request.header("X-THINGSPEAKAPIKEY"));
+
+  FakeServer::instance().reply(200, "hello");
+  CHECK_STRING("hello", thingSpeak.readStringField(7, 1));
+  CHECK_STRING("", FakeServer::instance().lastRequest().header("X-THINGSPEAKAPIKEY"));
+
+  FakeServer::instance().reply(200, "{\"created_at\":\"2024-01-02T03:04:05Z\",\"entry_id\":5,\"status\":\"fine\"}");
+  CHECK_STRING("fine", thingSpeak.readStatus(7, "RKEY"));
+  CHECK_STRING("/channels/7/feeds/last.txt?status=true", FakeServer::instance().lastRequest().path);
+
+  FakeServer::instance().reply(404);
+  CHECK_EQUAL(0, thingSpeak.readIntField(7, 1, "RKEY"));
+  CHECK_EQUAL(ERR_BADURL, thingSpeak.getLastReadStatus());
+
+  ReadResult result;
+  CHECK_EQUAL(ERR_INVALID_FIELD_NUM, thingSpeak.readField(7, 0, "RKEY", result));
+  FakeServer::instance().reply(200, "2.5");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.readField(7, 1, "RKEY", result));
+  CHECK_STRING("2.5", result.value);
+  CHECK(result.toFloat() == 2.5f);
+}
+
+static void testTimeout() {
+  FakeServer::instance().reset();
+  thingSpeak.setTimeout(200);
+
+  // a server answering after the timeout fails the request in about the timeout
+  FakeServer::instance().reply(200, "1", {}, 1000);
+  uint64_t start = Kernel::get_ms_count();
+  CHECK_EQUAL(ERR_TIMEOUT, thingSpeak.writeField(4, 1, 1, "WKEY"));
+  uint64_t elapsed = Kernel::get_ms_count() - start;
+  CHECK(elapsed >= 150 && elapsed < 900);
+
+  FakeServer::instance().reply(200, "1", {}, 1000);
+  CHECK_EQUAL(0, thingSpeak.readIntField(7, 1, "RKEY"));
+  CHECK_EQUAL(ERR_TIMEOUT, thingSpeak.getLastReadStatus());
+
+  // a per-call timeout bounds the whole call
+  FakeServer::instance().reply(200, "1", {}, 1000);
+  ReadResult result;
+  start = Kernel::get_ms_count();
+  CHECK_EQUAL(ERR_TIMEOUT, thingSpeak.readField(7, 1, "RKEY", result, 100));
+  CHECK(Kernel::get_ms_count() - start < 180);
+
+  thingSpeak.setTimeout(TIMEOUT_MS_SERVERRESPONSE);
+}
+
+static void testRetry() {
+  FakeServer::instance().reset();
+  thingSpeak.setRetryPolicy(3, 10, 20);
+  FakeServer::instance().reply(500);
+  FakeServer::instance().reply(503);
+  FakeServer::instance().reply(200, "9");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeField(4, 1, 1, "WKEY"));
+  CHECK_EQUAL(3, FakeServer::instance().requestCount());
+
+  // client errors are not retried
+  FakeServer::instance().clearLog();
+  FakeServer::instance().reply(400);
+  CHECK_EQUAL(ERR_BADAPIKEY, thingSpeak.writeField(4, 1, 1, "WKEY"));
+  CHECK_EQUAL(1, FakeServer::instance().requestCount());
+  thingSpeak.setRetryPolicy(THINGSPEAK_RETRY_ATTEMPTS, THINGSPEAK_RETRY_BASE_DELAY, THINGSPEAK_RETRY_MAX_DELAY);
+}
+
+static void testPipelined() {
+  FakeServer::instance().reset();
+  FakeServer::instance().reply(200, "1");
+  FakeServer::instance().reply(200, "2");
+  FakeServer::instance().reply(404);
+  FakeServer::instance().reply(200, "{\"a\":1}");
+  ChannelRead reads[] = {
+    ChannelRead(1, 1, "K1"),
+    ChannelRead(2, 2),
+    ChannelRead(3, 9, "K3"),
+    ChannelRead(3, 1, "K3"),
+    ChannelRead(4, "/feeds.json?results=1", "K4")
+  };
+  ReadResult results[5];
+  CHECK_EQUAL(ERR_INVALID_FIELD_NUM, thingSpeak.readPipelined(reads, 5, results));
+  CHECK_EQUAL(OK_SUCCESS, results[0].status);
+  CHECK_STRING("1", results[0].value);
+  CHECK_STRING("2", results[1].value);
+  CHECK_EQUAL(ERR_INVALID_FIELD_NUM, results[2].status);
+  CHECK_EQUAL(ERR_BADURL, results[3].status);
+  CHECK_STRING("{\"a\":1}", results[4].value);
+
+  std::vector<FakeRequest> requests = FakeServer::instance().requests();
+  CHECK_EQUAL(4, requests.size());
+  if(requests.size() == 4) {
+    CHECK_STRING("/channels/1/fields/1/last", requests[0].path);
+    CHECK_STRING("K1", requests[0].header("X-THINGSPEAKAPIKEY"));
+    CHECK_STRING("/channels/4/feeds.json?results=1", requests[3].path);
+  }
+}
+
+static void testStats() {
+  thingSpeak.resetStats();
+  FakeServer::instance().reset();
+  FakeServer::instance().reply(200, "1");
+  FakeServer::instance().reply(404);
+  thingSpeak.writeField(4, 1, 1, "WKEY");
+  thingSpeak.readIntField(7, 1, "RKEY");
+  ThingSpeakStats stats = thingSpeak.getStats();
+  CHECK_EQUAL(2, stats.requests);
+  CHECK(stats.bytesSent > 0);
+  CHECK(stats.bytesReceived > 0);
+
+  // the hook runs with the statistics unlocked and sees the request counted
+  static unsigned long requestsSeen;
+  requestsSeen = 0;
+  thingSpeak.setStatsHook([](const ThingSpeakRequestStats &) { requestsSeen = thingSpeak.getStats().requests; });
+  FakeServer::instance().reply(200, "2");
+  thingSpeak.writeField(4, 1, 2, "WKEY");
+  CHECK_EQUAL(3, requestsSeen);
+  thingSpeak.setStatsHook(nullptr);
+}
+
+static void testSwapPayloadBuffer() {
+  FakeServer::instance().reset();
+  FakeServer::instance().reply(200, "1", {}, 200);
+
+  // the buffer is not swapped under a write in flight, the call waits for it
+  Thread writer;
+  writer.start([] {
+    thingSpeak.setField(1, 1);
+    thingSpeak.writeFields(4, "WKEY");
+  });
+  ThisThread::sleep_for(50);
+  static char buffer[64];
+  uint64_t start = Kernel::get_ms_count();
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setPayloadBuffer(buffer, sizeof(buffer)));
+  CHECK(Kernel::get_ms_count() - start >= 100);
+  writer.join();
+  CHECK_STRING("field1=1", FakeServer::instance().lastRequest().body);
+
+  FakeServer::instance().reply(200, "2");
+  thingSpeak.setField(1, 2);
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeFields(4, "WKEY"));
+  CHECK_STRING("field1=2", string(buffer, 8));
+  thingSpeak.setPayloadBuffer(NULL, 0);
+}
+
+static void testPowerManagedConnectFailure() {
+  FakeServer::instance().reset();
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setPowerManagement(3600000));
+  CHECK_EQUAL(1, FakeServer::instance().interfaceDisconnectCount());
+
+  // a request fails right away if the interface can't be connected, nothing reaches the server
+  FakeServer::instance().failInterface(true);
+  CHECK_EQUAL(ERR_CONNECT_FAILED, thingSpeak.writeField(4, 1, 1, "WKEY"));
+  CHECK_EQUAL(0, thingSpeak.readIntField(7, 1, "RKEY"));
+  CHECK_EQUAL(ERR_CONNECT_FAILED, thingSpeak.getLastReadStatus());
+  CHECK_EQUAL(0, FakeServer::instance().requestCount());
+  CHECK_EQUAL(0, FakeServer::instance().connectCount());
+
+  // ending the power management reports a failed reconnect and tries again the next time
+  CHECK_EQUAL(ERR_CONNECT_FAILED, thingSpeak.setPowerManagement(0));
+  FakeServer::instance().failInterface(false);
+  int connects = FakeServer::instance().interfaceConnectCount();
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.setPowerManagement(0));
+  CHECK_EQUAL(connects + 1, FakeServer::instance().interfaceConnectCount());
+
+  FakeServer::instance().reply(200, "1");
+  CHECK_EQUAL(OK_SUCCESS, thingSpeak.writeField(4, 1, 1, "WKEY"));
+  CHECK_EQUAL(connects + 1, FakeServer::instance().interfaceConnectCount());
+}
+
+int main() {
+  thingSpeak.begin(&network);
+  RUN(testWrite);
+  RUN(testWriteErrors);
+  RUN(testReconnect);
+  RUN(testRead);
+  RUN(testTimeout);
+  RUN(testRetry);
+  RUN(testPipelined);
+  RUN(testStats);
+  RUN(testSwapPayloadBuffer);
+  RUN(testPowerManagedConnectFailure);
+  return TEST_RESULT();
+}